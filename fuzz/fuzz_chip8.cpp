@@ -0,0 +1,120 @@
+/*
+ * fuzz_chip8.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Fuzz target for the cpu core. Works with libFuzzer (LLVMFuzzerTestOneInput)
+ * and AFL (persistent mode when built with afl-clang-fast++). Built without
+ * either, it replays inputs from files given on the command line or stdin.
+ *
+ * Input layout:
+ *   [0..1]  rom length, big endian (clamped to what is left)
+ *   [2..]   rom bytes
+ *   [...]   keypad masks, 2 bytes each (big endian), one per frame
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <chip8.h>
+
+#define FUZZ_IPF 16
+#define FUZZ_MAX_FRAMES 64
+#define FUZZ_EXTRA_FRAMES 8 // frames to keep running after the script ends
+
+static Chip8 *machine()
+{
+    static Chip8 *chip8 = nullptr;
+    if (chip8 == nullptr) {
+        chip8 = new Chip8(nullptr, 0, true);
+        chip8->set_verbose(false);
+        chip8->set_ipf(FUZZ_IPF);
+    }
+    return chip8;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 2)
+        return 0;
+    size_t romlen = ((size_t)data[0] << 8) | data[1];
+    data += 2;
+    size -= 2;
+    if (romlen > size)
+        romlen = size;
+
+    // restores a blank snapshot, no new machine per input, and copies the
+    // rom into the machine's own pages rather than caching an image of it
+    Chip8 *chip8 = machine();
+    if (!chip8->load_rom(data, romlen, true))
+        return 0;
+    data += romlen;
+    size -= romlen;
+
+    size_t nkeys = size / 2;
+    size_t nframes = nkeys + FUZZ_EXTRA_FRAMES;
+    if (nframes > FUZZ_MAX_FRAMES)
+        nframes = FUZZ_MAX_FRAMES;
+
+    try {
+        for (size_t f = 0; f < nframes; f++) {
+            uint16_t keys = 0;
+            if (f < nkeys)
+                keys = ((uint16_t)data[2*f] << 8) | data[2*f + 1];
+            chip8->run_frame(keys);
+        }
+    } catch (const Fault &) {
+        // faults are expected from random roms, crashes are not
+    }
+    return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+
+static std::vector<uint8_t> read_all(FILE *f)
+{
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        buf.insert(buf.end(), chunk, chunk + n);
+    }
+    return buf;
+}
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    __AFL_INIT();
+    unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(10000)) {
+        LLVMFuzzerTestOneInput(buf, __AFL_FUZZ_TESTCASE_LEN);
+    }
+    (void)argc;
+    (void)argv;
+#else
+    if (argc < 2) {
+        std::vector<uint8_t> in = read_all(stdin);
+        LLVMFuzzerTestOneInput(in.data(), in.size());
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *f = std::fopen(argv[i], "rb");
+        if (f == NULL) {
+            std::fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> in = read_all(f);
+        std::fclose(f);
+        LLVMFuzzerTestOneInput(in.data(), in.size());
+    }
+#endif
+    return 0;
+}
+
+#endif
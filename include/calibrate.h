@@ -0,0 +1,17 @@
+#ifndef _CALIBRATE_H
+#define _CALIBRATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+#define CALIBRATE_FRAMES 1200  // 20 seconds of emulated time
+#define CALIBRATE_MAX_IPF 256  // the "as fast as it likes" reference
+
+uint16_t script_keys(uint32_t frame);
+uint64_t frames_digest(const uint8_t *rom, size_t len, uint8_t quirks, uint ipf, uint frames,
+                       bool *drew = nullptr);
+uint calibrate_ipf(const uint8_t *rom, size_t len, uint8_t quirks,
+                   uint frames = CALIBRATE_FRAMES);
+
+#endif
@@ -4,61 +4,268 @@
 #include <cstdint>
 #include <mem.h>
 #include <periphs.h>
+#include <frontend.h>
+#include <fault.h>
+#include <trace.h>
+#include <perf.h>
+#include <shm_export.h>
+#include <stream.h>
+#include <quirks.h>
+#include <screen.h>
+#include <memory>
 #include <string>
-#include <stack>
+#include <vector>
 
-#define NUM_INSTR 35
-#define NUM_OPS 16
+#define IDLE_FOREVER UINT32_MAX // idle_frames() of a machine that never wakes
+#define STACK_DEPTH 16          // nested 2NNN calls
+#define EXT_FLAGS 16            // FX75/FX85 flag registers, SUPER-CHIP only has 8
 
-typedef struct Instr {
-    uint16_t raw;
-    uint8_t op;
-    uint16_t nnn;
-    uint8_t nn;
-    uint8_t n;
-    uint8_t vx;
-    uint8_t vy;
-} Instr;
+/*
+ * What run_until() and run_frame_coop() hand back, the same types for every
+ * machine spec so hosts can drive any of them.
+ */
+class Chip8Base {
+public:
+    // how run_frame_coop() ended its frame
+    enum Yield {
+        YIELD_FRAME,    // ran every instruction of the frame
+        YIELD_KEY_WAIT, // stopped in FX0A with no key held
+        YIELD_IDLE,     // stopped in a loop that only waits, see idle_frames()
+    };
+
+    // when run_until() returns; limits left at their defaults never stop it
+    struct RunLimits {
+        uint64_t frames = 0;        // frames run
+        uint64_t instrs = 0;        // instructions run
+        int32_t pc = -1;            // pc about to run this address
+        bool match_hash = false;
+        uint64_t frame_hash = 0;    // framebuffer hashes to this after a frame
+        bool halt = false;          // nothing but spinning left, forever
+        double seconds = 0;         // wall clock
+    };
+
+    enum StopReason {
+        STOP_FRAMES,
+        STOP_INSTRS,
+        STOP_PC,
+        STOP_FRAME_HASH,
+        STOP_HALT,
+        STOP_TIME,
+        STOP_FAULT,
+    };
+
+    struct RunResult {
+        StopReason reason;
+        uint64_t frames;            // run by this call, a partial one included
+        uint64_t instrs;
+        double seconds;
+        // the machine as it was left
+        uint16_t pc;
+        uint16_t I;
+        uint8_t V[16];
+        uint8_t timer;
+        uint64_t frame_hash;
+        // for STOP_FAULT
+        FaultType fault;
+        uint16_t fault_addr;
+        uint16_t fault_pc;
+        uint16_t fault_opcode;
+        std::string fault_msg;
+    };
+
+    static const char *stop_name(StopReason reason);
+    // about the instruction rate the old per-instruction pacing gave
+    static uint ipf_for_clock(uint clock_speed) { return 16 + 3*((int)clock_speed - 5); }
+};
+
+// CHIP-8: 4KB, the 64x32 screen Periphs keeps, no extended instructions
+struct Chip8Spec {
+    static constexpr const char *NAME = "chip8";
+    static constexpr uint32_t MEM_BYTES = MEM_SIZE;
+    static constexpr uint WIDTH = FRAME_WIDTH;
+    static constexpr uint HEIGHT = FRAME_HEIGHT;
+    static constexpr uint PLANES = 1;
+    static constexpr bool EXTENDED = false; // SUPER-CHIP instructions and screen
+    static constexpr bool XO = false;       // XO-CHIP on top of those
+    static constexpr uint IPF = 10;         // clock speed 3
+    static constexpr uint8_t QUIRKS = 0;
+};
+
+/*
+ * Registers only the extended machines have: their own screen in place of
+ * the one in Periphs, its mode and planes, the flag registers and the sound
+ * timer. CHIP-8 gets none of them.
+ */
+template<typename Spec, bool = Spec::EXTENDED>
+struct ExtRegs {
+};
+
+template<typename Spec>
+struct ExtRegs<Spec, true> {
+    Screen<Spec::WIDTH, Spec::HEIGHT, Spec::PLANES> screen;
+    bool hires = false;
+    uint8_t planes = 1;     // planes DXYN, 00E0 and scrolls act on
+    uint8_t flags[EXT_FLAGS] = {0};
+    uint8_t sound = 0;
+};
+
+/*
+ * The interpreter, built once per machine spec (memory size, screen, which
+ * instruction set and the defaults it runs with; see Chip8Spec and
+ * xochip.h). Every opcode and every run loop exists once, and everything a
+ * machine can do (snapshots, forks, traces, profiling, exports, run-ahead)
+ * works the same for all of them. The spec's sizes are constants in every
+ * loop and the opcodes a spec doesn't have aren't in its op table.
+ */
+template<typename Spec>
+class BasicChip8 : public Chip8Base {
+    template<typename> friend struct Ops; // the opcode handlers, see chip8.cpp
+public:
+    typedef BasicMem<Spec::MEM_BYTES> Memory;
+    typedef Screen<Spec::WIDTH, Spec::HEIGHT, Spec::PLANES> Display;
 
+    // full machine state, for snapshot/restore
+    struct State {
+        uint16_t I;
+        uint16_t pc;
+        uint8_t V[16];
+        uint16_t stack[STACK_DEPTH];
+        uint8_t sp;
+        bool key_wait;
+        uint32_t rand;
+        Memory mem;
+        Periphs::State periphs;
+        [[no_unique_address]] ExtRegs<Spec> ext;
+    };
 
-class Chip8 {
-    typedef void(Chip8::*OpFunction)(Instr);
 private:
     uint16_t I;
     uint16_t pc;
     uint8_t V[16] = {0};
-    std::stack<uint16_t> m_subroutines;
-    Mem m_mem;
+    uint16_t m_stack[STACK_DEPTH] = {0}; // return addresses, fixed so calls never allocate
+    uint8_t m_sp = 0;
+    Memory m_mem;
     Periphs periphs;
-    OpFunction opfuncs[NUM_OPS] = {0}; // use first byte to index into arr
-
-    void load_program(const std::string program);
-
-    // op code fn go here
-    void nop();
-    void op0(Instr instr);
-    void op1(Instr instr);
-    void op2(Instr instr);
-    void op3(Instr instr);
-    void op4(Instr instr);
-    void op5(Instr instr);
-    void op6(Instr instr);
-    void op7(Instr instr);
-    void op8(Instr instr);
-    void op9(Instr instr);
-    void opA(Instr instr);
-    void opB(Instr instr);
-    void opC(Instr instr);
-    void opD(Instr instr);
-    void opE(Instr instr);
-    void opF(Instr instr);
+    [[no_unique_address]] ExtRegs<Spec> m_ext; // nothing on CHIP-8
+    State m_boot; // state right after the rom was loaded
+    uint m_ipf; // instructions per frame
+    bool m_max_clock;
+    bool m_key_wait = false; // inside FX0A
+    bool m_strict = false;   // fault on memory past the end instead of wrapping
+    bool m_verbose = false; // log every instruction to stderr
+    uint32_t m_frame = 0; // frames run, for traces
+    std::unique_ptr<Tracer> m_tracer;
+    std::unique_ptr<PerfProfile> m_perf;
+    std::unique_ptr<ShmExport> m_export;
+    std::unique_ptr<StreamServer> m_stream;
+    uint m_run_ahead = 0; // frames emulated past the one shown
+    uint m_ff_speed = 0;  // frames per shown frame fast forwarding, 0 for no limit
+    State m_ahead;        // real state while running ahead
+    uint8_t m_quirks = Spec::QUIRKS;
+    uint32_t m_rand;      // CXNN generator, part of the snapshot
+    uint32_t m_seed;      // m_rand after a rom load
+    uint64_t m_rom_hash = 0;
+    uint64_t m_sprites = 0;   // DXYN executed
+    uint64_t m_offscreen = 0; // sprites drawn across a screen edge
+
+    void init(uint ipf);
+    void execute();
+    void dispatch(uint16_t raw);
+    uint step_decoded(uint budget);
+    uint fused_sprite(const Decoded &d);
+    uint fused_timer_wait(const Decoded &d, uint budget);
+    uint fused_loop(const Decoded &d, uint budget);
+    void skip_if(bool cond);
+    void draw_sprite(uint8_t vx, uint8_t vy, uint8_t n);
+    bool draw_row(uint x, uint y, uint16_t bits, uint width, uint8_t plane, bool wrap);
+    // screen pixels per sprite pixel, lores extended screens double them
+    uint scale() { return hires() || !Spec::EXTENDED ? 1 : 2; }
+    [[noreturn]] void fault(FaultType type, uint16_t addr, const char *msg);
+    [[noreturn]] void range_fault(uint16_t addr, FaultType type);
+    // strict mode only: addr to addr+len-1 must all be in memory
+    void check_range(uint16_t addr, uint len, FaultType type)
+    {
+        if (m_strict && addr + len > Spec::MEM_BYTES)
+            range_fault(addr, type);
+    }
+    void emulate_frame();
+    void frame_done();
+    void show();
+    bool spinning();
+    uint run_instrs(uint n, int32_t stop_pc);
+    void profiled_frame();
+    void draw_ahead();
+    uint8_t next_rand();
+    void traced_step();
 
 public:
-    Chip8(const std::string program, uint pixel_scale, uint clock_speed, bool max_clock);
+    BasicChip8(const std::string &program, Frontend *frontend, uint clock_speed, bool max_clock);
+    BasicChip8(Frontend *frontend, uint clock_speed, bool max_clock);
+    // at the spec's own rate
+    BasicChip8(Frontend *frontend, bool max_clock);
+    bool load_rom(const uint8_t *rom, size_t len, bool once = false);
+    bool load_file(const std::string &path);
+    void reset();
+    void save_state(State &s);
+    void load_state(const State &s);
+    void fork(BasicChip8 &child);
     void step();
     void run();
+    void refresh();
+    void run_frame(uint16_t keys);
+    Yield run_frame_coop(uint16_t keys);
+    uint32_t idle_frames();
+    void skip_frames(uint32_t n);
+    RunResult run_until(const RunLimits &limits);
+    uint64_t frame_hash();
     void dump();
+    bool start_trace(const char *path);
+    void end_trace();
+    bool start_perf();
+    void end_perf();
+    bool start_export(const char *name);
+    void end_export();
+    bool start_stream(const char *addr);
+    void end_stream();
+
+    static const char *name() { return Spec::NAME; }
+    static bool extended() { return Spec::EXTENDED; }
+    void set_ipf(uint ipf) { m_ipf = ipf; }
+    uint ipf() { return m_ipf; }
+    void set_verbose(bool verbose) { m_verbose = verbose; }
+    void set_run_ahead(uint frames) { m_run_ahead = frames; }
+    void set_fast_forward(bool on, uint speed);
+    void set_strict(bool strict) { m_strict = strict; }
+    bool strict() { return m_strict; }
+    void set_quirks(uint8_t quirks) { m_quirks = quirks; }
+    uint8_t quirks() { return m_quirks; }
+    void set_seed(uint32_t seed);
+    uint64_t rom_hash() { return m_rom_hash; }
+    uint64_t sprite_draws() { return m_sprites; }
+    uint64_t offscreen_draws() { return m_offscreen; }
+    bool hires()
+    {
+        if constexpr (Spec::EXTENDED)
+            return m_ext.hires;
+        return false;
+    }
+
+    // direct access to live state, no copies
+    uint8_t *regs() { return V; }
+    uint16_t *index_reg() { return &I; }
+    uint16_t *prog_counter() { return &pc; }
+    Periphs &peripherals() { return periphs; }
+    // the screen, Spec::WIDTH x Spec::HEIGHT, a byte per pixel with bit p
+    // set where plane p is lit
+    const uint8_t *framebuf()
+    {
+        if constexpr (Spec::EXTENDED)
+            return m_ext.screen.data();
+        return periphs.framebuf();
+    }
 };
 
+typedef BasicChip8<Chip8Spec> Chip8;
+
 
 #endif
\ No newline at end of file
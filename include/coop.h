@@ -0,0 +1,98 @@
+#ifndef _COOP_H
+#define _COOP_H
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <chip8.h>
+
+/*
+ * Runs many machines on one thread, each as a C++20 coroutine. A machine
+ * runs a frame with Chip8::run_frame_coop() and then gives the thread back:
+ * until the next frame, until a key is held if it stopped in FX0A, or for as
+ * long as it will only spin in a timer wait or a jump to itself. Parked
+ * machines cost nothing per frame; when one is woken its timer is caught up
+ * first, so it sees the same emulated time as if it had run all along.
+ *
+ * Nothing here is thread safe, use one Scheduler per thread.
+ */
+class Scheduler {
+public:
+    struct Task {
+        struct promise_type {
+            std::exception_ptr error;
+
+            Task get_return_object()
+            {
+                return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            // started by the first run_frame()
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+private:
+    static const uint64_t PARK_KEYS = UINT64_MAX - 1;
+    static const uint64_t PARK_FOREVER = UINT64_MAX;
+
+    struct Machine {
+        Chip8 *chip8;
+        Task task;
+        uint16_t keys = 0;
+        uint64_t synced = 0; // frame the machine's own clock is at
+        bool faulted = false;
+    };
+
+    // co_await'ed by a machine to give up the thread until frame wake
+    struct Park {
+        Scheduler &sched;
+        size_t id;
+        uint64_t wake;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) { sched.park(id, wake); }
+        void await_resume() noexcept {}
+    };
+
+    typedef std::pair<uint64_t, size_t> Wake;
+
+    std::vector<Machine> m_machines;
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> m_timed;
+    std::vector<size_t> m_key_waits;
+    std::vector<size_t> m_ready;
+    std::vector<size_t> m_ran;
+    uint64_t m_now = 0;
+
+    Task machine(size_t id);
+    void park(size_t id, uint64_t wake);
+
+public:
+    Scheduler() {}
+    ~Scheduler();
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // the machine stays owned by the caller and must outlive the scheduler
+    size_t add(Chip8 &chip8);
+    size_t size() const { return m_machines.size(); }
+    void set_keys(size_t id, uint16_t keys) { m_machines[id].keys = keys; }
+
+    // one emulated frame for every machine, returns the ones that ran
+    const std::vector<size_t> &run_frame();
+    uint64_t frame() const { return m_now; }
+    bool faulted(size_t id) const { return m_machines[id].faulted; }
+    std::exception_ptr fault(size_t id) const;
+    // bring a parked machine's timer up to now, before looking at it
+    Chip8 &sync(size_t id);
+};
+
+#endif
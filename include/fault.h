@@ -0,0 +1,35 @@
+#ifndef _FAULT_H
+#define _FAULT_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+enum FaultType {
+    FAULT_MEM_READ,     // read outside of addr range
+    FAULT_MEM_WRITE,    // write outside of addr range
+    FAULT_BAD_PC,       // pc left program memory
+    FAULT_BAD_INSTR,    // opcode the chip8 doesn't have
+    FAULT_STACK,        // return with no subroutine, or call with the stack full
+};
+
+/*
+ * Thrown by the core when the rom does something the machine can't do. The
+ * host decides what happens next: the CLI dumps and exits, embedders and the
+ * fuzzer just drop or reset the one machine. Machines fill in the pc and
+ * opcode of the instruction that faulted (opcode 0 when pc itself is bad);
+ * Mem doesn't know them and leaves both 0.
+ */
+class Fault : public std::runtime_error {
+public:
+    FaultType type;
+    uint16_t addr;
+    uint16_t pc;
+    uint16_t opcode;
+
+    Fault(FaultType type, uint16_t addr, const std::string &msg, uint16_t pc = 0,
+          uint16_t opcode = 0)
+        : std::runtime_error(msg), type(type), addr(addr), pc(pc), opcode(opcode) {}
+};
+
+#endif
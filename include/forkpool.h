@@ -0,0 +1,39 @@
+#ifndef _FORKPOOL_H
+#define _FORKPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <chip8.h>
+
+#define FORK_NONE (-1) // fork() with every slot in use
+
+/*
+ * Headless machines built up front to fork into, for searches that branch
+ * from a game state into many input sequences. fork() clones a machine into
+ * a free slot (see Chip8::fork()) and release() hands the slot back; slots
+ * are never built or freed while searching. Released slots are reused last
+ * in, first out: the one freed last most likely forked from the same parent
+ * and still shares its pages and decoded code, which is what makes a fork
+ * cheap. Once warm, forking, running and releasing allocate nothing.
+ *
+ * Nothing here is thread safe, use one pool per thread.
+ */
+class ForkPool {
+private:
+    std::vector<std::unique_ptr<Chip8>> m_slots;
+    std::vector<int> m_free;
+
+public:
+    explicit ForkPool(size_t slots);
+    ForkPool(const ForkPool &) = delete;
+    ForkPool &operator=(const ForkPool &) = delete;
+
+    int fork(Chip8 &parent);
+    void release(int slot);
+    Chip8 &at(int slot) { return *m_slots[slot]; }
+    size_t size() const { return m_slots.size(); }
+    size_t in_use() const { return m_slots.size() - m_free.size(); }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _FRONTEND_H
+#define _FRONTEND_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define FRAME_HEIGHT 32
+#define FRAME_WIDTH 64
+
+#define NO_KEY 0xF0
+// host keys that aren't on the chip8 keypad
+#define KEY_HUD 0xE0
+#define KEY_FAST_FORWARD 0xE1
+// host key for each keypad key 0-F
+#define DEFAULT_KEYMAP "0123456789qwerty"
+
+/*
+ * A frontend shows the framebuffer to the user and hands key presses back to
+ * the peripherals. The framebuffer holds one byte per pixel (0 or 1), row
+ * major, FRAME_WIDTH x FRAME_HEIGHT.
+ *
+ * Each frame is render(), render_hud(), present(). poll_key() is called until
+ * it returns NO_KEY.
+ */
+class Frontend {
+public:
+    virtual ~Frontend() {}
+    virtual void render(const std::vector<uint8_t> &framebuf) = 0;
+    // a w x h framebuffer from the extended machines (any nonzero byte is
+    // lit). Returns false if the frontend only shows FRAME_WIDTH x
+    // FRAME_HEIGHT; it then gets the screen shrunk to that through render().
+    virtual bool render_screen(const uint8_t *, uint, uint) { return false; }
+    // text is newline separated, nullptr when the HUD is hidden
+    virtual void render_hud(const char *text) = 0;
+    virtual void present() = 0;
+    virtual uint8_t poll_key() = 0;
+    // per rom setup from the rom database, ignored where it doesn't apply
+    virtual void set_keymap(const std::string &) {}
+    virtual void set_palette(uint32_t, uint32_t) {}
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _LIBCHIP8_H
+#define _LIBCHIP8_H
+
+/*
+ * C interface to the chip8 core for embedding. Machines created here are
+ * headless: nothing is drawn, nothing sleeps, and time only moves when frames
+ * are run. State is handed out as pointers into the live machine, so reading
+ * the screen or registers after a frame costs nothing.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_FRAME_WIDTH 64
+#define CHIP8_FRAME_HEIGHT 32
+
+typedef struct chip8 chip8_t;
+
+#define CHIP8_FAULT_HOST -1 /* fault type when the host failed, not the rom */
+
+/*
+ * What stopped a faulted machine, see include/fault.h for the types, or
+ * CHIP8_FAULT_HOST.
+ */
+typedef struct chip8_fault {
+    int type;
+    uint16_t addr;              /* memory address or pc that was bad */
+    uint16_t pc;                /* instruction that faulted */
+    uint16_t opcode;            /* 0 if pc was outside program memory */
+} chip8_fault_t;
+
+/* Pointers stay valid for the lifetime of the machine. */
+typedef struct chip8_view {
+    uint8_t *V;                 /* V0-VF */
+    uint16_t *I;
+    uint16_t *pc;
+    uint8_t *delay_timer;
+    const uint8_t *framebuf;    /* one byte (0/1) per pixel, row major */
+} chip8_view_t;
+
+/* ipf: instructions run per 60Hz frame. Returns NULL if out of memory. */
+chip8_t *chip8_create(uint32_t ipf);
+void chip8_destroy(chip8_t *c);
+
+/*
+ * Returns 0 on success, -1 if the rom does not fit (or out of memory). Also
+ * resets.
+ */
+int chip8_load_rom(chip8_t *c, const uint8_t *rom, size_t len);
+/* Returns 0, or -1 if out of memory. */
+int chip8_reset(chip8_t *c);
+
+/*
+ * Seed CXNN's generator, now and for every later reset and rom load, so runs
+ * repeat exactly. Machines are seeded from the clock otherwise.
+ */
+void chip8_set_seed(chip8_t *c, uint32_t seed);
+
+/*
+ * Make child a copy of parent, fault state included, for branching searches.
+ * Memory is shared until written, so keep a set of children created up
+ * front and fork into them again rather than creating new ones. Returns 0,
+ * or -1 if out of memory.
+ */
+int chip8_fork(chip8_t *parent, chip8_t *child);
+
+/*
+ * Run n frames. keys holds one keypad mask per frame (bit k = key k held),
+ * or is NULL for no input. Returns 0, or -1 if the rom faulted (bad memory
+ * access, unknown opcode, ...). A faulted machine stays stopped until it is
+ * reset or a rom is loaded.
+ */
+int chip8_run_frames(chip8_t *c, uint32_t n, const uint16_t *keys);
+
+/*
+ * Run n frames on each of count machines in one call. keys is laid out
+ * machine major (count * n masks) or NULL. Returns the number of machines
+ * that are faulted afterwards.
+ */
+size_t chip8_run_frames_batch(chip8_t *const *cs, size_t count, uint32_t n,
+                              const uint16_t *keys);
+
+int chip8_faulted(chip8_t *c);
+/* Returns 0 and fills in f if the machine is faulted, else -1. */
+int chip8_get_fault(chip8_t *c, chip8_fault_t *f);
+
+/*
+ * Accesses through I past 0xFFF wrap to 0x000 by default. Strict machines
+ * fault on them instead.
+ */
+void chip8_set_strict(chip8_t *c, int strict);
+
+void chip8_get_view(chip8_t *c, chip8_view_t *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,18 +1,164 @@
 #ifndef _MEM_H
 #define _MEM_H
 
-class Mem {
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#define MEM_SIZE (1024*4)
+#define XO_MEM_SIZE (1024*64) // XO-CHIP, all of a 16 bit address
+#define PAGE_BITS 8
+#define PAGE_SIZE (1 << PAGE_BITS)
+#define NUM_PAGES (MEM_SIZE / PAGE_SIZE)
+#define MEM_FREE_PAGES 4096 // freed page copies kept for reuse, per thread
+#define DECODED_SPAN 8      // bytes a decoded entry reads, from its address on
+
+/*
+ * An instruction, or a run of them, decoded ahead of time by the machine.
+ * Mem only keeps these for the pages code runs from; what they mean is up
+ * to the PageDecoder that made them.
+ */
+struct Decoded {
+    uint8_t kind;    // 0: nothing cached, fetch and run the instruction
+    uint8_t len;     // most instructions one dispatch runs
+    uint16_t raw[4];
+};
+
+// fill out[from, to) from the bytes of one page; never reads past the page
+typedef void (*PageDecoder)(const uint8_t *page, Decoded *out, uint from, uint to);
+
+/*
+ * 256 bytes of memory, shared by every Mem that points at it. A shared page
+ * is never written. code is the page decoded, made the first time a Mem
+ * asks for it (so only for pages code runs from) and shared with the bytes.
+ */
+struct MemPage {
+    uint8_t data[PAGE_SIZE];
+    std::atomic<Decoded *> code{nullptr}; // PAGE_SIZE entries, or null
+    std::atomic<uint32_t> refs{1};        // only kept for page copies
+
+    ~MemPage();
+};
+
+/*
+ * A rom's pages (0x200 up to the end of the rom), shared by every Mem that
+ * loaded it. The rest of an image is the font page and the zero page.
+ */
+struct MemImage {
+    std::atomic<uint32_t> refs{1};
+    uint16_t first;   // page number of pages[0]
+    uint16_t count;
+    MemPage *pages;
+};
+
+/*
+ * Memory is paged and copy-on-write. Every Mem starts out reading straight
+ * from pages nobody writes: one font page and one zero page for everyone,
+ * plus the rom's pages, which machines running the same rom share. The first
+ * write to a page gives this Mem its own copy of that page. Copying a Mem
+ * (snapshots, forks) only copies the page table, and a page that is shared
+ * gets copied again on the next write to it. Page copies that are let go
+ * are kept for the next one (up to MEM_FREE_PAGES per thread).
+ *
+ * A Mem made with a PageDecoder hands out decoded code (decoded()). A page
+ * is decoded the first time code runs from it, and the entries stay with
+ * that page: shared along with it, carried into its copies, and redecoded
+ * in place when the Mem that owns the page writes to it (redecode()). Pages
+ * nothing runs from never get any. Mems sharing pages must use the same
+ * decoder.
+ *
+ * The size is a template parameter so the classic 4KB Mem keeps its small
+ * page table and one word of bits; only XO-CHIP pays for 64KB. mem.cpp
+ * instantiates MEM_SIZE and XO_MEM_SIZE.
+ *
+ * read() and write() wrap addresses at SIZE, as a machine that only decodes
+ * that many address lines would: no range check, no way to fail. Strict
+ * hosts use the _checked versions, which throw a Fault past the end. A 64KB
+ * Mem has no end: every 16 bit address is in it, so its checked accesses
+ * never fault, and a multi-byte access at I+n (FX55 and FX65 at I = 0xFFFF)
+ * wraps round to 0x0000 the same way read() does. Strict machines catch
+ * that before touching memory: check_range() faults on any I+n past 0xFFFF.
+ */
+template<uint32_t SIZE>
+class BasicMem {
+public:
+    static constexpr uint32_t PAGES = SIZE / PAGE_SIZE;
+    static constexpr uint32_t WORDS = (PAGES + 63) / 64;
+
 private:
-    uint8_t mem[1024*4] = {0}; // 4 MB
+    MemImage *m_image = nullptr;        // null: blank, or the rom is in our own pages
+    MemPage *m_pages[PAGES];            // where each page reads from
+    PageDecoder m_decoder;
+    // bit n set: page n is a copy (ours, maybe shared with copies of us)
+    // rather than the image's, font or zero page
+    uint64_t m_copied[WORDS] = {0};
+    // bit n set: page n is ours alone and can be written in place. Copies
+    // clear it on both sides, since the pages are shared after that.
+    mutable uint64_t m_writable[WORDS] = {0};
 
-    void write_font();
+    static bool bit(const uint64_t *bits, uint16_t n) { return (bits[n >> 6] >> (n & 63)) & 0x1; }
+    void blank();
+    void release();
+    void own_page(uint16_t page);
+    Decoded *decode(MemPage *page);
+    [[noreturn]] static void read_fault(uint16_t addr);
+    [[noreturn]] static void write_fault(uint16_t addr);
 
 public:
-    Mem();
-    void write(uint8_t data, uint16_t addr);
-    uint8_t read(uint16_t addr);
+    explicit BasicMem(PageDecoder decoder = nullptr);
+    BasicMem(const BasicMem &other);
+    BasicMem &operator=(const BasicMem &other);
+    ~BasicMem();
+    // inline: the page table costs a load, a call would cost more
+    uint8_t read(uint16_t addr)
+    {
+        addr &= SIZE - 1;
+        return m_pages[addr >> PAGE_BITS]->data[addr & (PAGE_SIZE - 1)];
+    }
+    void write(uint8_t data, uint16_t addr)
+    {
+        addr &= SIZE - 1;
+        uint16_t page = addr >> PAGE_BITS;
+        if (!bit(m_writable, page))
+            own_page(page);
+        m_pages[page]->data[addr & (PAGE_SIZE - 1)] = data;
+    }
+    uint8_t read_checked(uint16_t addr)
+    {
+        if constexpr (SIZE <= 0xFFFF) {
+            if (addr >= SIZE)
+                read_fault(addr);
+        }
+        return read(addr);
+    }
+    void write_checked(uint8_t data, uint16_t addr)
+    {
+        if constexpr (SIZE <= 0xFFFF) {
+            if (addr >= SIZE)
+                write_fault(addr);
+        }
+        write(data, addr);
+    }
+    const Decoded &decoded(uint16_t addr)
+    {
+        addr &= SIZE - 1;
+        MemPage *page = m_pages[addr >> PAGE_BITS];
+        Decoded *code = page->code.load(std::memory_order_acquire);
+        if (code == nullptr)
+            code = decode(page);
+        return code[addr & (PAGE_SIZE - 1)];
+    }
+    void redecode(uint16_t addr, uint len);
+    void load_program(const uint8_t *rom, size_t len);
+    void load_private(const uint8_t *rom, size_t len);
     void dump();
     uint32_t size();
+    uint32_t dirty_pages();
+    uint32_t code_pages();
 };
 
-#endif
\ No newline at end of file
+typedef BasicMem<MEM_SIZE> Mem;
+typedef BasicMem<XO_MEM_SIZE> XoMem;
+
+#endif
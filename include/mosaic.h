@@ -0,0 +1,49 @@
+#ifndef _MOSAIC_H
+#define _MOSAIC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <frontend.h>
+
+#define MOSAIC_MAX 256
+
+/*
+ * Board that many machines publish their screens to and one monitor reads
+ * them from. Each slot is a seqlock over the screen packed one bit per
+ * pixel: publishing never waits on the monitor, the monitor retries if it
+ * caught a slot mid-update. Keys go the other way, the monitor sets the
+ * held keys of whichever slot has focus.
+ */
+class Mosaic {
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;   // odd while being written
+        std::atomic<uint64_t> rows[FRAME_HEIGHT]; // bit 63 is x = 0
+        std::atomic<uint16_t> keys;
+        std::atomic<bool> faulted;
+    };
+
+    size_t m_count;
+    std::unique_ptr<Slot[]> m_slots;
+
+public:
+    Mosaic(size_t count);
+    size_t size() const { return m_count; }
+
+    // machine side, wait free
+    void publish(size_t slot, const uint8_t *framebuf);
+    void set_faulted(size_t slot);
+    uint16_t keys(size_t slot) const
+    {
+        return m_slots[slot].keys.load(std::memory_order_relaxed);
+    }
+
+    // monitor side
+    uint32_t snapshot(size_t slot, uint64_t rows[FRAME_HEIGHT]) const;
+    bool faulted(size_t slot) const;
+    void set_keys(size_t slot, uint16_t keys);
+};
+
+#endif
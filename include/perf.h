@@ -0,0 +1,86 @@
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <cstdint>
+#include <cstdio>
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,    // L1 data cache read misses
+    PERF_LLC_MISSES,
+    PERF_TASK_CLOCK,    // ns on cpu, software so always there
+    NUM_PERF_EVENTS,
+};
+
+enum PerfEngine {
+    ENGINE_FUSED,       // step_decoded()
+    ENGINE_PLAIN,       // step()
+    NUM_ENGINES,
+};
+
+#define PERF_CLASSES 16      // one per top opcode nibble
+#define PERF_SAMPLE_EVERY 16 // instrs between per opcode samples
+
+/*
+ * Host hardware counters for this thread, through perf_event_open(2). All
+ * events are opened as one group so they are scheduled on and off the PMU
+ * together and one read() gets them all. Events the host can't count (no
+ * PMU in a VM, perf_event_paranoid too high) are left out; values() reports
+ * them as zero and available() says which ones are real.
+ */
+class PerfCounters {
+private:
+    int m_leader = -1;
+    int m_fd[NUM_PERF_EVENTS];
+    int m_slot[NUM_PERF_EVENTS]; // position in the group read, -1 if not open
+    int m_open = 0;
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool open();
+    bool available(int event) const { return m_slot[event] >= 0; }
+    // running totals since open(), scaled up if the group was multiplexed
+    void values(uint64_t out[NUM_PERF_EVENTS]);
+};
+
+/*
+ * Counter deltas added up per engine and per opcode class. Engines are timed
+ * a whole frame at a time. Opcode classes are sampled: one instruction every
+ * PERF_SAMPLE_EVERY is counted on its own. What reading the counters itself
+ * costs (measured when opening) is taken off both.
+ */
+class PerfProfile {
+private:
+    struct Bucket {
+        uint64_t instrs;
+        uint64_t reads;     // counter read pairs, for taking off the overhead
+        uint64_t events[NUM_PERF_EVENTS];
+    };
+
+    PerfCounters m_counters;
+    uint64_t m_mark[NUM_PERF_EVENTS];
+    uint64_t m_overhead[NUM_PERF_EVENTS]; // of one read pair
+    Bucket m_engines[NUM_ENGINES];
+    Bucket m_classes[PERF_CLASSES];
+
+    void add(Bucket &b, uint64_t instrs);
+    void print_row(FILE *out, const char *name, const Bucket &b);
+
+public:
+    PerfProfile();
+    bool open();
+
+    void begin() { m_counters.values(m_mark); }
+    void end_engine(PerfEngine engine, uint64_t instrs) { add(m_engines[engine], instrs); }
+    void end_class(uint8_t cls) { add(m_classes[cls], 1); }
+
+    void report(FILE *out);
+};
+
+#endif
@@ -1,47 +1,67 @@
 #ifndef _PERIPHS_H
 #define _PERIPHS_H
 
-#include <SDL.h>
 #include <cstdint>
 #include <string>
 #include <vector>
-#include <map>
 #include <chrono>
-
-#define NO_KEY 0xF0
+#include <frontend.h>
+#include <stats.h>
 
 
 class Periphs {
+public:
+    // everything a snapshot needs, the frontend is not part of it
+    struct State {
+        uint8_t framebuf[FRAME_HEIGHT*FRAME_WIDTH];
+        uint8_t timer;
+        uint16_t keys;
+        uint8_t last_keycode;
+    };
+
 private:
-    SDL_Window *m_window;
-    SDL_Renderer *m_renderer;
-    uint m_pxscale;
+    Frontend *m_frontend;
     std::vector<uint8_t> m_framebuf;
-    std::map<SDL_Keycode, uint8_t> m_keymap;
-    std::chrono::high_resolution_clock::time_point m_last_tick;
+    std::vector<uint8_t> m_shrunk; // draw_screen() for frontends that can't
     std::chrono::high_resolution_clock::time_point m_last_keytime;
     uint8_t m_last_keycode;
+    uint16_t m_keys = 0; // bit n set while key n is held
     uint8_t m_timer;
-    uint m_clock = 0;
-    uint m_clock_speed;
-    bool m_max_clock;
-
-
-    uint scale(uint x);
-    void poll_quit();
-    void update_timer();
-    void render_all();
+    Stats m_stats;
+    bool m_show_hud = false;
+    bool m_fast_forward = false;
 
 public:
-    Periphs(const char *title, uint pxscale, uint clock_speed, bool max_clock);
-    ~Periphs();
+    Periphs(Frontend *frontend);
+    void reset();
+    void save_state(State &s);
+    void load_state(const State &s);
+    void fork(Periphs &child) const;
     void clear_screen();
     bool place_pixel(uint8_t x, uint8_t y, uint8_t pixval);
+    void begin_key_wait();
     uint8_t await_keypress();
     uint8_t get_keystate();
+    bool key_pressed(uint8_t key);
+    void set_keys(uint16_t keys);
     void refresh();
+    void poll_input();
+    void draw();
+    void draw_screen(const uint8_t *pixels, uint w, uint h);
     void set_timer(uint8_t ticks);
     uint8_t get_timer();
+    void tick_timer();
+
+    void set_hud(bool show) { m_show_hud = show; }
+    void set_fast_forward(bool on) { m_fast_forward = on; }
+    bool fast_forward() { return m_fast_forward; }
+    Stats &stats() { return m_stats; }
+
+    // headless when there is no frontend: refresh() does nothing and
+    // keys only change through set_keys()
+    bool headless() { return m_frontend == nullptr; }
+    const uint8_t *framebuf() { return m_framebuf.data(); }
+    uint8_t *delay_timer() { return &m_timer; }
 };
 
 #endif
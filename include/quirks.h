@@ -0,0 +1,23 @@
+#ifndef _QUIRKS_H
+#define _QUIRKS_H
+
+#include <cstdint>
+
+/*
+ * Behaviours chip8 interpreters disagree on. Each bit switches away from
+ * what this emulator does by default, so a quirks value of 0 runs roms the
+ * way it always has.
+ */
+enum Quirk {
+    QUIRK_SHIFT_VY = 1 << 0,  // 8XY6/8XYE shift VY into VX (COSMAC)
+    QUIRK_KEEP_I   = 1 << 1,  // FX55/FX65 leave I unchanged (CHIP-48)
+    QUIRK_JUMP_VX  = 1 << 2,  // BXNN jumps to XNN + VX (CHIP-48)
+    QUIRK_VF_RESET = 1 << 3,  // 8XY1/8XY2/8XY3 clear VF (COSMAC)
+    QUIRK_CLIP     = 1 << 4,  // sprites clip at the screen edge, no wrap
+    QUIRK_KEEP_VF  = 1 << 5,  // FX1E leaves VF alone (COSMAC, SUPER-CHIP)
+};
+
+#define NUM_QUIRKS 6
+#define QUIRK_COMBOS (1 << NUM_QUIRKS)
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _ROMDB_H
+#define _ROMDB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+
+/*
+ * Per-rom settings, keyed by a hash of the rom image. The file is text, one
+ * rom per line:
+ *
+ *   <hash> key=value ... [# comment]
+ *
+ * Keys this version doesn't know are kept as they are, so older and newer
+ * emulators can share a database.
+ */
+struct RomDbEntry {
+    uint ipf = 0;          // 0: not set
+    uint8_t quirks = 0;
+    std::string keymap;    // host key for each of 0-F, empty: default
+    bool palette = false;  // fg and bg set
+    uint32_t fg = 0;       // RGB
+    uint32_t bg = 0;
+    std::string extra;     // unknown key=value pairs, passed through
+    std::string comment;   // usually the rom's file name
+};
+
+class RomDb {
+private:
+    std::map<uint64_t, RomDbEntry> m_entries;
+
+public:
+    static std::string default_path();
+
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+    const RomDbEntry *find(uint64_t hash) const;
+    void set(uint64_t hash, const RomDbEntry &entry);
+    size_t size() const { return m_entries.size(); }
+};
+
+uint64_t rom_hash(const uint8_t *rom, size_t len);
+std::string format_quirks(uint8_t quirks);
+bool parse_quirks(const std::string &text, uint8_t &quirks);
+bool valid_keymap(const std::string &keys);
+std::string format_palette(uint32_t fg, uint32_t bg);
+bool parse_palette(const std::string &text, uint32_t &fg, uint32_t &bg);
+
+#endif
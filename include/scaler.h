@@ -0,0 +1,82 @@
+#ifndef _SCALER_H
+#define _SCALER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <frontend.h>
+
+// ARGB8888
+#define PIXEL_ON  0xFFFFFFFF
+#define PIXEL_DIM 0xFF7F7F7F // lit pixel on a scanline
+#define PIXEL_OFF 0xFF000000
+
+// at or above this scale the bottom half is scaled on a second thread
+#define SCALER_THREAD_SCALE 16
+// widest framebuffer taken, the extended machines' 128
+#define SCALER_MAX_WIDTH 128
+
+enum ScaleFilter {
+    FILTER_NEAREST,   // blocks, same as the old rectangles
+    FILTER_SCALE2X,   // EPX smoothing, then nearest
+    FILTER_SCANLINES, // nearest with the bottom of each row dimmed
+};
+
+/*
+ * Turns the 1 byte per pixel framebuffer (FRAME_WIDTH x FRAME_HEIGHT unless
+ * given another size) into an ARGB8888 image scale times the size, ready to
+ * go into a streaming texture. Rows are built with
+ * AVX2 when the cpu has it, else with plain loops that give the same output.
+ */
+class Scaler {
+private:
+    uint m_scale;
+    ScaleFilter m_filter;
+    bool m_avx2;
+    uint32_t m_on = PIXEL_ON;
+    uint32_t m_dim = PIXEL_DIM;
+    uint32_t m_off = PIXEL_OFF;
+    uint m_in_w, m_in_h;      // framebuffer size
+    uint m_src_w, m_src_h;    // size of what gets scaled up to the output
+    std::vector<uint8_t> m_epx; // scale2x output
+    std::vector<uint8_t> m_pad; // scale2x input with a border, for AVX2
+    // per 8 output pixels: first source pixel, and where the 8 come from
+    std::vector<uint16_t> m_base;
+    std::vector<int32_t> m_perm;
+
+    // second thread, scales rows [m_split, height) while we do the rest
+    std::thread m_worker;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    uint64_t m_job = 0;
+    uint64_t m_job_done = 0;
+    bool m_quit = false;
+    const uint8_t *m_src = nullptr;
+    uint32_t *m_dst = nullptr;
+    size_t m_pitch = 0;
+    uint m_split;
+
+    void scale_rows(const uint8_t *src, uint32_t *dst, size_t pitch, uint begin, uint end);
+    bool dim_row(uint y);
+    void work();
+
+public:
+    Scaler(uint scale, ScaleFilter filter, bool allow_avx2 = true, uint in_w = FRAME_WIDTH,
+           uint in_h = FRAME_HEIGHT);
+    ~Scaler();
+    uint width() const { return m_in_w * m_scale; }
+    uint height() const { return m_in_h * m_scale; }
+    bool avx2() const { return m_avx2; }
+    // ARGB8888, scanlines get half of on
+    void set_palette(uint32_t on, uint32_t off);
+    // pitch in pixels
+    void scale(const uint8_t *framebuf, uint32_t *dst, size_t pitch);
+};
+
+bool parse_filter(const char *name, ScaleFilter &filter);
+bool cpu_has_avx2();
+
+#endif
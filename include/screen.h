@@ -0,0 +1,90 @@
+#ifndef _SCREEN_H
+#define _SCREEN_H
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Framebuffer of the extended machines: W x H pixels in PLANES bitplanes.
+ * One byte per pixel, bit p set when plane p is lit, row major like the
+ * classic framebuffer, so anything taking that (frontends, rom_hash())
+ * takes this too. Size and plane count are template parameters so every
+ * loop below has constant bounds. Drawing and scrolling take a mask of the
+ * planes they touch and leave the others alone.
+ */
+template<uint W, uint H, uint PLANES>
+class Screen {
+public:
+    static constexpr uint WIDTH = W;
+    static constexpr uint HEIGHT = H;
+    static constexpr uint8_t ALL_PLANES = (1 << PLANES) - 1;
+
+private:
+    uint8_t m_px[W*H] = {0};
+
+    // move the pixels in planes by (dx, dy), what comes in from the edge is dark
+    void shift(int dx, int dy, uint8_t planes)
+    {
+        uint8_t next[W*H];
+        for (int y = 0; y < (int)H; y++) {
+            for (int x = 0; x < (int)W; x++) {
+                int sx = x - dx;
+                int sy = y - dy;
+                uint8_t from = 0;
+                if (sx >= 0 && sx < (int)W && sy >= 0 && sy < (int)H)
+                    from = m_px[sy*W + sx];
+                next[y*W + x] = (m_px[y*W + x] & ~planes) | (from & planes);
+            }
+        }
+        std::memcpy(m_px, next, sizeof(m_px));
+    }
+
+public:
+    const uint8_t *data() const { return m_px; }
+    uint8_t *data() { return m_px; }
+
+    void clear(uint8_t planes)
+    {
+        for (uint8_t &px : m_px) {
+            px &= ~planes;
+        }
+    }
+
+    /*
+     * XOR one sprite row into a plane: the top width bits of bits (msb
+     * leftmost) at (x, y), each drawn as a scale x scale block. Coordinates
+     * are in units of scale. Pixels past the right or bottom edge wrap when
+     * wrap is set and are dropped otherwise. True if a lit pixel went dark.
+     */
+    bool draw_row(uint x, uint y, uint16_t bits, uint width, uint8_t plane, uint scale, bool wrap)
+    {
+        bool collision = false;
+        for (uint i = 0; i < width; i++) {
+            if (!((bits >> (15 - i)) & 0x1))
+                continue;
+            uint px = (x + i) * scale;
+            uint py = y * scale;
+            if (px >= W || py >= H) {
+                if (!wrap)
+                    continue;
+                px %= W;
+                py %= H;
+            }
+            for (uint dy = 0; dy < scale; dy++) {
+                uint8_t *row = &m_px[(py + dy)*W + px];
+                for (uint dx = 0; dx < scale; dx++) {
+                    collision = collision || (row[dx] & plane);
+                    row[dx] ^= plane;
+                }
+            }
+        }
+        return collision;
+    }
+
+    void scroll_down(uint n, uint8_t planes) { shift(0, n, planes); }
+    void scroll_up(uint n, uint8_t planes) { shift(0, -(int)n, planes); }
+    void scroll_left(uint n, uint8_t planes) { shift(-(int)n, 0, planes); }
+    void scroll_right(uint n, uint8_t planes) { shift(n, 0, planes); }
+};
+
+#endif
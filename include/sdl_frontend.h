@@ -0,0 +1,44 @@
+#ifndef _SDL_FRONTEND_H
+#define _SDL_FRONTEND_H
+
+#include <SDL.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <frontend.h>
+#include <scaler.h>
+
+std::map<SDL_Keycode, uint8_t> sdl_keymap(const std::string &keys = DEFAULT_KEYMAP);
+
+class SdlFrontend : public Frontend {
+private:
+    SDL_Window *m_window;
+    SDL_Renderer *m_renderer;
+    SDL_Texture *m_texture;
+    uint m_pxscale;
+    ScaleFilter m_filter;
+    Scaler m_scaler;
+    uint32_t m_on = PIXEL_ON;
+    uint32_t m_off = PIXEL_OFF;
+    // render_screen(), made for the first screen size it gets
+    std::unique_ptr<Scaler> m_ext_scaler;
+    SDL_Texture *m_ext_texture = nullptr;
+    uint m_ext_w = 0, m_ext_h = 0;
+    std::map<SDL_Keycode, uint8_t> m_keymap;
+
+    uint scale(uint x);
+    void draw_text(const char *text, int x, int y, int px);
+
+public:
+    SdlFrontend(const char *title, uint pxscale, ScaleFilter filter);
+    ~SdlFrontend();
+    void render(const std::vector<uint8_t> &framebuf) override;
+    bool render_screen(const uint8_t *pixels, uint w, uint h) override;
+    void render_hud(const char *text) override;
+    void present() override;
+    uint8_t poll_key() override;
+    void set_keymap(const std::string &keys) override;
+    void set_palette(uint32_t fg, uint32_t bg) override;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _SDL_MOSAIC_H
+#define _SDL_MOSAIC_H
+
+#include <SDL.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <mosaic.h>
+
+#define MOSAIC_BORDER 2 // px around each tile, shows focus and faults
+
+/*
+ * One SDL window showing every screen on a Mosaic as a grid of tiles.
+ * Clicking a tile (or Tab) moves focus, and the keypad goes to the focused
+ * machine. Only ever reads the board, at most max_fps times a second.
+ */
+class SdlMosaic {
+private:
+    Mosaic &m_board;
+    SDL_Window *m_window;
+    SDL_Renderer *m_renderer;
+    SDL_Texture *m_texture;
+    std::map<SDL_Keycode, uint8_t> m_keymap;
+    uint m_cols, m_rows;
+    uint m_tile_scale;
+    uint m_tile_w, m_tile_h;    // including the border
+    uint m_max_fps;
+    size_t m_focus = 0;
+    uint16_t m_keys = 0;        // held on the focused machine
+    std::vector<uint32_t> m_seen; // last sequence drawn per tile
+
+    void draw();
+    void focus(size_t slot);
+    bool handle_events();
+
+public:
+    SdlMosaic(Mosaic &board, const char *title, uint max_fps);
+    ~SdlMosaic();
+    // until the window is closed
+    void run();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _SHM_EXPORT_H
+#define _SHM_EXPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <frontend.h>
+
+/*
+ * Frames published to a POSIX shared memory segment (shm_open(3), so
+ * /dev/shm/<name> on Linux) for other processes to watch. The segment is a
+ * ShmLayout: a header and a ring of SHM_SLOTS slots, each a seqlock over one
+ * frame's screen and registers. Frame n (counting publishes from 0) goes in
+ * slot n % SHM_SLOTS, whose seq reads 2n+1 while it is written and 2n+2 once
+ * done. The emulator never waits: a reader that falls SHM_SLOTS frames
+ * behind finds its frame overwritten and skips ahead. Readers can read a
+ * slot in place, checking seq before and after, or copy it out with
+ * ShmReader::read().
+ *
+ * Keys go the other way: once a reader has called set_keys(), the emulator
+ * takes the held keys from the segment at the end of every frame.
+ */
+
+#define SHM_MAGIC 0x48533843 // "C8SH"
+#define SHM_VERSION 1
+#define SHM_SLOTS 16
+#define SHM_KEYS_SET 0x10000 // in ShmLayout::keys, a reader has set them
+
+struct ShmFrame {
+    uint64_t frame;             // the machine's frame counter
+    uint16_t pc;
+    uint16_t I;
+    uint8_t V[16];
+    uint8_t timer;              // delay timer
+    uint8_t framebuf[FRAME_WIDTH*FRAME_HEIGHT]; // one byte (0/1) per pixel
+};
+
+struct alignas(64) ShmSlot {
+    std::atomic<uint64_t> seq;
+    ShmFrame data;
+};
+
+struct ShmLayout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;
+    std::atomic<uint64_t> head;     // frames published so far
+    std::atomic<uint32_t> keys;     // held keys, plus SHM_KEYS_SET
+    ShmSlot slot[SHM_SLOTS];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "seq is shared between processes");
+
+/*
+ * Emulator side. Creates the segment and removes it again when destroyed.
+ */
+class ShmExport {
+private:
+    std::string m_name;
+    ShmLayout *m_map = nullptr;
+    uint64_t m_next = 0;
+
+public:
+    ShmExport() = default;
+    ~ShmExport();
+    ShmExport(const ShmExport &) = delete;
+    ShmExport &operator=(const ShmExport &) = delete;
+
+    bool create(const char *name);
+    void publish(uint64_t frame, uint16_t pc, uint16_t I, const uint8_t *V, uint8_t timer,
+                 const uint8_t *framebuf);
+    // false until a reader has set keys
+    bool keys(uint16_t &keys) const;
+};
+
+enum ShmRead {
+    SHM_OK,
+    SHM_NOT_YET,        // not published yet
+    SHM_OVERWRITTEN,    // the ring has moved past it
+};
+
+/*
+ * Reader side, for tools and tests. Never blocks the emulator.
+ */
+class ShmReader {
+private:
+    ShmLayout *m_map = nullptr;
+
+public:
+    ShmReader() = default;
+    ~ShmReader();
+    ShmReader(const ShmReader &) = delete;
+    ShmReader &operator=(const ShmReader &) = delete;
+
+    bool open(const char *name);
+    uint64_t head() const { return m_map->head.load(std::memory_order_acquire); }
+    ShmRead read(uint64_t n, ShmFrame &out) const;
+    void set_keys(uint16_t keys);
+};
+
+#endif
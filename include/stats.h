@@ -0,0 +1,68 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <cstdint>
+#include <chrono>
+
+#define HUD_TEXT_LEN 128
+
+/*
+ * Frame timing counters. Each frame costs five clock reads and some adds, so
+ * these stay on all the time. Once a second the counters are summed up into a
+ * Report, which can be shown on the HUD, printed as a line to stderr or
+ * written as JSON to a file descriptor.
+ */
+class Stats {
+    typedef std::chrono::steady_clock clock;
+
+public:
+    struct Report {
+        double ips;             // emulated instructions per second
+        double fps;             // frames per second
+        double cpu_ms;          // avg host time per frame spent emulating
+        double render_ms;       // ... drawing the frame
+        double present_ms;      // ... handing it to the screen
+        double drift_ms;        // wall time minus emulated time (frames/60)
+        double speed;           // emulated frames per shown frame
+        uint64_t late;          // total frames that missed their deadline
+        uint64_t dropped;       // total frame periods skipped to catch up
+    };
+
+private:
+    clock::time_point m_start;
+    clock::time_point m_window_start;
+    clock::time_point m_mark;
+    clock::duration m_cpu;
+    clock::duration m_render;
+    clock::duration m_present;
+    uint64_t m_instrs;
+    uint64_t m_frames;
+    uint64_t m_total_frames;
+    uint64_t m_emulated;        // frames emulated this window
+    uint64_t m_total_emulated;
+    uint64_t m_late;
+    uint64_t m_dropped;
+
+    Report m_report;
+    char m_hud[HUD_TEXT_LEN];
+    bool m_print_line;
+    int m_json_fd;
+
+    void summarize(clock::time_point now);
+
+public:
+    Stats();
+    void set_output(bool print_line, int json_fd);
+
+    void begin_frame();
+    void cpu_done(uint64_t instrs);
+    void render_done();
+    void present_done();
+    // emulated: frames run for this shown one, more when fast forwarding
+    void end_frame(bool late, uint64_t dropped, uint64_t emulated = 1);
+
+    const Report &report() { return m_report; }
+    const char *hud_text() { return m_hud; }
+};
+
+#endif
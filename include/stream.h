@@ -0,0 +1,124 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <frontend.h>
+
+/*
+ * Frames streamed over a local socket, a Unix domain socket or a TCP port on
+ * 127.0.0.1, to clients that watch and play headless instances. The server
+ * never blocks the emulator: it polls for clients and keys about every
+ * STREAM_POLL_US, so unpaced runs don't pay a system call a frame, and a
+ * frame that is the same as the last one a client got sends nothing, so an
+ * idle instance costs its clients no bandwidth at all.
+ *
+ * The protocol, multi byte fields little endian:
+ *
+ *   server, on connect:    "C8ST", version, width, height (one byte each)
+ *   server, on a change:   'F', frame (u32), len (u16), len bytes of deltas
+ *   client, any time:      'D' key or 'U' key, key 0x0-0xF held or let go
+ *
+ * A screen is packed to a bitmap of one bit per pixel, rows top to bottom,
+ * the leftmost pixel in the top bit. An 'F' carries the bitmap XORed with
+ * the one sent to that client before (all clear before the first), run
+ * length encoded: a byte n below 0x80 is followed by n+1 literal bytes,
+ * n from 0x80 up stands for n-0x7F zero bytes. A client the socket can't
+ * keep up with gets fewer frames, never a broken one.
+ *
+ * Held keys are those held by any client; once a client has sent a key the
+ * emulator takes the keypad from the stream at the end of every frame.
+ */
+
+#define STREAM_MAGIC "C8ST"
+#define STREAM_VERSION 1
+#define STREAM_BITMAP_BYTES (FRAME_WIDTH*FRAME_HEIGHT/8)
+#define STREAM_MAX_DELTA (2*STREAM_BITMAP_BYTES)   // every byte a literal run of one
+#define STREAM_HELLO_BYTES 7
+#define STREAM_FRAME_HEADER 7
+#define STREAM_MAX_CLIENTS 16
+#define STREAM_OUT_BYTES 2048  // per client, sent but not yet taken by the socket
+#define STREAM_POLL_US 1000    // look for clients and keys at most this often
+#define STREAM_MAX_SKIP 1024   // frames between looks at the clock, at most
+
+void stream_pack(const uint8_t *framebuf, uint8_t *bitmap);
+size_t stream_encode(const uint8_t *prev, const uint8_t *cur, uint8_t *out);
+bool stream_decode(const uint8_t *in, size_t len, uint8_t *bitmap);
+
+/*
+ * Emulator side. Listens on addr: a port number for TCP on 127.0.0.1,
+ * anything else is the path of a Unix domain socket, which replaces an old
+ * socket there (but nothing else) and is removed again when the server is
+ * destroyed.
+ */
+class StreamServer {
+private:
+    struct Client {
+        int fd = -1;
+        int pending = -1;   // first byte of a key event split across reads
+        uint16_t keys = 0;
+        uint8_t sent[STREAM_BITMAP_BYTES]; // the screen as the client will have it
+        uint8_t out[STREAM_OUT_BYTES];
+        size_t out_len = 0;
+    };
+
+    int m_fd = -1;
+    std::string m_path; // Unix socket to remove, empty for TCP
+    bool m_keys_set = false;
+    uint m_connected = 0;
+    std::chrono::steady_clock::time_point m_next_poll;
+    uint m_skip = 1;    // frames per look at the clock, grows on unpaced runs
+    uint m_until_look = 0;
+    uint8_t m_bitmap[STREAM_BITMAP_BYTES];
+    Client m_clients[STREAM_MAX_CLIENTS];
+
+    void poll_clients();
+    void accept_clients();
+    void drop(Client &c);
+    void read_keys(Client &c);
+    void queue(Client &c, const void *data, size_t len);
+    void flush(Client &c);
+
+public:
+    StreamServer() = default;
+    ~StreamServer();
+    StreamServer(const StreamServer &) = delete;
+    StreamServer &operator=(const StreamServer &) = delete;
+
+    bool listen(const char *addr);
+    void publish(uint32_t frame, const uint8_t *framebuf);
+    // false until a client has sent a key
+    bool keys(uint16_t &keys) const;
+    uint clients() const { return m_connected; }
+};
+
+/*
+ * Client side, for tools and tests. Blocking.
+ */
+class StreamClient {
+private:
+    int m_fd = -1;
+    bool m_greeted = false;
+    uint8_t m_bitmap[STREAM_BITMAP_BYTES] = {0};
+
+    bool read_all(void *buf, size_t len);
+
+public:
+    StreamClient() = default;
+    ~StreamClient();
+    StreamClient(const StreamClient &) = delete;
+    StreamClient &operator=(const StreamClient &) = delete;
+
+    // the greeting is checked by the first read_frame(), the server only
+    // sends it once the emulator has run a frame
+    bool connect(const char *addr);
+    // waits for the next frame sent, false once the server has gone
+    bool read_frame(uint32_t &frame, size_t &bytes);
+    bool send_key(uint8_t key, bool down);
+    bool pixel(uint x, uint y) const;
+    const uint8_t *bitmap() const { return m_bitmap; }
+};
+
+#endif
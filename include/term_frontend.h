@@ -0,0 +1,36 @@
+#ifndef _TERM_FRONTEND_H
+#define _TERM_FRONTEND_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <frontend.h>
+
+#define TERM_ROWS (FRAME_HEIGHT / 2)
+#define TERM_COLS FRAME_WIDTH
+
+/*
+ * Draws the framebuffer in a terminal using unicode half blocks (two pixels
+ * per character cell) and reads keys from stdin in raw mode. Only the cells
+ * that changed since the last drawn frame are sent, at most 60 times a second.
+ */
+class TermFrontend : public Frontend {
+private:
+    uint8_t m_cells[TERM_ROWS * TERM_COLS];
+    std::string m_out;
+    std::string m_hud;
+    std::chrono::steady_clock::time_point m_last_present;
+    uint8_t m_keymap[128]; // typed character to keypad key, or NO_KEY
+
+public:
+    TermFrontend();
+    ~TermFrontend();
+    void render(const std::vector<uint8_t> &framebuf) override;
+    void render_hud(const char *text) override;
+    void present() override;
+    uint8_t poll_key() override;
+    void set_keymap(const std::string &keys) override;
+};
+
+#endif
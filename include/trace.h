@@ -0,0 +1,72 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <zlib.h>
+
+/*
+ * Binary execution traces. A trace file is gzip compressed and holds a
+ * TraceHeader followed by one TraceRecord per executed instruction.
+ */
+
+#define TRACE_MAGIC "C8TRACE1"
+#define TRACE_RING_BITS 16 // records buffered between emulator and writer
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+struct TraceRecord {
+    uint32_t frame;     // frame the instr ran in
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;         // after the instr
+    uint16_t vmask;     // bit n set: Vn changed
+    uint16_t waddr;     // first mem byte written
+    uint8_t wlen;       // bytes written to mem, 0 for none
+    uint8_t timer;      // delay timer after the instr
+    uint8_t V[16];      // after the instr
+};
+static_assert(sizeof(TraceRecord) == 32, "trace records are written raw");
+
+/*
+ * Records go into a single producer/single consumer ring owned by the
+ * emulating thread. A background thread drains the ring into the compressed
+ * file, so the emulator only pays for a 32 byte store per instruction. If
+ * the writer falls a whole ring behind, the emulator waits for it; records
+ * are never dropped.
+ */
+class Tracer {
+private:
+    gzFile m_file;
+    TraceRecord *m_ring;
+    std::atomic<uint64_t> m_head; // next slot the emulator fills
+    std::atomic<uint64_t> m_tail; // next slot the writer drains
+    std::atomic<bool> m_done;
+    std::thread m_writer;
+
+    void drain();
+    void wait_for_room();
+
+public:
+    Tracer();
+    ~Tracer();
+    bool open(const char *path);
+    void close();
+
+    void record(const TraceRecord &r)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == (1u << TRACE_RING_BITS))
+            wait_for_room();
+        m_ring[head & ((1u << TRACE_RING_BITS) - 1)] = r;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _XOCHIP_H
+#define _XOCHIP_H
+
+#include <cstdint>
+#include <chip8.h>
+#include <mem.h>
+#include <quirks.h>
+
+#define EXT_WIDTH 128
+#define EXT_HEIGHT 64
+#define BIG_FONT_ADDR 0x50 // FX30 digits, 10 bytes each, after the small font
+
+/*
+ * Specs for the extended instruction sets: memory size, screen geometry,
+ * plane count and the defaults they run with. BasicChip8 (chip8.h) is built
+ * for each of them.
+ *
+ * The screen is always WIDTH x HEIGHT. In lores every pixel is drawn as a
+ * 2x2 block, so frontends never see the mode change size.
+ */
+
+// SUPER-CHIP 1.1: 4KB, 128x64 with a 64x32 lores mode, one plane
+struct SchipSpec {
+    static constexpr const char *NAME = "schip";
+    static constexpr uint32_t MEM_BYTES = MEM_SIZE;
+    static constexpr uint WIDTH = EXT_WIDTH;
+    static constexpr uint HEIGHT = EXT_HEIGHT;
+    static constexpr uint PLANES = 1;
+    static constexpr bool EXTENDED = true;
+    static constexpr bool XO = false;
+    static constexpr uint IPF = 30;
+    static constexpr uint8_t QUIRKS = QUIRK_KEEP_I | QUIRK_JUMP_VX | QUIRK_CLIP | QUIRK_KEEP_VF;
+};
+
+// XO-CHIP: SUPER-CHIP with 64KB, F000 NNNN for a 16 bit I, two planes and
+// scrolling up; wraps sprites like Octo
+struct XoChipSpec {
+    static constexpr const char *NAME = "xochip";
+    static constexpr uint32_t MEM_BYTES = XO_MEM_SIZE;
+    static constexpr uint WIDTH = EXT_WIDTH;
+    static constexpr uint HEIGHT = EXT_HEIGHT;
+    static constexpr uint PLANES = 2;
+    static constexpr bool EXTENDED = true;
+    static constexpr bool XO = true;
+    static constexpr uint IPF = 1000;
+    static constexpr uint8_t QUIRKS = QUIRK_SHIFT_VY | QUIRK_KEEP_VF;
+};
+
+typedef BasicChip8<SchipSpec> SuperChip8;
+typedef BasicChip8<XoChipSpec> XoChip8;
+
+#endif
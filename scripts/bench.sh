@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# bench.sh
+#
+# Travis Banken
+# 2020
+#
+# Runs the benchmark roms headless on each chip8 binary given and prints the
+# best of RUNS instructions/sec per rom, plus the speedup over the first
+# binary.
+#
+# usage: scripts/bench.sh BASELINE_BIN [OTHER_BIN...]
+
+ROMS=${ROMS:-$(ls roms/bench/*.ch8)}
+FRAMES=${FRAMES:-200000}
+RUNS=${RUNS:-3}
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 BASELINE_BIN [OTHER_BIN...]" >&2
+    exit 1
+fi
+
+# best ips of RUNS runs
+best_ips() {
+    best=0
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        ips=$("$1" --headless --quiet --clock-speed 10 --frames "$FRAMES" "$2" 2>/dev/null |
+              awk '{ for (i = 1; i <= NF; i++) if ($i ~ /^ips=/) print substr($i, 5) }')
+        best=$(echo "${ips:-0} $best" | awk '{ print ($1 > $2) ? $1 : $2 }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+printf "%-16s" "rom"
+for bin in "$@"; do
+    printf "%20s" "$(basename "$bin")"
+done
+printf "\n"
+
+for rom in $ROMS; do
+    printf "%-16s" "$(basename "$rom")"
+    base=""
+    for bin in "$@"; do
+        ips=$(best_ips "$bin" "$rom")
+        if [ -z "$base" ]; then
+            base=$ips
+            printf "%20s" "$(echo "$ips" | awk '{ printf "%.1fM ips", $1 / 1e6 }')"
+        else
+            printf "%20s" "$(echo "$ips $base" | awk '{ printf "%.1fM (%.2fx)", $1 / 1e6, $1 / $2 }')"
+        fi
+    done
+    printf "\n"
+done
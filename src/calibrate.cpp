@@ -0,0 +1,93 @@
+/*
+ * calibrate.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Finds the lowest instruction rate a rom looks the same at as when it is
+ * given all the instructions it could want.
+ */
+
+#include <algorithm>
+#include <chip8.h>
+#include <romdb.h>
+#include <calibrate.h>
+
+#define CALIBRATE_SEED 0xC8C8C8C8
+
+/*
+ * Keys for frame f: every second, tap the next key for 6 frames, so roms
+ * sitting on a title screen or in a key wait get going.
+ */
+uint16_t script_keys(uint32_t f)
+{
+    if (f % 60 >= 6)
+        return 0;
+    return 1 << ((f / 60) % 16);
+}
+
+/*
+ * Hash of every frame the rom shows, in order, running the key script with
+ * a fixed seed. A fault ends the run and is part of the hash. drew, if
+ * given, says whether any pixel was ever lit.
+ */
+uint64_t frames_digest(const uint8_t *rom, size_t len, uint8_t quirks, uint ipf, uint frames,
+                       bool *drew)
+{
+    if (drew != nullptr)
+        *drew = false;
+    Chip8 chip8(nullptr, 0, true);
+    chip8.set_verbose(false);
+    chip8.set_seed(CALIBRATE_SEED);
+    chip8.load_rom(rom, len);
+    chip8.set_quirks(quirks);
+    chip8.set_ipf(ipf);
+
+    const uint8_t *framebuf = chip8.peripherals().framebuf();
+    uint8_t frame[FRAME_WIDTH*FRAME_HEIGHT + 8];
+    uint64_t digest = 0;
+    for (uint32_t f = 0; f < frames; f++) {
+        try {
+            chip8.run_frame(script_keys(f));
+        } catch (const Fault &) {
+            return digest ^ 0xFA17;
+        }
+        // chain the previous digest in so order matters
+        for (int i = 0; i < 8; i++) {
+            frame[i] = digest >> (8*i);
+        }
+        std::copy(framebuf, framebuf + FRAME_WIDTH*FRAME_HEIGHT, frame + 8);
+        digest = rom_hash(frame, sizeof(frame));
+        if (drew != nullptr && !*drew)
+            *drew = std::find(frame + 8, frame + sizeof(frame), 1) != frame + sizeof(frame);
+    }
+    return digest;
+}
+
+/*
+ * Roms that pace themselves off the delay timer stop changing what they
+ * show once they have enough instructions per frame; past that the extra
+ * ones only spin in timer waits. Returns the lowest rate that shows the same
+ * frames as CALIBRATE_MAX_IPF does, or 0 if the rom isn't paced like that
+ * (half the reference rate already looks different) or never draws.
+ */
+uint calibrate_ipf(const uint8_t *rom, size_t len, uint8_t quirks, uint frames)
+{
+    bool drew;
+    uint64_t want = frames_digest(rom, len, quirks, CALIBRATE_MAX_IPF, frames, &drew);
+    if (!drew)
+        return 0;
+    uint hi = CALIBRATE_MAX_IPF / 2;
+    if (frames_digest(rom, len, quirks, hi, frames) != want)
+        return 0;
+    // lowest rate that still matches, assuming more never hurts
+    uint lo = 1;
+    while (lo < hi) {
+        uint mid = (lo + hi) / 2;
+        if (frames_digest(rom, len, quirks, mid, frames) == want)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return hi;
+}
@@ -4,7 +4,9 @@
  * Travis Banken
  * 2020
  *
- * Implements main chip8 functionality.
+ * Implements main chip8 functionality. One core runs every machine: CHIP-8,
+ * SUPER-CHIP and XO-CHIP are specs of BasicChip8, whose extra opcodes are
+ * only in the op tables of the specs that have them.
  */
 
 /*
@@ -26,9 +28,10 @@ OPCODES
 8XY3 -- VX = VX ^ VY
 8XY4 -- VX = VX + VY (VF set to 1 if carry out, 0 if not)
 8XY5 -- VX = VX - VY (VF set to 0 if borrow, 1 if not)
-8XY6 -- VX = VX >> 1 (Store least sig bit of VX in VF before shift)
-8XY7 -- VX = VY - VX (VF set to 0 if  borrow, 1 if not)
-8XY8 -- VX = VX << 1 (Store most sig bit of VX in VF before shift)
+8XY6 -- VX = VX >> 1 (Store least sig bit of VX in VF)
+8XY7 -- VX = VY - VX (VF set to 0 if borrow, 1 if not)
+8XYE -- VX = VX << 1 (Store most sig bit of VX in VF)
+        The flag is written last, so it wins when X is F
 
 9XY0 -- skip next isntr if VX != VY
 ANNN -- set I to addr NNN
@@ -43,418 +46,1852 @@ FX07 -- Set VX to the value of the delay timer.
 FX0A -- Key press is awaited, then stored in VX
 FX15 -- Sets the delay timer to VX
 FX18 -- Sets the sound timer to VX
-FX1E -- Adds VX to I. VF is set to 1 when there is a range overflow (I+VX > 0xFFF),
-        and 0 otherwise
-FX29 -- Sets I to the location of the sprite for the character in VX. Characters
-        0-F are represented by a 4x5 font
+FX1E -- Adds VX to I, wrapping at the end of memory. VF is set to 1 when I passes
+        the end, and 0 otherwise (left alone with QUIRK_KEEP_VF)
+FX29 -- Sets I to the location of the sprite for the character in the low nibble
+        of VX. Characters 0-F are represented by a 4x5 font
 FX33 -- take the decimal representation of VX, place the hundreds digit in memory
         at location in I, the tens digit at location I+1, and the ones digit at 
         location I+2
 FX55 -- Store V0 to VX (inclusive) in mem starting at addr I.
 FX65 -- Fill V0 to VX (inclusive) in mem starting at addr I.
+
+SUPER-CHIP and XO-CHIP add
+00CN -- scroll down N pixels (lores scrolls move whole lores pixels)
+00FB -- scroll right 4 pixels
+00FC -- scroll left 4 pixels
+00FD -- exit the interpreter
+00FE -- lores, 64x32
+00FF -- hires, 128x64
+DXY0 -- Draw a 16x16 sprite
+FX30 -- Sets I to the 8x10 font character for the low nibble of VX
+FX75 -- Store V0 to VX (inclusive) in the flag registers
+FX85 -- Fill V0 to VX (inclusive) from the flag registers
+and take only N = 0 in 5XYN and 9XYN.
+
+XO-CHIP adds
+00DN -- scroll up N pixels
+5XY2 -- Store VX to VY (either direction) in mem starting at addr I, I unchanged
+5XY3 -- Fill VX to VY (either direction) from mem starting at addr I, I unchanged
+F000 NNNN -- Set I to the 16 bit addr NNNN, skips skip all 4 bytes of it
+FN01 -- Select the planes in N for drawing, clearing and scrolling
+F002 -- Load the audio pattern from I (ignored, no sound)
+FX3A -- Set the audio pitch to VX (ignored, no sound)
+and draws DXYN on each selected plane from consecutive sprites at I.
+
+Addresses from I (DXYN, FX33, FX55, FX65) wrap at the end of memory. In
+strict mode they fault instead, see set_strict().
 */
 
+#include <array>
+#include <bit>
 #include <fstream>
 #include <iostream>
 #include <chip8.h>
+#include <xochip.h>
+#include <romdb.h>
 #include <assert.h>
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+// what a decoded entry holds
+enum {
+    DEC_NONE,
+    DEC_SINGLE,     // one plain instruction
+    DEC_SPRITE,     // 6XNN 6YNN ANNN DXYN
+    DEC_TIMER_WAIT, // FX07 3XNN 1NNN
+    DEC_LOOP,       // 7XNN 3XNN 1NNN
+};
+
+static void decode_page(const uint8_t *page, Decoded *out, uint from, uint to);
+
+// 8x10 hex digits for FX30; SUPER-CHIP roms only ask for 0-9
+static const uint8_t big_font[16][10] = {
+    {0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF}, // 0
+    {0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF}, // 1
+    {0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF}, // 2
+    {0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 3
+    {0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03}, // 4
+    {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 5
+    {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF}, // 6
+    {0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18}, // 7
+    {0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF}, // 8
+    {0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 9
+    {0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3}, // A
+    {0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC}, // B
+    {0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C}, // C
+    {0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC}, // D
+    {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF}, // E
+    {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0}, // F
+};
+
+/*
+ * Blank machine: font loaded, no program, everything else zeroed. The
+ * extended machines start in lores drawing on plane 1.
+ */
+template<typename Spec>
+static typename BasicChip8<Spec>::State make_blank_state()
+{
+    typename BasicChip8<Spec>::State blank;
+    blank.mem = typename BasicChip8<Spec>::Memory(decode_page);
+    blank.I = 0;
+    blank.pc = 0x200;
+    std::fill(blank.V, blank.V + 16, 0);
+    std::fill(blank.stack, blank.stack + STACK_DEPTH, 0);
+    blank.sp = 0;
+    blank.key_wait = false;
+    blank.rand = 1;
+    std::fill(blank.periphs.framebuf, blank.periphs.framebuf + sizeof(blank.periphs.framebuf), 0);
+    blank.periphs.timer = 0;
+    blank.periphs.keys = 0;
+    blank.periphs.last_keycode = NO_KEY;
+    blank.ext = ExtRegs<Spec>();
+    return blank;
+}
+
+template<typename Spec>
+static const typename BasicChip8<Spec>::State &blank_state()
+{
+    // machines get built on several threads at once (chip8-probe)
+    static const typename BasicChip8<Spec>::State blank = make_blank_state<Spec>();
+    return blank;
+}
 
-static void log_instr(Instr i)
+static void log_instr(uint16_t raw)
 {
     std::fprintf(stderr, "----------------------------------------\n");
-    std::fprintf(stderr, "Current Instruction: 0x%04X\n", i.raw);
-    std::fprintf(stderr, "op  -> 0x%01X\n", i.op);
-    std::fprintf(stderr, "nnn -> 0x%03X\n", i.nnn);
-    std::fprintf(stderr, "nn  -> 0x%02X\n", i.nn);
-    std::fprintf(stderr, "vx  -> 0x%01X\n", i.vx);
-    std::fprintf(stderr, "vy  -> 0x%01X\n", i.vy);
+    std::fprintf(stderr, "Current Instruction: 0x%04X\n", raw);
+    std::fprintf(stderr, "op  -> 0x%01X\n", raw >> 12);
+    std::fprintf(stderr, "nnn -> 0x%03X\n", raw & 0xFFF);
+    std::fprintf(stderr, "nn  -> 0x%02X\n", raw & 0xFF);
+    std::fprintf(stderr, "vx  -> 0x%01X\n", (raw >> 8) & 0xF);
+    std::fprintf(stderr, "vy  -> 0x%01X\n", (raw >> 4) & 0xF);
     std::fprintf(stderr, "----------------------------------------\n");
 }
 
-Chip8::Chip8(const std::string program, uint pixel_scale, uint clock_speed, bool max_clock)
-    : I(0), pc(0x200), m_mem(), periphs(("Chip8: " + program).c_str(), 
-                                        pixel_scale, clock_speed, max_clock)
+template<typename Spec>
+BasicChip8<Spec>::BasicChip8(const std::string &program, Frontend *frontend, uint clock_speed, bool max_clock)
+    : BasicChip8(frontend, clock_speed, max_clock)
 {
-    // set seed for rand
-    std::srand(std::time(nullptr));
-
-    // load ops into array
-    opfuncs[0]  = &Chip8::op0;
-    opfuncs[1]  = &Chip8::op1;
-    opfuncs[2]  = &Chip8::op2;
-    opfuncs[3]  = &Chip8::op3;
-    opfuncs[4]  = &Chip8::op4;
-    opfuncs[5]  = &Chip8::op5;
-    opfuncs[6]  = &Chip8::op6;
-    opfuncs[7]  = &Chip8::op7;
-    opfuncs[8]  = &Chip8::op8;
-    opfuncs[9]  = &Chip8::op9;
-    opfuncs[10] = &Chip8::opA;
-    opfuncs[11] = &Chip8::opB;
-    opfuncs[12] = &Chip8::opC;
-    opfuncs[13] = &Chip8::opD;
-    opfuncs[14] = &Chip8::opE;
-    opfuncs[15] = &Chip8::opF;
-
-    // load program
-    Chip8::load_program(program);
-}
-
-void Chip8::load_program(const std::string program)
-{
-    std::ifstream progstream(program);
-    if (!progstream.is_open()) {
-        std::cerr << "Failed to open " << program << " for loading!\n";
+    if (!load_file(program))
         std::exit(1);
+}
+
+template<typename Spec>
+BasicChip8<Spec>::BasicChip8(Frontend *frontend, uint clock_speed, bool max_clock)
+    : I(0), pc(0x200), m_mem(decode_page), periphs(frontend), m_max_clock(max_clock)
+{
+    init(ipf_for_clock(clock_speed));
+}
+
+template<typename Spec>
+BasicChip8<Spec>::BasicChip8(Frontend *frontend, bool max_clock)
+    : I(0), pc(0x200), m_mem(decode_page), periphs(frontend), m_max_clock(max_clock)
+{
+    init(Spec::IPF);
+}
+
+template<typename Spec>
+void BasicChip8<Spec>::init(uint ipf)
+{
+    // set seed for rand
+    m_seed = std::time(nullptr);
+    m_rand = m_seed ? m_seed : 1;
+
+    m_ipf = ipf;
+
+    save_state(m_boot);
+}
+
+/*
+ * load_rom() from a file. Says why and returns false if it can't.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::load_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Failed to open " << path << " for loading!\n";
+        return false;
     }
-    uint16_t addr = 0x200;
-    uint16_t offset = 0;
-    while (!progstream.eof()) {
-        uint8_t byte;
-        progstream.get((char&)byte);
-        m_mem.write(byte, (addr + offset));
-        offset++;
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+    if (!load_rom(rom.data(), rom.size())) {
+        std::cerr << "Error: " << path << " is too large to fit in memory!\n";
+        return false;
     }
-    progstream.close();
+    return true;
 }
 
-void Chip8::run()
+/*
+ * Reset to a blank machine, copy a rom image into program memory at 0x200 and
+ * remember that as the state reset() goes back to. Returns false if the rom
+ * does not fit. Machines loading the same rom share its pages; a rom loaded
+ * once and thrown away (fuzz inputs) skips that and is copied into this
+ * machine's own pages.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::load_rom(const uint8_t *rom, size_t len, bool once)
 {
-    while (pc < m_mem.size()) {
-        step();
+    if (len > m_mem.size() - 0x200)
+        return false;
+    load_state(blank_state<Spec>());
+    m_rand = m_seed ? m_seed : 1;
+    if (once)
+        m_mem.load_private(rom, len);
+    else
+        m_mem.load_program(rom, len);
+    if constexpr (Spec::EXTENDED) {
+        // the image only has the small font, the big one costs this Mem page 0
+        for (int c = 0; c < 16; c++) {
+            for (int row = 0; row < 10; row++) {
+                m_mem.write(big_font[c][row], BIG_FONT_ADDR + 10*c + row);
+            }
+        }
+        m_mem.redecode(BIG_FONT_ADDR, sizeof(big_font));
     }
-    while (1)
-        periphs.refresh();
+    m_rom_hash = ::rom_hash(rom, len);
+    save_state(m_boot);
+    return true;
 }
 
-void Chip8::step()
+/*
+ * Seed CXNN, for runs that have to repeat exactly. Takes effect now and on
+ * every reset.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::set_seed(uint32_t seed)
 {
-    std::fprintf(stderr, "========================================\n");
-    std::fprintf(stderr, "Current PC: 0x%04X\n", pc);
-    assert(pc < m_mem.size() && pc >= 0x200);
+    m_seed = seed;
+    m_rand = seed ? seed : 1;
+    m_boot.rand = m_rand;
+}
 
-    // read instruction
-    // instr are 2 bytes in size (requires 2 reads)
-    uint16_t raw_instr = (((uint16_t)m_mem.read(pc)) << 8) | m_mem.read(pc+1);
-    if (raw_instr == 0x0) {
-        nop();
+template<typename Spec>
+uint8_t BasicChip8<Spec>::next_rand()
+{
+    // xorshift32
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand >> 24;
+}
+
+/*
+ * Put the machine back to the state right after the rom was loaded.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::reset()
+{
+    load_state(m_boot);
+}
+
+template<typename Spec>
+void BasicChip8<Spec>::save_state(State &s)
+{
+    s.I = I;
+    s.pc = pc;
+    std::copy(V, V + 16, s.V);
+    std::copy(m_stack, m_stack + STACK_DEPTH, s.stack);
+    s.sp = m_sp;
+    s.key_wait = m_key_wait;
+    s.rand = m_rand;
+    s.mem = m_mem;
+    periphs.save_state(s.periphs);
+    s.ext = m_ext;
+}
+
+template<typename Spec>
+void BasicChip8<Spec>::load_state(const State &s)
+{
+    I = s.I;
+    pc = s.pc;
+    std::copy(s.V, s.V + 16, V);
+    std::copy(s.stack, s.stack + STACK_DEPTH, m_stack);
+    m_sp = s.sp;
+    m_key_wait = s.key_wait;
+    m_rand = s.rand;
+    m_mem = s.mem;
+    periphs.load_state(s.periphs);
+    m_ext = s.ext;
+}
+
+/*
+ * Turn child into a copy of this machine, for searches that branch from a
+ * state: registers, stack, memory, timer, screen, keys, the CXNN generator
+ * and the settings that change how it runs. Memory is shared page by page
+ * until either side writes, decoded code along with it, so a fork costs
+ * little more than the screen copy. Tracing, exports and streams stay with
+ * this machine.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::fork(BasicChip8 &child)
+{
+    if (&child == this)
         return;
+    child.I = I;
+    child.pc = pc;
+    std::copy(V, V + 16, child.V);
+    std::copy(m_stack, m_stack + STACK_DEPTH, child.m_stack);
+    child.m_sp = m_sp;
+    child.m_key_wait = m_key_wait;
+    child.m_rand = m_rand;
+    child.m_seed = m_seed;
+    child.m_frame = m_frame;
+    child.m_ipf = m_ipf;
+    child.m_quirks = m_quirks;
+    child.m_strict = m_strict;
+    child.m_rom_hash = m_rom_hash;
+    child.m_sprites = m_sprites;
+    child.m_offscreen = m_offscreen;
+    child.m_mem = m_mem;
+    periphs.fork(child.periphs);
+    child.m_ext = m_ext;
+    child.m_boot = m_boot;
+}
+
+/*
+ * Run one 60Hz frame worth of instructions against the given keypad state
+ * (bit n set means key n is held), then tick the timer. Time only moves in
+ * emulated frames here, so this is what headless hosts should drive.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::run_frame(uint16_t keys)
+{
+    periphs.set_keys(keys);
+    emulate_frame();
+}
+
+/*
+ * run_frame() that stops as soon as the rest of the frame could only spin:
+ * in an FX0A wait with no key held, or in a loop that waits on the timer or
+ * jumps to itself. The frame still counts and the timer still ticks. Those
+ * spins only move pc around the loop and reread the timer, so the machine
+ * ends up as run_frame() would have left it, apart from pc sitting at the
+ * loop head and a timer wait's register holding an older timer value.
+ * Schedulers use the return value to park the machine; see idle_frames()
+ * and skip_frames().
+ */
+template<typename Spec>
+Chip8Base::Yield BasicChip8<Spec>::run_frame_coop(uint16_t keys)
+{
+    periphs.set_keys(keys);
+    Yield why = YIELD_FRAME;
+    bool single = m_tracer || m_verbose;
+    for (uint i = 0; i < m_ipf;) {
+        if (spinning()) {
+            why = YIELD_IDLE;
+            break;
+        }
+        if (single) {
+            step();
+            i++;
+        } else {
+            i += step_decoded(m_ipf - i);
+        }
+        if (m_key_wait) {
+            why = YIELD_KEY_WAIT;
+            break;
+        }
     }
-    Instr instr;
-    instr.raw =  raw_instr;
-    instr.op  = (raw_instr >> 12) & 0xF;
-    instr.nnn = (raw_instr >>  0) & 0xFFF;
-    instr.nn  = (raw_instr >>  0) & 0xFF;
-    instr.n   = (raw_instr >>  0) & 0xF;
-    instr.vx  = (raw_instr >>  8) & 0xF;
-    instr.vy  = (raw_instr >>  4) & 0xF;
-    log_instr(instr);
+    frame_done();
+    return why;
+}
 
-    assert(instr.op < NUM_OPS);
-    assert(opfuncs[instr.op] != NULL);
-    // call op function
-    (this->*opfuncs[instr.op])(instr);
-    periphs.refresh();
+/*
+ * At a 1NNN jump to itself, at an 00FD exit (which stays where it is), or at
+ * a fused timer wait that jumps to itself and won't be let out by the
+ * current timer value.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::spinning()
+{
+    if ((uint32_t)pc + 1 >= m_mem.size() || pc < 0x200)
+        return false;
+    const Decoded &d = m_mem.decoded(pc);
+    uint16_t raw = d.raw[0];
+    if (d.kind == DEC_NONE)
+        raw = (m_mem.read(pc) << 8) | m_mem.read(pc + 1);
+    if (pc <= 0xFFF && raw == (0x1000 | pc))
+        return true;
+    if (Spec::EXTENDED && raw == 0x00FD)
+        return true;
+    return d.kind == DEC_TIMER_WAIT && (d.raw[2] & 0xFFF) == pc
+        && periphs.get_timer() != (d.raw[1] & 0xFF);
 }
 
-void Chip8::nop()
+/*
+ * Whole frames from now the machine is certain to do nothing but spin: a
+ * timer wait spins until the timer counts down to its value, a jump to
+ * itself (or a wait for a value the timer has already passed) forever.
+ * 0 if the next frame does real work.
+ */
+template<typename Spec>
+uint32_t BasicChip8<Spec>::idle_frames()
 {
-    std::fprintf(stderr, "NOP Instruction!\n");
-    pc += 2;
+    if (!spinning())
+        return 0;
+    const Decoded &d = m_mem.decoded(pc);
+    if (d.kind != DEC_TIMER_WAIT)
+        return IDLE_FOREVER;
+    uint8_t timer = periphs.get_timer();
+    uint8_t until = d.raw[1] & 0xFF;
+    return until < timer ? timer - until : IDLE_FOREVER;
 }
 
-// *** Op Code handlers ***
+/*
+ * Let n frames go by without running them: only the timer and the frame
+ * count move. For machines parked by a scheduler.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::skip_frames(uint32_t n)
+{
+    for (uint32_t i = 0; i < n && periphs.get_timer() > 0; i++) {
+        periphs.tick_timer();
+    }
+    m_frame += n;
+}
 
-void Chip8::op0(Instr instr)
+/*
+ * Up to n instructions, stopping early with pc at stop_pc (-1 for never).
+ * Returns how many ran. Stopping on a pc has to look at every instruction,
+ * so that goes through plain steps.
+ */
+template<typename Spec>
+uint BasicChip8<Spec>::run_instrs(uint n, int32_t stop_pc)
 {
-    switch (instr.raw) {
-    case 0x00E0:
-        // 00E0 -- clear the screen
-        periphs.clear_screen();
-        pc += 2;
-        break;
-    case 0x00EE:
-        // 00EE -- return from subroutine
-        pc = m_subroutines.top() + 2;
-        m_subroutines.pop();
-        char pcfmt[8];
-        sprintf(pcfmt, "0x%04X\n", pc);
-        std::cerr << "Returning from subroutine to pc " << pcfmt << std::endl;
-        break;
-    default:
-        // 0NNN -- Call RCA 1802 program at addr NNN. 
-        // Not necessary for most ROMs
-        std::cerr << "Warning: Instruction 0NNN not implemented :(\n";
-        pc += 2;
-        break;
+    bool single = m_tracer || m_verbose || stop_pc >= 0;
+    uint i = 0;
+    while (i < n && pc != stop_pc) {
+        if (single) {
+            step();
+            i++;
+        } else {
+            i += step_decoded(n - i);
+        }
     }
+    return i;
 }
 
-void Chip8::op1(Instr instr)
+static const char *stop_names[] = {
+    "frames", "instrs", "pc", "frame-hash", "halt", "time", "fault",
+};
+
+const char *Chip8Base::stop_name(StopReason reason)
 {
-    std::fprintf(stderr, "Jumping to 0x%04x\n", instr.nnn);
-    // 1NNN -- jmp to adr NNN
-    pc = instr.nnn;
+    return stop_names[reason];
 }
 
-void Chip8::op2(Instr instr)
+template<typename Spec>
+uint64_t BasicChip8<Spec>::frame_hash()
 {
-    // 2NNN -- call subroutine at NNN
-    m_subroutines.push(pc);
-    pc = instr.nnn;
-    char pcfmt[8];
-    sprintf(pcfmt, "0x%04X", pc);
-    std::cerr << "Calling subroutine at " << pcfmt << std::endl;
+    return ::rom_hash(framebuf(), Spec::WIDTH*Spec::HEIGHT);
 }
 
-void Chip8::op3(Instr instr)
+/*
+ * Run frames with the keys held now until one of the limits is hit, for
+ * batch jobs that should end as soon as there is nothing left to see. A
+ * halt is a jump to itself, a timer wait the timer has already passed, or
+ * an FX0A with no key held (nothing will press one). Frame limits are
+ * checked between frames and instruction ones between instructions, so an
+ * instruction or pc limit can stop partway through a frame, before its
+ * timer tick. A fault stops the run instead of being thrown.
+ */
+template<typename Spec>
+Chip8Base::RunResult BasicChip8<Spec>::run_until(const RunLimits &limits)
 {
-    // 3XNN -- skip next instr if VX == NN
-    if (V[instr.vx] == instr.nn) {
-        pc += 4;
-    } else {
-        pc += 2;
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    bool instr_limits = limits.instrs || limits.pc >= 0;
+    RunResult r;
+    r.frames = 0;
+    r.instrs = 0;
+    r.fault = FAULT_BAD_PC;
+    r.fault_addr = 0;
+    r.fault_pc = 0;
+    r.fault_opcode = 0;
+
+    try {
+        while (true) {
+            if (limits.frames && r.frames >= limits.frames) {
+                r.reason = STOP_FRAMES;
+                break;
+            }
+            if (limits.halt && (idle_frames() == IDLE_FOREVER
+                                || (m_key_wait && periphs.get_keystate() == NO_KEY))) {
+                r.reason = STOP_HALT;
+                break;
+            }
+            if (!instr_limits) {
+                emulate_frame();
+                r.instrs += m_ipf;
+            } else {
+                uint budget = m_ipf;
+                if (limits.instrs && limits.instrs - r.instrs < budget)
+                    budget = limits.instrs - r.instrs;
+                uint ran = run_instrs(budget, limits.pc);
+                r.instrs += ran;
+                if (ran < m_ipf) {
+                    if (ran)
+                        r.frames++;
+                    r.reason = pc == limits.pc ? STOP_PC : STOP_INSTRS;
+                    break;
+                }
+                frame_done();
+            }
+            r.frames++;
+            if (limits.match_hash && frame_hash() == limits.frame_hash) {
+                r.reason = STOP_FRAME_HASH;
+                break;
+            }
+            // a clock read every frame would cost more than short frames
+            if (limits.seconds > 0 && r.frames % 64 == 0
+                && std::chrono::duration<double>(clock::now() - start).count() >= limits.seconds) {
+                r.reason = STOP_TIME;
+                break;
+            }
+        }
+    } catch (const Fault &f) {
+        r.reason = STOP_FAULT;
+        r.fault = f.type;
+        r.fault_addr = f.addr;
+        r.fault_pc = f.pc;
+        r.fault_opcode = f.opcode;
+        r.fault_msg = f.what();
     }
+
+    r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    r.pc = pc;
+    r.I = I;
+    std::copy(V, V + 16, r.V);
+    r.timer = periphs.get_timer();
+    r.frame_hash = frame_hash();
+    return r;
 }
 
-void Chip8::op4(Instr instr)
+template<typename Spec>
+void BasicChip8<Spec>::emulate_frame()
 {
-    // 4XNN -- skip next instr if VX != NN
-    if (V[instr.vx] != instr.nn) {
-        pc += 4;
+    if (m_perf) {
+        profiled_frame();
+    } else if (m_tracer || m_verbose) {
+        // these want to see every instruction on its own
+        for (uint i = 0; i < m_ipf; i++) {
+            step();
+        }
     } else {
-        pc += 2;
+        for (uint i = 0; i < m_ipf;) {
+            i += step_decoded(m_ipf - i);
+        }
     }
+    frame_done();
 }
 
-void Chip8::op5(Instr instr)
+/*
+ * Every frame ends here: tick the timers, count the frame and hand it to the
+ * frame export and the stream, taking back the keys readers hold there.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::frame_done()
 {
-    // 5XY0 -- skip next instr if VX == VY
-    if (V[instr.vx] == V[instr.vy]) {
-        pc += 4;
-    } else {
-        pc += 2;
+    periphs.tick_timer();
+    if constexpr (Spec::EXTENDED)
+        m_ext.sound -= m_ext.sound == 0 ? 0 : 1;
+    m_frame++;
+    if (m_export) {
+        m_export->publish(m_frame, pc, I, V, periphs.get_timer(), periphs.framebuf());
+        uint16_t keys;
+        if (m_export->keys(keys))
+            periphs.set_keys(keys);
+    }
+    if (m_stream) {
+        m_stream->publish(m_frame, periphs.framebuf());
+        uint16_t keys;
+        if (m_stream->keys(keys))
+            periphs.set_keys(keys);
     }
 }
 
-void Chip8::op6(Instr instr)
+/*
+ * Run-ahead: emulate m_run_ahead more frames with the keys held now, show
+ * the last of them and roll back. A key press then shows up on screen as
+ * soon as the game would react to it, instead of m_run_ahead frames later.
+ * The extra frames are not traced. If they fault, the present frame is
+ * shown; the real frames will get to the fault on their own.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::draw_ahead()
 {
-    // 6XNN -- set VX to NN
-    V[instr.vx] = instr.nn;
-    pc += 2;
+    std::unique_ptr<Tracer> tracer = std::move(m_tracer);
+    std::unique_ptr<ShmExport> shm = std::move(m_export);
+    std::unique_ptr<StreamServer> stream = std::move(m_stream);
+    uint32_t frame = m_frame;
+    save_state(m_ahead);
+    try {
+        for (uint i = 0; i < m_run_ahead; i++) {
+            emulate_frame();
+        }
+    } catch (const Fault &) {
+        load_state(m_ahead);
+    }
+    periphs.stats().cpu_done(0);
+    show();
+    load_state(m_ahead);
+    m_frame = frame;
+    m_tracer = std::move(tracer);
+    m_export = std::move(shm);
+    m_stream = std::move(stream);
 }
 
-void Chip8::op7(Instr instr)
+/*
+ * Draw the screen as it is now. The extended machines' screens go to the
+ * frontend at their own size.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::show()
 {
-    // 7XNN -- Add NN to VX (carry flag not changed)
-    V[instr.vx] += instr.nn;
-    // V[instr.vx] &= 0xF; // TODO maybe this???
-    pc += 2;
+    if constexpr (Spec::EXTENDED)
+        periphs.draw_screen(framebuf(), Spec::WIDTH, Spec::HEIGHT);
+    else
+        periphs.draw();
+}
+
+/*
+ * Once per step in step mode: take input and draw.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::refresh()
+{
+    periphs.poll_input();
+    show();
 }
 
-void Chip8::op8(Instr instr)
+/*
+ * speed: emulated frames per shown frame, 0 to run as many as fit.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::set_fast_forward(bool on, uint speed)
+{
+    m_ff_speed = speed;
+    periphs.set_fast_forward(on);
+}
+
+/*
+ * Frame loop for running with a frontend: take input, a frame of
+ * instructions, tick the timer, draw once (running ahead first if enabled),
+ * then sleep to the next 60Hz deadline (unless max clock). Frames that
+ * finish past their deadline count as late; if we fall more than a whole
+ * frame behind, the missed deadlines are dropped instead of rushed.
+ *
+ * Fast forwarding, each shown frame instead emulates frames back to back
+ * (timers still tick once per emulated frame) until the speed is reached or
+ * only the time the last draw took is left before the deadline, so the
+ * display keeps its rate however much the host can emulate.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::run()
 {
-    uint16_t res;
-    switch (instr.raw & 0xF) {
+    typedef std::chrono::steady_clock clock;
+    const clock::duration frame_time = std::chrono::microseconds(1000000 / 60);
+    Stats &stats = periphs.stats();
+    clock::time_point deadline = clock::now() + frame_time;
+    clock::duration draw_cost(0);
+
+    while (true) {
+        stats.begin_frame();
+        periphs.poll_input();
+        uint64_t frames = 1;
+        emulate_frame();
+        if (periphs.fast_forward()) {
+            clock::time_point until = std::min(deadline, clock::now() + frame_time) - draw_cost;
+            while ((m_ff_speed == 0 || frames < m_ff_speed) && clock::now() < until) {
+                emulate_frame();
+                frames++;
+            }
+        }
+        stats.cpu_done(m_ipf * frames);
+        clock::time_point drawn = clock::now();
+        if (m_run_ahead && !periphs.fast_forward())
+            draw_ahead();
+        else
+            show();
+        draw_cost = clock::now() - drawn;
+
+        bool late = false;
+        uint64_t dropped = 0;
+        if (!m_max_clock) {
+            clock::time_point now = clock::now();
+            if (now < deadline) {
+                std::this_thread::sleep_until(deadline);
+            } else {
+                late = true;
+                dropped = (now - deadline) / frame_time;
+                deadline += dropped * frame_time;
+            }
+            deadline += frame_time;
+        }
+        stats.end_frame(late, dropped, frames);
+    }
+}
+
+/*
+ * Record every instruction from here on into a compressed trace file (see
+ * trace.h). Returns false if the file could not be opened.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::start_trace(const char *path)
+{
+    end_trace();
+    m_tracer.reset(new Tracer());
+    if (!m_tracer->open(path)) {
+        m_tracer.reset();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Publish every frame from here on to the shared memory segment name (see
+ * shm_export.h). Returns false if it could not be made.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::start_export(const char *name)
+{
+    if (Spec::EXTENDED) {
+        std::fprintf(stderr, "Error: the frame export only takes %ux%u screens\n", FRAME_WIDTH,
+                     FRAME_HEIGHT);
+        return false;
+    }
+    m_export.reset(new ShmExport());
+    if (!m_export->create(name)) {
+        m_export.reset();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Stop publishing and remove the segment.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::end_export()
+{
+    m_export.reset();
+}
+
+/*
+ * Stream changed frames to clients on a local socket and take keys from
+ * them (see stream.h). Returns false if it could not listen on addr.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::start_stream(const char *addr)
+{
+    if (Spec::EXTENDED) {
+        std::fprintf(stderr, "Error: the frame stream only takes %ux%u screens\n", FRAME_WIDTH,
+                     FRAME_HEIGHT);
+        return false;
+    }
+    m_stream.reset(new StreamServer());
+    if (!m_stream->listen(addr)) {
+        m_stream.reset();
+        return false;
+    }
+    return true;
+}
+
+template<typename Spec>
+void BasicChip8<Spec>::end_stream()
+{
+    m_stream.reset();
+}
+
+/*
+ * Count host cycles, cache and branch misses from now on, see
+ * profiled_frame(). Costs some speed, so only for profiling runs.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::start_perf()
+{
+    m_perf.reset(new PerfProfile());
+    if (!m_perf->open()) {
+        m_perf.reset();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Print what the host counters saw to stderr and stop counting.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::end_perf()
+{
+    if (!m_perf)
+        return;
+    m_perf->report(stderr);
+    m_perf.reset();
+}
+
+/*
+ * The instructions of one frame with host counters read around them. Frames
+ * take turns: one through the decoded engine, one through plain step(), and
+ * one plain frame where every PERF_SAMPLE_EVERY-th instruction is counted on
+ * its own under its opcode class. Both engines give the same machine state, so
+ * switching between them doesn't change what the rom does. The decoded
+ * engine skips the tracer and verbose logging, so with either of those its
+ * turn goes to plain step() too, and only the plain engine gets counted.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::profiled_frame()
+{
+    uint turn = m_frame % 3;
+    if (turn == 0 && (m_tracer || m_verbose))
+        turn = 1;
+    switch (turn) {
     case 0:
-        // 8XY0 -- set VX = VY
-        V[instr.vx] = V[instr.vy];
+        m_perf->begin();
+        for (uint i = 0; i < m_ipf;) {
+            i += step_decoded(m_ipf - i);
+        }
+        m_perf->end_engine(ENGINE_FUSED, m_ipf);
         break;
     case 1:
-        // 8XY1 -- VX = VX | VY
-        V[instr.vx] |= V[instr.vy];
-        break;
-    case 2:
-        // 8XY2 -- VX = VX & VY
-        V[instr.vx] &= V[instr.vy];
-        break;
-    case 3:
-        // 8XY3 -- VX = VX ^ VY
-        V[instr.vx] ^= V[instr.vy];
-        break;
-    case 4:
-        // 8XY4 -- VX = VX + VY (VF set to 1 if carry out, 0 if not)
-        res = V[instr.vx] + V[instr.vy];
-        V[instr.vx] = res & 0xFF;
-        V[0xF] = (res >> 16) & 0x1;
-        break;
-    case 5:
-        // 8XY5 -- VX = VX - VY (VF set to 0 if borrow, 1 if not)
-        V[0xF] = V[instr.vx] < V[instr.vy] ? 0 : 1;
-        V[instr.vx] -= V[instr.vy];
-        break;
-    case 6:
-        // 8XY6 -- VX = VX >> 1 (Store least sig bit of VX in VF before shift)
-        V[0xF] = V[instr.vx] & 0x1;
-        V[instr.vx] = V[instr.vx] >> 1;
-        break;
-    case 7:
-        // 8XY7 -- VX = VY - VX (VF set to 0 if borrow, 1 if not)
-        V[0xF] = V[instr.vy] < V[instr.vx] ? 0 : 1;
-        V[instr.vy] -= V[instr.vx];
-        break;
-    case 0xE:
-        // 8XYE -- VX = VX << 1 (Store most sig bit of VX in VF before shift)
-        // NOTE what happens if instr.vx == 0xF?
-        V[0xF] = (V[instr.vx] >> 7) & 0x1;
-        V[instr.vx] = V[instr.vx] << 1;
+        m_perf->begin();
+        for (uint i = 0; i < m_ipf; i++) {
+            step();
+        }
+        m_perf->end_engine(ENGINE_PLAIN, m_ipf);
         break;
     default:
-        std::cerr << __FUNCTION__ << ": Error: This line shouldn't print!\n";
-        std::exit(1);
+        for (uint i = 0; i < m_ipf; i++) {
+            // a bad pc faults inside step(), not here
+            if (i % PERF_SAMPLE_EVERY != 0 || (uint32_t)pc + 1 >= m_mem.size() || pc < 0x200) {
+                step();
+                continue;
+            }
+            uint8_t cls = m_mem.read(pc) >> 4;
+            m_perf->begin();
+            step();
+            m_perf->end_class(cls);
+        }
+        break;
     }
-    pc += 2;
 }
 
-void Chip8::op9(Instr instr)
+/*
+ * Flush and close the trace, if there is one.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::end_trace()
 {
-    // 9XY0 -- skip next isntr if VX != VY
-    if (V[instr.vx] != V[instr.vy]) {
-        pc += 4;
-    } else {
-       pc += 2;
+    m_tracer.reset();
+}
+
+template<typename Spec>
+void BasicChip8<Spec>::step()
+{
+    if (m_tracer) {
+        traced_step();
+        return;
     }
+    execute();
 }
 
-void Chip8::opA(Instr instr)
+/*
+ * step() with the instruction and what it changed written to the trace.
+ * Memory writes are only FX33, FX55 and XO-CHIP's 5XY2, so they come from
+ * the opcode and I rather than hooking every write.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::traced_step()
 {
-    // ANNN -- set I to addr NNN
-    I = instr.nnn;
-    pc += 2;
+    TraceRecord r;
+    uint8_t before[16];
+    std::copy(V, V + 16, before);
+    uint16_t I_before = I;
+
+    r.frame = m_frame;
+    r.pc = pc;
+    r.opcode = 0;
+    if ((uint32_t)pc + 1 < m_mem.size())
+        r.opcode = (((uint16_t)m_mem.read(pc)) << 8) | m_mem.read(pc+1);
+
+    execute();
+
+    r.I = I;
+    r.vmask = 0;
+    for (int i = 0; i < 16; i++) {
+        if (V[i] != before[i])
+            r.vmask |= 1 << i;
+    }
+    std::copy(V, V + 16, r.V);
+    r.waddr = 0;
+    r.wlen = 0;
+    if ((r.opcode & 0xF0FF) == 0xF033) {
+        r.waddr = I_before;
+        r.wlen = 3;
+    } else if ((r.opcode & 0xF0FF) == 0xF055) {
+        r.waddr = I_before;
+        r.wlen = ((r.opcode >> 8) & 0xF) + 1;
+    } else if (Spec::XO && (r.opcode & 0xF00F) == 0x5002) {
+        uint8_t x = (r.opcode >> 8) & 0xF;
+        uint8_t y = (r.opcode >> 4) & 0xF;
+        r.waddr = I_before;
+        r.wlen = (x <= y ? y - x : x - y) + 1;
+    }
+    r.timer = periphs.get_timer();
+    m_tracer->record(r);
 }
 
-void Chip8::opB(Instr instr)
+template<typename Spec>
+void BasicChip8<Spec>::execute()
 {
-    // BNNN -- Jmp to addr NNN + V0
-    pc = instr.nnn + V[0];
+    if (m_verbose) {
+        std::fprintf(stderr, "========================================\n");
+        std::fprintf(stderr, "Current PC: 0x%04X\n", pc);
+    }
+    if ((uint32_t)pc + 1 >= m_mem.size() || pc < 0x200)
+        fault(FAULT_BAD_PC, pc, "PC left program memory!");
+
+    // read instruction
+    // instr are 2 bytes in size (requires 2 reads)
+    uint16_t raw_instr = (((uint16_t)m_mem.read(pc)) << 8) | m_mem.read(pc+1);
+    dispatch(raw_instr);
 }
 
-void Chip8::opC(Instr instr)
+// *** Decoded instruction stream ***
+
+/*
+ * Decode the instructions starting at [from, to) of a memory page (Mem
+ * keeps the entries with the page, see mem.h). If one starts an idiom roms
+ * use all the time, the whole run is fused into one entry with its own
+ * handler. Entries only describe what starts at their address, so a jump
+ * into the middle of a fused run just uses the entry there, and they only
+ * read their own page: an instruction split across two pages is left to
+ * execute(), a run that would cross into the next page isn't fused.
+ */
+static void decode_page(const uint8_t *page, Decoded *out, uint from, uint to)
 {
-    // CXNN -- VX = rand() & NN
-    V[instr.vx] = std::rand() & instr.nn;
+    for (uint off = from; off < to; off++) {
+        Decoded &d = out[off];
+        int avail = 0;
+        for (; avail < 4 && off + 2*avail + 1 < PAGE_SIZE; avail++) {
+            d.raw[avail] = (((uint16_t)page[off + 2*avail]) << 8) | page[off + 2*avail + 1];
+        }
+        for (int i = avail; i < 4; i++) {
+            d.raw[i] = 0;
+        }
+        d.kind = avail == 0 ? DEC_NONE : DEC_SINGLE;
+        d.len = 1;
+
+        const uint16_t *raw = d.raw;
+        bool same_x = ((raw[0] ^ raw[1]) & 0x0F00) == 0;
+        if (avail >= 4 && (raw[0] >> 12) == 0x6 && (raw[1] >> 12) == 0x6
+                && (raw[2] >> 12) == 0xA && (raw[3] >> 12) == 0xD) {
+            d.kind = DEC_SPRITE;
+            d.len = 4;
+        } else if (avail >= 3 && (raw[0] & 0xF0FF) == 0xF007 && (raw[1] >> 12) == 0x3
+                && same_x && (raw[2] >> 12) == 0x1) {
+            d.kind = DEC_TIMER_WAIT;
+            d.len = 3;
+        } else if (avail >= 3 && (raw[0] >> 12) == 0x7 && (raw[1] >> 12) == 0x3
+                && same_x && (raw[2] >> 12) == 0x1) {
+            d.kind = DEC_LOOP;
+            d.len = 3;
+        }
+    }
+}
+
+/*
+ * step() through the decoded stream. Runs at most budget instructions and
+ * returns how many ran, so frames still run exactly m_ipf of them.
+ */
+template<typename Spec>
+uint BasicChip8<Spec>::step_decoded(uint budget)
+{
+    if ((uint32_t)pc + 1 >= m_mem.size() || pc < 0x200)
+        fault(FAULT_BAD_PC, pc, "PC left program memory!");
+
+    const Decoded &d = m_mem.decoded(pc);
+    if (d.kind == DEC_SINGLE) {
+        dispatch(d.raw[0]);
+        return 1;
+    }
+    if (d.kind == DEC_NONE) {
+        execute();
+        return 1;
+    }
+    if (d.len > budget) {
+        dispatch(d.raw[0]);
+        return 1;
+    }
+    switch (d.kind) {
+    case DEC_SPRITE:
+        return fused_sprite(d);
+    case DEC_TIMER_WAIT:
+        return fused_timer_wait(d, budget);
+    case DEC_LOOP:
+        return fused_loop(d, budget);
+    default:
+        dispatch(d.raw[0]);
+        return 1;
+    }
+}
+
+// 6XNN 6YNN ANNN DXYN -- load coordinates and sprite, draw
+template<typename Spec>
+uint BasicChip8<Spec>::fused_sprite(const Decoded &d)
+{
+    V[(d.raw[0] >> 8) & 0xF] = d.raw[0] & 0xFF;
+    V[(d.raw[1] >> 8) & 0xF] = d.raw[1] & 0xFF;
+    I = d.raw[2] & 0xFFF;
+    // pc on the DXYN in case the draw faults
+    pc += 6;
+    draw_sprite((d.raw[3] >> 8) & 0xF, (d.raw[3] >> 4) & 0xF, d.raw[3] & 0xF);
     pc += 2;
+    return 4;
 }
 
-void Chip8::opD(Instr instr)
+/*
+ * FX07 3XNN 1NNN -- read the timer, leave once it reads NN. The timer only
+ * moves between frames, so if the jump goes back to the FX07 and the timer
+ * isn't there yet, the rest of the frame is spent spinning: skip straight
+ * to the end of it.
+ */
+template<typename Spec>
+uint BasicChip8<Spec>::fused_timer_wait(const Decoded &d, uint budget)
 {
-    char Ifmt[8];
-    sprintf(Ifmt, "0x%04X", I);
-    std::cerr << "Loading sprite from " << Ifmt << " with height " << (uint)instr.n << std::endl;
-    // DXYN -- Draw sprite at coordinate 
+    uint8_t x = (d.raw[0] >> 8) & 0xF;
+    uint16_t target = d.raw[2] & 0xFFF;
+    V[x] = periphs.get_timer();
+    if (V[x] == (d.raw[1] & 0xFF)) {
+        pc += 6;
+        return 2;
+    }
+    if (target == pc)
+        return budget - budget % 3;
+    pc = target;
+    return 3;
+}
+
+/*
+ * 7XNN 3XNN 1NNN -- bump a counter, leave once it hits the end value. A
+ * loop made of only these three runs in place until done or out of budget.
+ */
+template<typename Spec>
+uint BasicChip8<Spec>::fused_loop(const Decoded &d, uint budget)
+{
+    uint8_t x = (d.raw[0] >> 8) & 0xF;
+    uint8_t step = d.raw[0] & 0xFF;
+    uint8_t end = d.raw[1] & 0xFF;
+    uint16_t head = pc;
+    uint16_t target = d.raw[2] & 0xFFF;
+    uint done = 0;
+    do {
+        V[x] += step;
+        done += 2;
+        if (V[x] == end) {
+            pc = head + 6;
+            return done;
+        }
+        done += 1;
+        pc = target;
+    } while (target == head && budget - done >= 3);
+    return done;
+}
+
+// *** Op Code handlers ***
+
+/*
+ * One handler per opcode shape, with the register fields as template
+ * arguments wherever the opcode names registers: 8XY4 becomes 256 handlers,
+ * one per register pair, each adding two fixed registers. Immediates (NN,
+ * NNN, N) are still read out of raw. op_table below maps every 16 bit
+ * opcode straight to its handler, so dispatch is one load and one call.
+ */
+template<typename Spec>
+struct Ops {
+    typedef BasicChip8<Spec> M;
+
+    static void trap(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.fault(FAULT_BAD_INSTR, c.pc, "Unknown instruction!");
+    }
+
+    static void nop(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if (c.m_verbose)
+            std::fprintf(stderr, "NOP Instruction!\n");
+        c.pc += 2;
+    }
+
+    // 00E0 -- clear the screen (the selected planes)
+    static void cls(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if constexpr (Spec::EXTENDED)
+            c.m_ext.screen.clear(c.m_ext.planes);
+        else
+            c.periphs.clear_screen();
+        c.pc += 2;
+    }
+
+    // 00EE -- return from subroutine
+    static void ret(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if (c.m_sp == 0)
+            c.fault(FAULT_STACK, c.pc, "Return with no subroutine to return from!");
+        c.pc = c.m_stack[--c.m_sp] + 2;
+        if (c.m_verbose)
+            std::fprintf(stderr, "Returning from subroutine to pc 0x%04X\n", c.pc);
+    }
+
+    // The extended handlers below are in every Ops<Spec>, but only in the
+    // op tables of the specs with extended registers.
+
+    // 00CN -- scroll down N pixels, 00DN -- up N pixels (XO-CHIP). Lores
+    // scrolls move whole lores pixels
+    template<bool UP>
+    static void scroll_v(M &c, uint16_t raw)
+    {
+        if constexpr (Spec::EXTENDED) {
+            uint n = (raw & 0xF) * c.scale();
+            if (UP)
+                c.m_ext.screen.scroll_up(n, c.m_ext.planes);
+            else
+                c.m_ext.screen.scroll_down(n, c.m_ext.planes);
+        }
+        c.pc += 2;
+    }
+
+    // 00FB -- scroll right 4 pixels, 00FC -- left 4 pixels
+    template<bool LEFT>
+    static void scroll_h(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if constexpr (Spec::EXTENDED) {
+            uint n = 4 * c.scale();
+            if (LEFT)
+                c.m_ext.screen.scroll_left(n, c.m_ext.planes);
+            else
+                c.m_ext.screen.scroll_right(n, c.m_ext.planes);
+        }
+        c.pc += 2;
+    }
+
+    // 00FD -- exit the interpreter: stays on this instruction, which
+    //         spinning() then counts as a halt
+    static void exit(M &c, uint16_t raw)
+    {
+        (void)c;
+        (void)raw;
+    }
+
+    // 00FE -- lores, 64x32; 00FF -- hires, 128x64. Both clear the screen
+    static void mode(M &c, uint16_t raw)
+    {
+        if constexpr (Spec::EXTENDED) {
+            c.m_ext.hires = raw == 0x00FF;
+            c.m_ext.screen.clear(M::Display::ALL_PLANES);
+        }
+        c.pc += 2;
+    }
+
+    // 0NNN -- Call RCA 1802 program at addr NNN.
+    // Not necessary for most ROMs
+    static void sys(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if (c.m_verbose)
+            std::fprintf(stderr, "Warning: Instruction 0NNN not implemented :(\n");
+        c.pc += 2;
+    }
+
+    // 1NNN -- jmp to adr NNN
+    static void jump(M &c, uint16_t raw)
+    {
+        if (c.m_verbose)
+            std::fprintf(stderr, "Jumping to 0x%04x\n", raw & 0xFFF);
+        c.pc = raw & 0xFFF;
+    }
+
+    // 2NNN -- call subroutine at NNN
+    static void call(M &c, uint16_t raw)
+    {
+        if (c.m_sp == STACK_DEPTH)
+            c.fault(FAULT_STACK, c.pc, "Call with the subroutine stack full!");
+        c.m_stack[c.m_sp++] = c.pc;
+        c.pc = raw & 0xFFF;
+        if (c.m_verbose)
+            std::fprintf(stderr, "Calling subroutine at 0x%04X\n", c.pc);
+    }
+
+    // 3XNN -- skip next instr if VX == NN
+    template<uint8_t X>
+    static void skip_eq(M &c, uint16_t raw)
+    {
+        c.skip_if(c.V[X] == (raw & 0xFF));
+    }
+
+    // 4XNN -- skip next instr if VX != NN
+    template<uint8_t X>
+    static void skip_ne(M &c, uint16_t raw)
+    {
+        c.skip_if(c.V[X] != (raw & 0xFF));
+    }
+
+    // 5XY0 -- skip next instr if VX == VY
+    template<uint8_t X, uint8_t Y>
+    static void skip_eq_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.skip_if(c.V[X] == c.V[Y]);
+    }
+
+    // 5XY2 -- store VX to VY (either direction) in mem starting at addr I,
+    //         I unchanged (XO-CHIP)
+    // 5XY3 -- fill VX to VY (either direction) from mem starting at addr I,
+    //         I unchanged (XO-CHIP)
+    template<uint8_t X, uint8_t Y, bool STORE>
+    static void range(M &c, uint16_t raw)
+    {
+        (void)raw;
+        constexpr int dir = X <= Y ? 1 : -1;
+        constexpr uint count = (X <= Y ? Y - X : X - Y) + 1;
+        c.check_range(c.I, count, STORE ? FAULT_MEM_WRITE : FAULT_MEM_READ);
+        for (uint i = 0; i < count; i++) {
+            uint8_t r = (X + dir*(int)i) & 0xF;
+            if (STORE)
+                c.m_mem.write(c.V[r], c.I + i);
+            else
+                c.V[r] = c.m_mem.read(c.I + i);
+        }
+        if (STORE)
+            c.m_mem.redecode(c.I, count);
+        c.pc += 2;
+    }
+
+    template<uint8_t X, uint8_t Y>
+    static void store_range(M &c, uint16_t raw) { range<X, Y, true>(c, raw); }
+
+    template<uint8_t X, uint8_t Y>
+    static void load_range(M &c, uint16_t raw) { range<X, Y, false>(c, raw); }
+
+    // 6XNN -- set VX to NN
+    template<uint8_t X>
+    static void load(M &c, uint16_t raw)
+    {
+        c.V[X] = raw & 0xFF;
+        c.pc += 2;
+    }
+
+    // 7XNN -- Add NN to VX (carry flag not changed)
+    template<uint8_t X>
+    static void add(M &c, uint16_t raw)
+    {
+        c.V[X] += raw & 0xFF;
+        c.pc += 2;
+    }
+
+    // 8XY0 -- set VX = VY
+    template<uint8_t X, uint8_t Y>
+    static void mov(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.V[X] = c.V[Y];
+        c.pc += 2;
+    }
+
+    // 8XY1 -- VX = VX | VY
+    template<uint8_t X, uint8_t Y>
+    static void or_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.V[X] |= c.V[Y];
+        if (c.m_quirks & QUIRK_VF_RESET)
+            c.V[0xF] = 0;
+        c.pc += 2;
+    }
+
+    // 8XY2 -- VX = VX & VY
+    template<uint8_t X, uint8_t Y>
+    static void and_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.V[X] &= c.V[Y];
+        if (c.m_quirks & QUIRK_VF_RESET)
+            c.V[0xF] = 0;
+        c.pc += 2;
+    }
+
+    // 8XY3 -- VX = VX ^ VY
+    template<uint8_t X, uint8_t Y>
+    static void xor_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.V[X] ^= c.V[Y];
+        if (c.m_quirks & QUIRK_VF_RESET)
+            c.V[0xF] = 0;
+        c.pc += 2;
+    }
+
+    // The flag goes in last in 8XY4-8XYE, so with VF as an operand or as
+    // VX the flag wins.
+
+    // 8XY4 -- VX = VX + VY (VF set to 1 if carry out, 0 if not)
+    template<uint8_t X, uint8_t Y>
+    static void add_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint16_t res = c.V[X] + c.V[Y];
+        c.V[X] = res & 0xFF;
+        c.V[0xF] = (res >> 8) & 0x1;
+        c.pc += 2;
+    }
+
+    // 8XY5 -- VX = VX - VY (VF set to 0 if borrow, 1 if not)
+    template<uint8_t X, uint8_t Y>
+    static void sub_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint8_t flag = c.V[X] < c.V[Y] ? 0 : 1;
+        c.V[X] -= c.V[Y];
+        c.V[0xF] = flag;
+        c.pc += 2;
+    }
+
+    // 8XY6 -- VX = VX >> 1 (Store least sig bit of VX in VF)
+    template<uint8_t X, uint8_t Y>
+    static void shr(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint8_t src = (c.m_quirks & QUIRK_SHIFT_VY) ? c.V[Y] : c.V[X];
+        c.V[X] = src >> 1;
+        c.V[0xF] = src & 0x1;
+        c.pc += 2;
+    }
+
+    // 8XY7 -- VX = VY - VX (VF set to 0 if borrow, 1 if not)
+    template<uint8_t X, uint8_t Y>
+    static void subn_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint8_t flag = c.V[Y] < c.V[X] ? 0 : 1;
+        c.V[X] = c.V[Y] - c.V[X];
+        c.V[0xF] = flag;
+        c.pc += 2;
+    }
+
+    // 8XYE -- VX = VX << 1 (Store most sig bit of VX in VF)
+    template<uint8_t X, uint8_t Y>
+    static void shl(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint8_t src = (c.m_quirks & QUIRK_SHIFT_VY) ? c.V[Y] : c.V[X];
+        c.V[X] = src << 1;
+        c.V[0xF] = src >> 7;
+        c.pc += 2;
+    }
+
+    // 9XY0 -- skip next isntr if VX != VY
+    template<uint8_t X, uint8_t Y>
+    static void skip_ne_reg(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.skip_if(c.V[X] != c.V[Y]);
+    }
+
+    // ANNN -- set I to addr NNN
+    static void load_i(M &c, uint16_t raw)
+    {
+        c.I = raw & 0xFFF;
+        c.pc += 2;
+    }
+
+    // BNNN -- Jmp to addr NNN + V0
+    // (BXNN -- Jmp to addr XNN + VX with QUIRK_JUMP_VX)
+    template<uint8_t X>
+    static void jump_v(M &c, uint16_t raw)
+    {
+        c.pc = (raw & 0xFFF) + c.V[(c.m_quirks & QUIRK_JUMP_VX) ? X : 0];
+    }
+
+    // CXNN -- VX = rand() & NN
+    template<uint8_t X>
+    static void rand(M &c, uint16_t raw)
+    {
+        c.V[X] = c.next_rand() & (raw & 0xFF);
+        c.pc += 2;
+    }
+
+    // DXYN -- Draw sprite at coordinate
     // (VX,VY) with width 8 pixels and height N pixels, with
     // sprite loaded at adrr I
     // set VF to 1 if any pixels unset, 00 otherwise
-    uint8_t y = V[instr.vy];
-    bool collision = false;
-    for (int i = 0; i < instr.n; i++) {
-        uint8_t row = m_mem.read(I+i);
-        uint8_t x = V[instr.vx];
-        for (int pix = 0; pix < 8; pix++) {
-            // std::cerr << "Pix = " << pix << std::endl;
-            uint8_t pixval = (row >> (7-pix)) & 0x1;
-            bool bres = periphs.place_pixel(x, y, pixval);
-            collision = collision || bres;
-            x++;
+    template<uint8_t X, uint8_t Y>
+    static void draw(M &c, uint16_t raw)
+    {
+        if (c.m_verbose)
+            std::fprintf(stderr, "Loading sprite from 0x%04X with height %u\n", c.I, raw & 0xF);
+        c.draw_sprite(X, Y, raw & 0xF);
+        c.pc += 2;
+    }
+
+    // EX9E -- Skip next instr if key stored in VX is pressed
+    template<uint8_t X>
+    static void skip_key(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.skip_if(c.periphs.key_pressed(c.V[X]));
+    }
+
+    // EXA1 -- Skip next instr if key stored in VX isn't pressed
+    template<uint8_t X>
+    static void skip_no_key(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.skip_if(!c.periphs.key_pressed(c.V[X]));
+    }
+
+    // FX07 -- Set VX to the value of the delay timer.
+    template<uint8_t X>
+    static void get_timer(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.V[X] = c.periphs.get_timer();
+        c.pc += 2;
+    }
+
+    // FX0A -- Key press is awaited, then stored in VX
+    template<uint8_t X>
+    static void wait_key(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if (!c.m_key_wait) {
+            if (c.m_verbose)
+                std::fprintf(stderr, "Waiting for keypress...\n");
+            c.periphs.begin_key_wait();
+            c.m_key_wait = true;
         }
-        y++;
+        uint8_t key = c.periphs.await_keypress();
+        // nothing held yet, run this instr again next step
+        if (key == NO_KEY)
+            return;
+        c.m_key_wait = false;
+        c.V[X] = key;
+        c.pc += 2;
     }
-    V[0xF] = collision ? 1 : 0;
 
-    pc += 2;
+    // FX15 -- Sets the delay timer to VX
+    template<uint8_t X>
+    static void set_timer(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.periphs.set_timer(c.V[X]);
+        c.pc += 2;
+    }
+
+    // FX18 -- Sets the sound timer to VX. There is no sound; only the
+    //         extended machines keep the timer
+    template<uint8_t X>
+    static void set_sound(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if constexpr (Spec::EXTENDED)
+            c.m_ext.sound = c.V[X];
+        else if (c.m_verbose)
+            std::fprintf(stderr, "Warning: No sound timer!\n");
+        c.pc += 2;
+    }
+
+    // FX1E -- Adds VX to I, wrapping at the end of memory. VF is set to 1 when
+    //         I passes the end, and 0 otherwise (left alone with QUIRK_KEEP_VF)
+    template<uint8_t X>
+    static void add_i(M &c, uint16_t raw)
+    {
+        (void)raw;
+        uint32_t res = c.I + c.V[X];
+        c.I = res & (Spec::MEM_BYTES - 1);
+        if (!(c.m_quirks & QUIRK_KEEP_VF))
+            c.V[0xF] = res >= Spec::MEM_BYTES ? 1 : 0;
+        c.pc += 2;
+    }
+
+    // FX29 -- Sets I to the location of the sprite for the character in the low
+    //         nibble of VX. Characters 0-F are represented by a 4x5 font
+    template<uint8_t X>
+    static void font(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.I = (c.V[X] & 0xF) * 5;
+        c.pc += 2;
+    }
+
+    // FX30 -- Sets I to the big (8x10) font character in the low nibble of VX
+    template<uint8_t X>
+    static void big_font(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.I = BIG_FONT_ADDR + (c.V[X] & 0xF) * 10;
+        c.pc += 2;
+    }
+
+    // FX33 -- take the decimal representation of VX, place the hundreds digit in memory
+    //         at location in I, the tens digit at location I+1, and the ones digit at
+    //         location I+2
+    template<uint8_t X>
+    static void bcd(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.check_range(c.I, 3, FAULT_MEM_WRITE);
+        uint8_t hunds = c.V[X] / 100;
+        uint8_t tens = (c.V[X] % 100) / 10;
+        uint8_t ones = (c.V[X] % 100) % 10;
+        c.m_mem.write(hunds, c.I);
+        c.m_mem.write(tens, c.I+1);
+        c.m_mem.write(ones, c.I+2);
+        c.m_mem.redecode(c.I, 3);
+        c.pc += 2;
+    }
+
+    // FX55 -- Store V0 to VX (inclusive) in mem starting at addr I.
+    template<uint8_t X>
+    static void store(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.check_range(c.I, X + 1, FAULT_MEM_WRITE);
+        for (int i = 0; i <= X; i++) {
+            c.m_mem.write(c.V[i], c.I+i);
+        }
+        c.m_mem.redecode(c.I, X + 1);
+        if (!(c.m_quirks & QUIRK_KEEP_I))
+            c.I = c.I + X + 1;
+        c.pc += 2;
+    }
+
+    // FX65 -- Fill V0 to VX (inclusive) in mem starting at addr I.
+    template<uint8_t X>
+    static void fill(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.check_range(c.I, X + 1, FAULT_MEM_READ);
+        for (int i = 0; i <= X; i++) {
+            c.V[i] = c.m_mem.read(c.I+i);
+        }
+        if (!(c.m_quirks & QUIRK_KEEP_I))
+            c.I = c.I + X + 1;
+        c.pc += 2;
+    }
+
+    // FX75 -- store V0 to VX (inclusive) in the flag registers
+    template<uint8_t X>
+    static void save_flags(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if constexpr (Spec::EXTENDED)
+            std::copy(c.V, c.V + X + 1, c.m_ext.flags);
+        c.pc += 2;
+    }
+
+    // FX85 -- fill V0 to VX (inclusive) from the flag registers
+    template<uint8_t X>
+    static void load_flags(M &c, uint16_t raw)
+    {
+        (void)raw;
+        if constexpr (Spec::EXTENDED)
+            std::copy(c.m_ext.flags, c.m_ext.flags + X + 1, c.V);
+        c.pc += 2;
+    }
+
+    // F000 NNNN -- set I to the 16 bit address NNNN, a 4 byte instruction (XO-CHIP)
+    static void long_i(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.I = (c.m_mem.read(c.pc + 2) << 8) | c.m_mem.read(c.pc + 3);
+        c.pc += 4;
+    }
+
+    // FN01 -- select the planes in N for drawing, clearing and scrolling (XO-CHIP)
+    static void planes(M &c, uint16_t raw)
+    {
+        if constexpr (Spec::EXTENDED)
+            c.m_ext.planes = (raw >> 8) & M::Display::ALL_PLANES;
+        c.pc += 2;
+    }
+
+    // F002 -- load the audio pattern from I, FX3A -- set the audio pitch to VX
+    //         (XO-CHIP). There is no sound, so both are skipped
+    static void audio(M &c, uint16_t raw)
+    {
+        (void)raw;
+        c.pc += 2;
+    }
+};
+
+template<typename Spec>
+using OpHandler = void (*)(BasicChip8<Spec> &c, uint16_t raw);
+
+// pick.operator()<I>() for each I in the sequence, i.e. one handler
+// instantiation per register (or register pair, I = X << 4 | Y)
+template<typename Spec, typename Pick, size_t... I>
+static constexpr std::array<OpHandler<Spec>, sizeof...(I)> expand(Pick pick, std::index_sequence<I...>)
+{
+    return {pick.template operator()<I>()...};
 }
 
-void Chip8::opE(Instr instr)
+#define BY_X(f) expand<Spec>([]<size_t X>() { return &O::template f<X>; }, \
+                             std::make_index_sequence<16>())
+#define BY_XY(f) expand<Spec>([]<size_t XY>() { return &O::template f<(XY >> 4), (XY & 0xF)>; }, \
+                              std::make_index_sequence<256>())
+
+template<typename Spec>
+static constexpr std::array<OpHandler<Spec>, 0x10000> make_op_table()
 {
-    uint8_t key;
-    switch (instr.raw & 0xFF) {
-    case 0x9E:
-        // EX9E -- Skip next instr if key stored in VX is pressed
-        key = periphs.get_keystate();
-        pc += key == V[instr.vx] ? 4 : 2;
-        break;
-    case 0xA1:
-        // EXA1 -- Skip next instr if key stored in VX isn't pressed
-        key = periphs.get_keystate();
-        pc += key == V[instr.vx] ? 2 : 4;
-        break;
-    default:
-        std::cerr << "Error (opE): Unknown instruction!\n";
-        std::exit(1);
+    typedef Ops<Spec> O;
+    constexpr auto skip_eq = BY_X(skip_eq), skip_ne = BY_X(skip_ne), load = BY_X(load),
+        add = BY_X(add), jump_v = BY_X(jump_v), rand = BY_X(rand), skip_key = BY_X(skip_key),
+        skip_no_key = BY_X(skip_no_key), get_timer = BY_X(get_timer), wait_key = BY_X(wait_key),
+        set_timer = BY_X(set_timer), set_sound = BY_X(set_sound), add_i = BY_X(add_i),
+        font = BY_X(font), big_font = BY_X(big_font), bcd = BY_X(bcd), store = BY_X(store),
+        fill = BY_X(fill), save_flags = BY_X(save_flags), load_flags = BY_X(load_flags);
+    constexpr auto skip_eq_reg = BY_XY(skip_eq_reg), skip_ne_reg = BY_XY(skip_ne_reg),
+        draw = BY_XY(draw), store_range = BY_XY(store_range), load_range = BY_XY(load_range);
+    // 8XYN by N, empty where there is no such N
+    constexpr std::array<std::array<OpHandler<Spec>, 256>, 16> alu = {
+        BY_XY(mov), BY_XY(or_reg), BY_XY(and_reg), BY_XY(xor_reg),
+        BY_XY(add_reg), BY_XY(sub_reg), BY_XY(shr), BY_XY(subn_reg),
+        {}, {}, {}, {}, {}, {}, BY_XY(shl), {},
+    };
+
+    // CHIP-8 takes any N in 5XYN and 9XYN, the extended machines only 0
+    // (and XO-CHIP's 5XY2 and 5XY3)
+    constexpr bool ext = Spec::EXTENDED, xo = Spec::XO;
+    std::array<OpHandler<Spec>, 0x10000> t{};
+    for (uint32_t raw = 0; raw < 0x10000; raw++) {
+        uint8_t x = (raw >> 8) & 0xF;
+        uint8_t xy = (raw >> 4) & 0xFF;
+        uint8_t n = raw & 0xF;
+        uint8_t nn = raw & 0xFF;
+        OpHandler<Spec> h = &O::trap;
+        switch (raw >> 12) {
+        case 0x0:
+            if (raw == 0x0000)
+                h = &O::nop;
+            else if (raw == 0x00E0)
+                h = &O::cls;
+            else if (raw == 0x00EE)
+                h = &O::ret;
+            else if (ext && (raw & 0xFFF0) == 0x00C0)
+                h = &O::template scroll_v<false>;
+            else if (xo && (raw & 0xFFF0) == 0x00D0)
+                h = &O::template scroll_v<true>;
+            else if (ext && raw == 0x00FB)
+                h = &O::template scroll_h<false>;
+            else if (ext && raw == 0x00FC)
+                h = &O::template scroll_h<true>;
+            else if (ext && raw == 0x00FD)
+                h = &O::exit;
+            else if (ext && (raw == 0x00FE || raw == 0x00FF))
+                h = &O::mode;
+            else
+                h = &O::sys;
+            break;
+        case 0x1: h = &O::jump; break;
+        case 0x2: h = &O::call; break;
+        case 0x3: h = skip_eq[x]; break;
+        case 0x4: h = skip_ne[x]; break;
+        case 0x5:
+            if (!ext || n == 0)
+                h = skip_eq_reg[xy];
+            else if (xo && n == 2)
+                h = store_range[xy];
+            else if (xo && n == 3)
+                h = load_range[xy];
+            break;
+        case 0x6: h = load[x]; break;
+        case 0x7: h = add[x]; break;
+        case 0x8:
+            if (alu[n][xy] != nullptr)
+                h = alu[n][xy];
+            break;
+        case 0x9:
+            if (!ext || n == 0)
+                h = skip_ne_reg[xy];
+            break;
+        case 0xA: h = &O::load_i; break;
+        case 0xB: h = jump_v[x]; break;
+        case 0xC: h = rand[x]; break;
+        case 0xD: h = draw[xy]; break;
+        case 0xE:
+            if (nn == 0x9E)
+                h = skip_key[x];
+            else if (nn == 0xA1)
+                h = skip_no_key[x];
+            break;
+        case 0xF:
+            if (xo && raw == 0xF000) {
+                h = &O::long_i;
+                break;
+            }
+            switch (nn) {
+            case 0x01: h = xo ? &O::planes : h; break;
+            case 0x02: h = xo ? &O::audio : h; break;
+            case 0x07: h = get_timer[x]; break;
+            case 0x0A: h = wait_key[x]; break;
+            case 0x15: h = set_timer[x]; break;
+            case 0x18: h = set_sound[x]; break;
+            case 0x1E: h = add_i[x]; break;
+            case 0x29: h = font[x]; break;
+            case 0x30: h = ext ? big_font[x] : h; break;
+            case 0x33: h = bcd[x]; break;
+            case 0x3A: h = xo ? &O::audio : h; break;
+            case 0x55: h = store[x]; break;
+            case 0x65: h = fill[x]; break;
+            case 0x75: h = ext ? save_flags[x] : h; break;
+            case 0x85: h = ext ? load_flags[x] : h; break;
+            }
+            break;
+        }
+        t[raw] = h;
     }
+    return t;
 }
 
-void Chip8::opF(Instr instr)
+#undef BY_X
+#undef BY_XY
+
+// every opcode to its handler, 512KB a machine, built by the compiler
+template<typename Spec>
+static constexpr std::array<OpHandler<Spec>, 0x10000> op_table = make_op_table<Spec>();
+
+template<typename Spec>
+void BasicChip8<Spec>::dispatch(uint16_t raw_instr)
 {
-    uint16_t res;
-    switch (instr.raw & 0xFF) {
-    case 0x07:
-        // FX07 -- Set VX to the value of the delay timer.
-        V[instr.vx] = periphs.get_timer();
-        break;
-    case 0x0A:
-        // FX0A -- Key press is awaited, then stored in VX
-        std::cerr << "Waiting for keypress...\n";
-        V[instr.vx] = periphs.await_keypress();
-        break;
-    case 0x15:
-        // FX15 -- Sets the delay timer to VX
-        periphs.set_timer(V[instr.vx]);
-        break;
-    case 0x18:
-        // FX18 -- Sets the sound timer to VX
-        std::cerr << "Warning: No sound timer!\n";
-        break;
-    case 0x1E:
-        // FX1E -- Adds VX to I. VF is set to 1 when there is a range overflow (I+VX > 0xFFF),
-        //         and 0 otherwise
-        res = V[instr.vx] + I;
-        V[0xF] = res > 0xFFF ? 1 : 0;
-        I = res & 0xFFF;
-        break;
-    case 0x29:
-        // FX29 -- Sets I to the location of the sprite for the character in VX. Characters
-        //         0-F are represented by a 4x5 font
-        I = V[instr.vx] * 5;
-        break;
-    case 0x33:
-        // FX33 -- take the decimal representation of VX, place the hundreds digit in memory
-        //         at location in I, the tens digit at location I+1, and the ones digit at 
-        //         location I+2
-        {
-            uint8_t hunds = V[instr.vx] / 100;
-            uint8_t tens = (V[instr.vx] % 100) / 10;
-            uint8_t ones = (V[instr.vx] % 100) % 10;
-            m_mem.write(hunds, I);
-            m_mem.write(tens, I+1);
-            m_mem.write(ones, I+2);
-        }
-        break;
-    case 0x55:
-        // FX55 -- Store V0 to VX (inclusive) in mem starting at addr I.
-        for (int i = 0; i <= instr.vx; i++) {
-            m_mem.write(V[i], I+i);
+    if (m_verbose && raw_instr != 0x0)
+        log_instr(raw_instr);
+    op_table<Spec>[raw_instr](*this, raw_instr);
+}
+
+/*
+ * Skip the next instruction if cond, which on XO-CHIP may be the 4 byte
+ * F000 NNNN.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::skip_if(bool cond)
+{
+    pc += 2;
+    if (!cond)
+        return;
+    if constexpr (Spec::XO) {
+        if (m_mem.read(pc) == 0xF0 && m_mem.read(pc + 1) == 0x00)
+            pc += 2;
+    }
+    pc += 2;
+}
+
+/*
+ * Throw a Fault for the instruction at pc, with its opcode when pc is in
+ * program memory.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::fault(FaultType type, uint16_t addr, const char *msg)
+{
+    uint16_t opcode = 0;
+    if ((uint32_t)pc + 1 < m_mem.size() && pc >= 0x200)
+        opcode = (((uint16_t)m_mem.read(pc)) << 8) | m_mem.read(pc+1);
+    throw Fault(type, addr, msg, pc, opcode);
+}
+
+/*
+ * Strict mode: the instruction at pc reaches past the end of memory from
+ * addr. The fault's address is the first byte outside.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::range_fault(uint16_t addr, FaultType type)
+{
+    // XO-CHIP's 64KB end at 0x10000, which wraps to 0x0000
+    uint16_t bad = addr < Spec::MEM_BYTES ? (uint16_t)Spec::MEM_BYTES : addr;
+    fault(type, bad, type == FAULT_MEM_WRITE ? "Attempt to write outside of addr range!"
+                                             : "Attempt to access outside of addr range!");
+}
+
+/*
+ * DXYN with N rows of 8, or on the extended machines DXY0 with 16 rows of
+ * 16. With more than one plane selected, each plane takes the next
+ * sprite's worth of bytes from I, plane 0 first. VF is 1 if any lit pixel
+ * went dark.
+ */
+template<typename Spec>
+void BasicChip8<Spec>::draw_sprite(uint8_t vx, uint8_t vy, uint8_t n)
+{
+    // sprites start on screen, the part past an edge wraps or is clipped
+    bool wrap = !(m_quirks & QUIRK_CLIP);
+    uint w = Spec::WIDTH / scale();
+    uint h = Spec::HEIGHT / scale();
+    bool wide = Spec::EXTENDED && n == 0;
+    uint rows = wide ? 16 : n;
+    uint width = wide ? 16 : 8;
+    uint bytes = wide ? 2*rows : rows;
+    uint8_t planes = 1;
+    if constexpr (Spec::EXTENDED)
+        planes = m_ext.planes;
+    check_range(I, bytes * std::popcount(planes), FAULT_MEM_READ);
+    uint x0 = V[vx] % w;
+    uint y0 = V[vy] % h;
+    m_sprites++;
+    if (x0 + width > w || y0 + rows > h)
+        m_offscreen++;
+    bool collision = false;
+    uint16_t addr = I;
+    for (uint p = 0; p < Spec::PLANES; p++) {
+        uint8_t plane = 1 << p;
+        if (!(planes & plane))
+            continue;
+        for (uint r = 0; r < rows; r++) {
+            uint y = y0 + r;
+            if (!wrap && y >= h)
+                break;
+            uint16_t bits = m_mem.read(addr + (wide ? 2*r : r)) << 8;
+            if (wide)
+                bits |= m_mem.read(addr + 2*r + 1);
+            collision = draw_row(x0, y % h, bits, width, plane, wrap) || collision;
         }
-        I = I + instr.vx + 1;
-        break;
-    case 0x65:
-        // FX65 -- Fill V0 to VX (inclusive) in mem starting at addr I.    
-        for (int i = 0; i <= instr.vx; i++) {
-            V[i] = m_mem.read(I+i);
+        // clipped rows still take their bytes
+        addr += bytes;
+    }
+    V[0xF] = collision ? 1 : 0;
+}
+
+/*
+ * One sprite row, the top width bits of bits, at (x, y) in sprite pixels.
+ */
+template<typename Spec>
+bool BasicChip8<Spec>::draw_row(uint x, uint y, uint16_t bits, uint width, uint8_t plane, bool wrap)
+{
+    if constexpr (Spec::EXTENDED) {
+        return m_ext.screen.draw_row(x, y, bits, width, plane, scale(), wrap);
+    } else {
+        (void)plane;
+        bool collision = false;
+        for (uint pix = 0; pix < width; pix++) {
+            if (!wrap && x + pix >= FRAME_WIDTH)
+                break;
+            uint8_t pixval = (bits >> (15-pix)) & 0x1;
+            collision = periphs.place_pixel(x + pix, y, pixval) || collision;
         }
-        I = I + instr.vx + 1;
-        break;
-    default:
-        std::cerr << "Error (opF): unknown instruction!\n";
-        std::exit(1);
+        return collision;
     }
-    pc += 2;
 }
 
-void Chip8::dump()
+template<typename Spec>
+void BasicChip8<Spec>::dump()
 {
     m_mem.dump();
 
@@ -476,4 +1913,8 @@ void Chip8::dump()
     }
 
     ofile.close();
-}
\ No newline at end of file
+}
+
+template class BasicChip8<Chip8Spec>;
+template class BasicChip8<SchipSpec>;
+template class BasicChip8<XoChipSpec>;
@@ -0,0 +1,108 @@
+/*
+ * coop.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Cooperative scheduler, thousands of machines on one thread as coroutines.
+ */
+
+#include <coop.h>
+
+Scheduler::~Scheduler()
+{
+    for (Machine &m : m_machines) {
+        m.task.handle.destroy();
+    }
+}
+
+size_t Scheduler::add(Chip8 &chip8)
+{
+    size_t id = m_machines.size();
+    m_machines.emplace_back();
+    Machine &m = m_machines.back();
+    m.chip8 = &chip8;
+    m.synced = m_now;
+    m.task = machine(id);
+    m_timed.push(Wake(m_now, id));
+    return id;
+}
+
+/*
+ * The coroutine for one machine: a frame, then park until there is
+ * something to do.
+ */
+Scheduler::Task Scheduler::machine(size_t id)
+{
+    while (true) {
+        // m_machines can grow while we are parked, look it up again
+        Machine &m = m_machines[id];
+        Chip8 &chip8 = *m.chip8;
+        chip8.skip_frames(m_now - m.synced);
+        Chip8::Yield why = chip8.run_frame_coop(m.keys);
+        m.synced = m_now + 1;
+
+        uint64_t wake = m_now + 1;
+        if (why == Chip8::YIELD_KEY_WAIT) {
+            wake = PARK_KEYS;
+        } else if (why == Chip8::YIELD_IDLE) {
+            uint32_t idle = chip8.idle_frames();
+            wake = idle == IDLE_FOREVER ? PARK_FOREVER : m.synced + idle;
+        }
+        co_await Park{*this, id, wake};
+    }
+}
+
+void Scheduler::park(size_t id, uint64_t wake)
+{
+    if (wake == PARK_KEYS)
+        m_key_waits.push_back(id);
+    else if (wake != PARK_FOREVER)
+        m_timed.push(Wake(wake, id));
+}
+
+const std::vector<size_t> &Scheduler::run_frame()
+{
+    m_ready.clear();
+    m_ran.clear();
+    while (!m_timed.empty() && m_timed.top().first <= m_now) {
+        m_ready.push_back(m_timed.top().second);
+        m_timed.pop();
+    }
+    for (size_t i = 0; i < m_key_waits.size();) {
+        size_t id = m_key_waits[i];
+        if (m_machines[id].keys == 0) {
+            i++;
+            continue;
+        }
+        m_ready.push_back(id);
+        m_key_waits[i] = m_key_waits.back();
+        m_key_waits.pop_back();
+    }
+
+    for (size_t id : m_ready) {
+        auto handle = m_machines[id].task.handle;
+        handle.resume();
+        // only a fault gets out of the loop
+        if (handle.done())
+            m_machines[id].faulted = true;
+        m_ran.push_back(id);
+    }
+    m_now++;
+    return m_ran;
+}
+
+std::exception_ptr Scheduler::fault(size_t id) const
+{
+    return m_machines[id].task.handle.promise().error;
+}
+
+Chip8 &Scheduler::sync(size_t id)
+{
+    Machine &m = m_machines[id];
+    if (!m.faulted && m.synced < m_now) {
+        m.chip8->skip_frames(m_now - m.synced);
+        m.synced = m_now;
+    }
+    return *m.chip8;
+}
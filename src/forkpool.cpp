@@ -0,0 +1,47 @@
+/*
+ * forkpool.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Preallocated machines to fork game states into.
+ */
+
+#include <forkpool.h>
+
+ForkPool::ForkPool(size_t slots)
+{
+    m_slots.reserve(slots);
+    m_free.reserve(slots);
+    for (size_t i = 0; i < slots; i++) {
+        m_slots.emplace_back(new Chip8(nullptr, 0, true));
+        m_slots.back()->set_verbose(false);
+    }
+    // hand out slot 0 first
+    for (size_t i = slots; i > 0; i--) {
+        m_free.push_back(i - 1);
+    }
+}
+
+/*
+ * Clone parent, which can itself be a slot, into a free slot. Returns the
+ * slot or FORK_NONE if there is none free.
+ */
+int ForkPool::fork(Chip8 &parent)
+{
+    if (m_free.empty())
+        return FORK_NONE;
+    int slot = m_free.back();
+    m_free.pop_back();
+    parent.fork(*m_slots[slot]);
+    return slot;
+}
+
+/*
+ * The slot's machine is left as it was, so its pages stay shared until
+ * it is forked into again.
+ */
+void ForkPool::release(int slot)
+{
+    m_free.push_back(slot);
+}
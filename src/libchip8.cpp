@@ -0,0 +1,146 @@
+/*
+ * libchip8.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * C interface around the chip8 core for embedding in other programs.
+ */
+
+#include <chip8.h>
+#include <libchip8.h>
+
+struct chip8 {
+    Chip8 core;
+    bool faulted;
+    chip8_fault_t fault;
+
+    chip8() : core(nullptr, 0, true), faulted(false) {}
+};
+
+/*
+ * Nothing may unwind into C callers: every entry point that can get an
+ * exception out of the core (a Fault, or std::bad_alloc) catches it and
+ * returns NULL or -1 instead.
+ */
+chip8_t *chip8_create(uint32_t ipf)
+{
+    try {
+        chip8_t *c = new chip8();
+        c->core.set_ipf(ipf);
+        return c;
+    } catch (...) {
+        return NULL;
+    }
+}
+
+void chip8_destroy(chip8_t *c)
+{
+    delete c;
+}
+
+int chip8_load_rom(chip8_t *c, const uint8_t *rom, size_t len)
+{
+    try {
+        if (!c->core.load_rom(rom, len))
+            return -1;
+    } catch (...) {
+        return -1;
+    }
+    c->faulted = false;
+    return 0;
+}
+
+int chip8_reset(chip8_t *c)
+{
+    try {
+        c->core.reset();
+    } catch (...) {
+        return -1;
+    }
+    c->faulted = false;
+    return 0;
+}
+
+void chip8_set_seed(chip8_t *c, uint32_t seed)
+{
+    c->core.set_seed(seed);
+}
+
+int chip8_fork(chip8_t *parent, chip8_t *child)
+{
+    try {
+        parent->core.fork(child->core);
+    } catch (...) {
+        return -1;
+    }
+    child->faulted = parent->faulted;
+    child->fault = parent->fault;
+    return 0;
+}
+
+int chip8_run_frames(chip8_t *c, uint32_t n, const uint16_t *keys)
+{
+    if (c->faulted)
+        return -1;
+    try {
+        for (uint32_t i = 0; i < n; i++) {
+            c->core.run_frame(keys ? keys[i] : 0);
+        }
+    } catch (const Fault &f) {
+        c->faulted = true;
+        c->fault.type = f.type;
+        c->fault.addr = f.addr;
+        c->fault.pc = f.pc;
+        c->fault.opcode = f.opcode;
+        return -1;
+    } catch (...) {
+        // out of memory mid frame, the machine is no good either way
+        c->faulted = true;
+        c->fault.type = CHIP8_FAULT_HOST;
+        c->fault.addr = 0;
+        c->fault.pc = *c->core.prog_counter();
+        c->fault.opcode = 0;
+        return -1;
+    }
+    return 0;
+}
+
+size_t chip8_run_frames_batch(chip8_t *const *cs, size_t count, uint32_t n,
+                              const uint16_t *keys)
+{
+    size_t faulted = 0;
+    for (size_t m = 0; m < count; m++) {
+        if (chip8_run_frames(cs[m], n, keys ? &keys[m*n] : nullptr) != 0)
+            faulted++;
+    }
+    return faulted;
+}
+
+int chip8_faulted(chip8_t *c)
+{
+    return c->faulted ? 1 : 0;
+}
+
+int chip8_get_fault(chip8_t *c, chip8_fault_t *f)
+{
+    if (!c->faulted)
+        return -1;
+    *f = c->fault;
+    return 0;
+}
+
+void chip8_set_strict(chip8_t *c, int strict)
+{
+    c->core.set_strict(strict != 0);
+}
+
+void chip8_get_view(chip8_t *c, chip8_view_t *view)
+{
+    Periphs &p = c->core.peripherals();
+    view->V = c->core.regs();
+    view->I = c->core.index_reg();
+    view->pc = c->core.prog_counter();
+    view->delay_timer = p.delay_timer();
+    view->framebuf = p.framebuf();
+}
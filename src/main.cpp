@@ -11,38 +11,158 @@
 #include <fstream>
 #include <mem.h>
 #include <chip8.h>
+#include <romdb.h>
+#include <calibrate.h>
 #include <periphs.h>
+#include <sdl_frontend.h>
+#include <sdl_mosaic.h>
+#include <coop.h>
+#include <term_frontend.h>
+#include <xochip.h>
+#include <memory>
 #include <csignal>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <getopt.h>
 
 #define MAX_CLOCK_SPEED 10
 #define DEFAULT_CLOCK_SPEED 3
 #define MAX_PIXEL_SCALE 32
 #define DEFAULT_PIXEL_SCALE 16
+#define MAX_RUN_AHEAD 8
+#define DEFAULT_FF_SPEED 0 // as fast as the host goes
+#define MAX_HEADLESS_MOSAIC 65536
+
+// long only options
+enum {
+    OPT_HUD = 256,
+    OPT_STATS,
+    OPT_STATS_FD,
+    OPT_FRAMES,
+    OPT_TRACE,
+    OPT_RUN_AHEAD,
+    OPT_ROM_DB,
+    OPT_FILTER,
+    OPT_MOSAIC,
+    OPT_PERF,
+    OPT_QUIRKS,
+    OPT_KEYMAP,
+    OPT_PALETTE,
+    OPT_SAVE_ROM_DB,
+    OPT_CALIBRATE,
+    OPT_FAST_FORWARD,
+    OPT_MAX_INSTRS,
+    OPT_UNTIL_PC,
+    OPT_UNTIL_HASH,
+    OPT_UNTIL_HALT,
+    OPT_TIMEOUT,
+    OPT_SHM,
+    OPT_MODE,
+    OPT_STRICT,
+    OPT_STREAM,
+};
+
+// how one rom runs, from the command line, whatever the machine
+struct RunOptions {
+    bool step = false;
+    bool headless = false;
+    Chip8::RunLimits limits;    // for --headless
+    bool quiet = false;
+    bool strict = false;
+    bool hud = false;
+    bool stats_line = false;
+    int stats_fd = -1;
+    const char *trace_path = NULL;
+    const char *shm_name = NULL;
+    const char *stream_addr = NULL;
+    uint run_ahead = 0;
+    bool fast_forward = false;
+    uint ff_speed = DEFAULT_FF_SPEED;
+    bool perf = false;
+    bool save_rom_db = false;
+};
 
 static void sighandler(int sig);
+template<typename Machine>
 static void exithandler(int rc, void *arg);
 static void print_usage();
+template<typename Machine>
+static int run_rom(const char *filename, Frontend *frontend, bool max_clock, RomDb &db,
+                   const std::string &db_path, const RomDbEntry &given, bool quirks_given,
+                   const RunOptions &opts);
+template<typename Machine>
+static int run_headless(Machine &chip8, const Chip8::RunLimits &limits);
+static RomDbEntry rom_settings(const RomDb &db, uint64_t hash, const RomDbEntry &given,
+                               bool quirks_given);
+static std::string rom_name(const std::string &path);
+template<typename Machine>
+static void apply_settings(Machine &chip8, Frontend *frontend, const RomDbEntry &settings);
+static int calibrate(const char *filename, RomDb &db, const std::string &db_path,
+                     const RomDbEntry &given, bool quirks_given);
+static int run_mosaic(uint count, char **roms, int nroms, uint clock_speed, bool max_clock,
+                      const RomDb &db, const RomDbEntry &given, bool quirks_given,
+                      bool headless, unsigned long frames);
 
 int main(int argc, char **argv)
 {
     // *** start handle args ***
-    bool step = false;
+    RunOptions opts;
     uint clock_speed = DEFAULT_CLOCK_SPEED;
+    bool clock_given = false;
     uint pixel_scale = DEFAULT_PIXEL_SCALE;
+    ScaleFilter filter = FILTER_NEAREST;
     bool max_clock = false;
+    bool term = false;
+    unsigned long frames = 0;
+    std::string mode = "chip8";
+    uint mosaic = 0;
+    std::string rom_db = RomDb::default_path();
+    RomDbEntry given;       // settings from the command line, over the database
+    bool quirks_given = false;
+    bool calibrate_ipf = false;
     char *filename = NULL;
-    const char* const short_opts = "sc:p:mh";
+    const char* const short_opts = "sc:p:mtHqh";
     const option long_opts[] = {
         {"step", no_argument, nullptr, 's'},
-        {"clock-speed", no_argument, nullptr, 'c'},
+        {"clock-speed", required_argument, nullptr, 'c'},
         {"pixel-scale", required_argument, nullptr, 'p'},
         {"help", no_argument, nullptr, 'h'},
-        {"max-clock", no_argument, nullptr, 'm'}
+        {"max-clock", no_argument, nullptr, 'm'},
+        {"term", no_argument, nullptr, 't'},
+        {"headless", no_argument, nullptr, 'H'},
+        {"frames", required_argument, nullptr, OPT_FRAMES},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"hud", no_argument, nullptr, OPT_HUD},
+        {"stats", no_argument, nullptr, OPT_STATS},
+        {"stats-fd", required_argument, nullptr, OPT_STATS_FD},
+        {"trace", required_argument, nullptr, OPT_TRACE},
+        {"run-ahead", required_argument, nullptr, OPT_RUN_AHEAD},
+        {"rom-db", required_argument, nullptr, OPT_ROM_DB},
+        {"filter", required_argument, nullptr, OPT_FILTER},
+        {"mosaic", required_argument, nullptr, OPT_MOSAIC},
+        {"perf", no_argument, nullptr, OPT_PERF},
+        {"quirks", required_argument, nullptr, OPT_QUIRKS},
+        {"keymap", required_argument, nullptr, OPT_KEYMAP},
+        {"palette", required_argument, nullptr, OPT_PALETTE},
+        {"save-rom-db", no_argument, nullptr, OPT_SAVE_ROM_DB},
+        {"calibrate", no_argument, nullptr, OPT_CALIBRATE},
+        {"fast-forward", required_argument, nullptr, OPT_FAST_FORWARD},
+        {"max-instrs", required_argument, nullptr, OPT_MAX_INSTRS},
+        {"until-pc", required_argument, nullptr, OPT_UNTIL_PC},
+        {"until-hash", required_argument, nullptr, OPT_UNTIL_HASH},
+        {"until-halt", no_argument, nullptr, OPT_UNTIL_HALT},
+        {"timeout", required_argument, nullptr, OPT_TIMEOUT},
+        {"shm", required_argument, nullptr, OPT_SHM},
+        {"mode", required_argument, nullptr, OPT_MODE},
+        {"strict", no_argument, nullptr, OPT_STRICT},
+        {"stream", required_argument, nullptr, OPT_STREAM},
+        {nullptr, 0, nullptr, 0}
     };
     while (1) {
         const auto opt = getopt_long(argc, argv, short_opts, long_opts, nullptr);
@@ -51,10 +171,11 @@ int main(int argc, char **argv)
 
         switch (opt) {
         case 's':
-            step = true;
+            opts.step = true;
             break;
         case 'c':
             clock_speed = (uint)std::stoi(optarg);
+            clock_given = true;
             if (clock_speed > MAX_CLOCK_SPEED) {
                 std::cerr << "Error: Invalid clock speed!\n";
                 print_usage();
@@ -72,6 +193,132 @@ int main(int argc, char **argv)
         case 'm':
             max_clock = true;
             break;
+        case 't':
+            term = true;
+            break;
+        case 'H':
+            opts.headless = true;
+            break;
+        case OPT_FRAMES:
+            frames = std::stoul(optarg);
+            opts.limits.frames = frames;
+            break;
+        case OPT_MAX_INSTRS:
+            opts.limits.instrs = std::stoull(optarg);
+            break;
+        case OPT_UNTIL_PC:
+            opts.limits.pc = std::stoi(optarg, nullptr, 16);
+            if (opts.limits.pc < 0 || opts.limits.pc > 0xFFFF) {
+                std::cerr << "Error: Invalid until-pc address!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case OPT_UNTIL_HASH:
+            opts.limits.match_hash = true;
+            opts.limits.frame_hash = std::stoull(optarg, nullptr, 16);
+            break;
+        case OPT_UNTIL_HALT:
+            opts.limits.halt = true;
+            break;
+        case OPT_TIMEOUT:
+            opts.limits.seconds = std::stod(optarg);
+            break;
+        case OPT_SHM:
+            opts.shm_name = optarg;
+            break;
+        case OPT_STRICT:
+            opts.strict = true;
+            break;
+        case OPT_STREAM:
+            opts.stream_addr = optarg;
+            break;
+        case OPT_MODE:
+            mode = optarg;
+            if (mode != "chip8" && mode != "schip" && mode != "xochip") {
+                std::cerr << "Error: Invalid mode!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case 'q':
+            opts.quiet = true;
+            break;
+        case OPT_HUD:
+            opts.hud = true;
+            break;
+        case OPT_STATS:
+            opts.stats_line = true;
+            break;
+        case OPT_STATS_FD:
+            opts.stats_fd = std::stoi(optarg);
+            break;
+        case OPT_TRACE:
+            opts.trace_path = optarg;
+            break;
+        case OPT_FILTER:
+            if (!parse_filter(optarg, filter)) {
+                std::cerr << "Error: Invalid filter!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case OPT_ROM_DB:
+            rom_db = optarg;
+            break;
+        case OPT_RUN_AHEAD:
+            opts.run_ahead = (uint)std::stoi(optarg);
+            if (opts.run_ahead > MAX_RUN_AHEAD) {
+                std::cerr << "Error: Invalid run-ahead value!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case OPT_PERF:
+            opts.perf = true;
+            break;
+        case OPT_QUIRKS:
+            if (!parse_quirks(optarg, given.quirks)) {
+                std::cerr << "Error: Invalid quirks!\n";
+                print_usage();
+                return 1;
+            }
+            quirks_given = true;
+            break;
+        case OPT_KEYMAP:
+            given.keymap = optarg;
+            if (!valid_keymap(given.keymap)) {
+                std::cerr << "Error: Invalid keymap!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case OPT_PALETTE:
+            given.palette = parse_palette(optarg, given.fg, given.bg);
+            if (!given.palette) {
+                std::cerr << "Error: Invalid palette!\n";
+                print_usage();
+                return 1;
+            }
+            break;
+        case OPT_SAVE_ROM_DB:
+            opts.save_rom_db = true;
+            break;
+        case OPT_CALIBRATE:
+            calibrate_ipf = true;
+            break;
+        case OPT_FAST_FORWARD:
+            opts.fast_forward = true;
+            opts.ff_speed = (uint)std::stoi(optarg);
+            break;
+        case OPT_MOSAIC:
+            mosaic = (uint)std::stoi(optarg);
+            if (mosaic == 0 || mosaic > MAX_HEADLESS_MOSAIC) {
+                std::cerr << "Error: Invalid mosaic size!\n";
+                print_usage();
+                return 1;
+            }
+            break;
         case 'h':
             print_usage();
             return 0;
@@ -88,36 +335,59 @@ int main(int argc, char **argv)
     filename = argv[optind];
     // *** end processing args ***
 
+    RomDb db;
+    db.load(rom_db);
+    if (clock_given)
+        given.ipf = Chip8::ipf_for_clock(clock_speed);
+    // the rom database and what builds on it are for CHIP-8 roms
+    if (mode != "chip8" && (calibrate_ipf || mosaic || opts.save_rom_db)) {
+        std::cerr << "Error: --calibrate, --mosaic and --save-rom-db are CHIP-8 only!\n";
+        return 1;
+    }
+    if (calibrate_ipf)
+        return calibrate(filename, db, rom_db, given, quirks_given);
+    if (mosaic > MOSAIC_MAX && !opts.headless) {
+        std::cerr << "Error: Only " << MOSAIC_MAX << " machines fit in the mosaic window!\n";
+        return 1;
+    }
+    if (mosaic)
+        return run_mosaic(mosaic, argv + optind, argc - optind, clock_speed, max_clock,
+                          db, given, quirks_given, opts.headless, frames);
+
     std::clog << "-----------------------------------------\n";
     std::clog << "*** Settings ***\n";
     std::clog << "-----------------------------------------\n";
     std::clog << "Rom Path   : " << filename << std::endl;
     std::clog << "Pixel Scale: " << pixel_scale << std::endl;
     std::clog << "Clock Speed: " << clock_speed << std::endl;
-    std::clog << "Step Mode  : " << (step ? "ON\n" : "OFF\n");
-    std::clog << "Max Clock  : " << (step ? "TRUE\n" : "FALSE\n");
+    std::clog << "Step Mode  : " << (opts.step ? "ON\n" : "OFF\n");
+    std::clog << "Max Clock  : " << (opts.step ? "TRUE\n" : "FALSE\n");
+    std::clog << "Frontend   : " << (opts.headless ? "HEADLESS\n" : term ? "TERM\n" : "SDL\n");
+    std::clog << "Mode       : " << mode << std::endl;
     std::clog << "-----------------------------------------\n";
 
     // setup sighandler
     sighandler_t res = signal(SIGINT, sighandler);
     assert(res != SIG_ERR);
 
-    Chip8 chip8 = Chip8(filename, pixel_scale, clock_speed, max_clock);
-
-    // setup exit handler
-    on_exit(exithandler, (void*)&chip8);
-
-    std::clog << "Starting Chip8...\n";
-    // check if in step mode
-    if (step) {
-        while (1) {
-            chip8.step();
-            printf("Press ENTER to continue...\n");
-            getchar();
-        }
+    std::unique_ptr<Frontend> frontend;
+    if (opts.headless) {
+        // no frontend
+    } else if (term) {
+        frontend.reset(new TermFrontend());
     } else {
-        chip8.run();
+        std::string title = std::string("Chip8: ") + filename;
+        frontend.reset(new SdlFrontend(title.c_str(), pixel_scale, filter));
     }
+
+    if (mode == "schip")
+        return run_rom<SuperChip8>(filename, frontend.get(), max_clock, db, rom_db, given,
+                                   quirks_given, opts);
+    if (mode == "xochip")
+        return run_rom<XoChip8>(filename, frontend.get(), max_clock, db, rom_db, given,
+                                quirks_given, opts);
+    return run_rom<Chip8>(filename, frontend.get(), max_clock, db, rom_db, given, quirks_given,
+                          opts);
 }
 
 static void sighandler(int sig)
@@ -126,16 +396,293 @@ static void sighandler(int sig)
         std::exit(1);
 }
 
+template<typename Machine>
 static void exithandler(int rc, void *arg)
 {
-    Chip8 *chip8 = (Chip8*) arg;
+    Machine *chip8 = (Machine*) arg;
+    chip8->end_trace();
+    chip8->end_perf();
+    chip8->end_export();
+    chip8->end_stream();
     if (rc != 0)
         chip8->dump();
 }
 
+/*
+ * Load and run one rom on a Machine with everything the command line asked
+ * for. Rom database entries are tuned for CHIP-8, so on the extended
+ * machines only what is given on the command line applies on top of the
+ * machine's own defaults. Doesn't return once the machine runs: it leaves
+ * through the exit handler while the machine is still alive.
+ */
+template<typename Machine>
+static int run_rom(const char *filename, Frontend *frontend, bool max_clock, RomDb &db,
+                   const std::string &db_path, const RomDbEntry &given, bool quirks_given,
+                   const RunOptions &opts)
+{
+    Machine chip8(frontend, max_clock);
+    if (!chip8.load_file(filename))
+        return 1;
+    chip8.set_verbose(!opts.quiet);
+    chip8.set_strict(opts.strict);
+    chip8.peripherals().set_hud(opts.hud);
+    chip8.peripherals().stats().set_output(opts.stats_line, opts.stats_fd);
+    chip8.set_run_ahead(opts.run_ahead);
+    chip8.set_fast_forward(opts.fast_forward, opts.ff_speed);
+    RomDb none;
+    RomDbEntry settings = rom_settings(Machine::extended() ? none : db, chip8.rom_hash(), given,
+                                       quirks_given);
+    if (Machine::extended() && !quirks_given)
+        settings.quirks = chip8.quirks();
+    apply_settings(chip8, frontend, settings);
+    std::clog << "Rom Setup  : ";
+    if (Machine::extended())
+        std::clog << Machine::name() << ", ";
+    std::clog << "quirks " << format_quirks(settings.quirks) << ", " << chip8.ipf()
+              << " instrs/frame";
+    if (!settings.keymap.empty())
+        std::clog << ", keys " << settings.keymap;
+    if (settings.palette)
+        std::clog << ", palette " << format_palette(settings.fg, settings.bg);
+    std::clog << std::endl;
+    if (opts.save_rom_db) {
+        settings.ipf = chip8.ipf();
+        if (settings.comment.empty())
+            settings.comment = rom_name(filename);
+        db.set(chip8.rom_hash(), settings);
+        if (!db.save(db_path))
+            return 1;
+        std::clog << "Rom DB     : saved to " << db_path << std::endl;
+    }
+    if (opts.trace_path != NULL && !chip8.start_trace(opts.trace_path))
+        return 1;
+    if (opts.perf && !chip8.start_perf())
+        return 1;
+    if (opts.shm_name != NULL && !chip8.start_export(opts.shm_name))
+        return 1;
+    if (opts.stream_addr != NULL && !chip8.start_stream(opts.stream_addr))
+        return 1;
+
+    // setup exit handler
+    on_exit(exithandler<Machine>, (void*)&chip8);
+
+    std::clog << "Starting Chip8...\n";
+    try {
+        // check if in step mode
+        if (opts.headless) {
+            std::exit(run_headless(chip8, opts.limits));
+        } else if (opts.step) {
+            while (1) {
+                chip8.step();
+                chip8.refresh();
+                printf("Press ENTER to continue...\n");
+                getchar();
+            }
+        } else {
+            chip8.run();
+        }
+    } catch (const Fault &f) {
+        // exit handler dumps the machine for us
+        std::fprintf(stderr, "Error: %s (addr 0x%04X, pc 0x%04X, opcode 0x%04X)\n", f.what(),
+                     f.addr, f.pc, f.opcode);
+        std::exit(1);
+    }
+    std::exit(0);
+}
+
+/*
+ * What a rom runs with: its database entry (from chip8-probe, --calibrate or
+ * --save-rom-db), with anything given on the command line on top.
+ */
+static RomDbEntry rom_settings(const RomDb &db, uint64_t hash, const RomDbEntry &given,
+                               bool quirks_given)
+{
+    RomDbEntry settings;
+    const RomDbEntry *entry = db.find(hash);
+    if (entry != nullptr)
+        settings = *entry;
+    if (given.ipf)
+        settings.ipf = given.ipf;
+    if (quirks_given)
+        settings.quirks = given.quirks;
+    if (!given.keymap.empty())
+        settings.keymap = given.keymap;
+    if (given.palette) {
+        settings.palette = true;
+        settings.fg = given.fg;
+        settings.bg = given.bg;
+    }
+    return settings;
+}
+
+// file name without the directories, what chip8-probe comments entries with
+static std::string rom_name(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    return path.substr(slash == std::string::npos ? 0 : slash + 1);
+}
+
+template<typename Machine>
+static void apply_settings(Machine &chip8, Frontend *frontend, const RomDbEntry &settings)
+{
+    chip8.set_quirks(settings.quirks);
+    if (settings.ipf)
+        chip8.set_ipf(settings.ipf);
+    if (frontend != nullptr && !settings.keymap.empty())
+        frontend->set_keymap(settings.keymap);
+    if (frontend != nullptr && settings.palette)
+        frontend->set_palette(settings.fg, settings.bg);
+}
+
+/*
+ * Find the lowest instruction rate the rom needs (see calibrate_ipf()) and
+ * store it in the database with the rest of its settings.
+ */
+static int calibrate(const char *filename, RomDb &db, const std::string &db_path,
+                     const RomDbEntry &given, bool quirks_given)
+{
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+    if (!in.good() && !in.eof()) {
+        std::cerr << "Error: Failed to read " << filename << "!\n";
+        return 1;
+    }
+    uint64_t hash = rom_hash(rom.data(), rom.size());
+    RomDbEntry settings = rom_settings(db, hash, given, quirks_given);
+    uint ipf = calibrate_ipf(rom.data(), rom.size(), settings.quirks);
+    if (ipf == 0) {
+        std::cerr << filename << ": screen keeps changing with the rate, "
+                  << "it doesn't pace itself off the timer; nothing saved\n";
+        return 1;
+    }
+    settings.ipf = ipf;
+    if (settings.comment.empty())
+        settings.comment = rom_name(filename);
+    db.set(hash, settings);
+    if (!db.save(db_path))
+        return 1;
+    std::printf("%s: %u instrs/frame, saved to %s\n", filename, ipf, db_path.c_str());
+    return 0;
+}
+
+/*
+ * Run count machines at once and watch them all in one window. The roms are
+ * handed out round robin and every machine gets its own random seed, so
+ * copies of one rom still play differently. Each core gets a thread with a
+ * coroutine scheduler over its share of the machines, so machines waiting
+ * on a key or the timer cost next to nothing. A machine that faults stops
+ * and its tile turns red, the rest carry on.
+ *
+ * Headless there is no window and no pacing: run the given number of frames
+ * (0 for forever) and print how many machine frames actually had to run.
+ */
+static int run_mosaic(uint count, char **roms, int nroms, uint clock_speed, bool max_clock,
+                      const RomDb &db, const RomDbEntry &given, bool quirks_given,
+                      bool headless, unsigned long frames)
+{
+    std::vector<std::unique_ptr<Chip8>> machines;
+    for (uint i = 0; i < count; i++) {
+        machines.emplace_back(new Chip8(roms[i % nroms], nullptr, clock_speed, max_clock));
+        Chip8 &chip8 = *machines.back();
+        chip8.set_verbose(false);
+        chip8.set_seed(i + 1);
+        apply_settings(chip8, nullptr, rom_settings(db, chip8.rom_hash(), given, quirks_given));
+    }
+    std::clog << "Mosaic     : " << count << " machines, " << nroms << " roms\n";
+
+    Mosaic board(headless ? 1 : count);
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> ran(0);
+    uint nthreads = std::max(1u, std::min(count, std::thread::hardware_concurrency()));
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint t = 0; t < nthreads; t++) {
+        threads.emplace_back([&, t]() {
+            typedef std::chrono::steady_clock clock;
+            const clock::duration period = std::chrono::microseconds(1000000 / 60);
+            Scheduler sched;
+            std::vector<uint> slots; // scheduler id to board slot
+            for (uint i = t; i < count; i += nthreads) {
+                sched.add(*machines[i]);
+                slots.push_back(i);
+            }
+            uint64_t my_ran = 0;
+            clock::time_point next = clock::now();
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (headless && frames && sched.frame() >= frames)
+                    break;
+                for (size_t id = 0; !headless && id < slots.size(); id++) {
+                    sched.set_keys(id, board.keys(slots[id]));
+                }
+                const std::vector<size_t> &done = sched.run_frame();
+                my_ran += done.size();
+                if (headless)
+                    continue;
+                for (size_t id : done) {
+                    if (sched.faulted(id))
+                        board.set_faulted(slots[id]);
+                    board.publish(slots[id], machines[slots[id]]->peripherals().framebuf());
+                }
+                if (max_clock)
+                    continue;
+                next += period;
+                clock::time_point now = clock::now();
+                if (next < now)
+                    next = now;
+                std::this_thread::sleep_until(next);
+            }
+            ran += my_ran;
+        });
+    }
+
+    if (!headless) {
+        {
+            SdlMosaic monitor(board, "Chip8 mosaic", 60);
+            monitor.run();
+        }
+        stop.store(true, std::memory_order_relaxed);
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (headless) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        unsigned long long total = (unsigned long long)frames * count;
+        printf("machines %u frames %lu machine-frames %llu run %llu secs %.4f fps %.0f\n",
+               count, frames, total, (unsigned long long)ran.load(), secs, total / secs);
+    }
+    return 0;
+}
+
+/*
+ * Run frames back to back with no frontend and no pacing until one of the
+ * limits is hit (with none, until killed), then print how fast that went,
+ * why it stopped and where the machine ended up. Used for benchmarking, for
+ * training PGO builds and for batch jobs. Returns the exit code: 1 if the
+ * rom faulted.
+ */
+template<typename Machine>
+static int run_headless(Machine &chip8, const Chip8::RunLimits &limits)
+{
+    chip8.peripherals().set_keys(0);
+    Chip8::RunResult res = chip8.run_until(limits);
+    // key=value fields, for scripts (scripts/bench.sh reads ips=)
+    printf("frames=%llu instrs=%llu secs=%.4f ips=%.0f stop=%s pc=0x%04X I=0x%04X "
+           "hash=%016llx\n", (unsigned long long)res.frames, (unsigned long long)res.instrs,
+           res.seconds, res.instrs / res.seconds, Chip8::stop_name(res.reason), res.pc, res.I,
+           (unsigned long long)res.frame_hash);
+    if (res.reason == Chip8::STOP_FAULT) {
+        std::fprintf(stderr, "Error: %s (addr 0x%04X, pc 0x%04X, opcode 0x%04X)\n",
+                     res.fault_msg.c_str(), res.fault_addr, res.fault_pc, res.fault_opcode);
+        return 1;
+    }
+    return 0;
+}
+
 static void print_usage()
 {
-    printf("Usage: chip8 [OPTIONS] <path-to-rom>\n");
+    printf("Usage: chip8 [OPTIONS] <path-to-rom>...\n");
     printf("Emulates a chip8 processor using the provided rom file.\n");
     printf("\n");
     printf("EXAMPLE:\n");
@@ -152,6 +699,80 @@ static void print_usage()
     printf("    -p, --pixel-scale       Sets the resolution scale, the default being %d.\n", DEFAULT_PIXEL_SCALE);
     printf("                            Adjust this to make the screen larger or smaller.\n");
     printf("                            Max value is %d\n", MAX_PIXEL_SCALE);
+    printf("        --filter NAME       How the screen is scaled up: nearest (default),\n");
+    printf("                            scale2x for smoothed edges, or scanlines.\n");
+    printf("        --mosaic N          Run N machines (max %d) side by side in one\n", MOSAIC_MAX);
+    printf("                            window, cycling through every rom path given.\n");
+    printf("                            Click a screen or press Tab to send it the keys.\n");
+    printf("                            With --headless, up to %d machines run with no\n", MAX_HEADLESS_MOSAIC);
+    printf("                            window for --frames frames and report the rate.\n");
+    printf("    -t, --term              Draw the screen in the terminal instead of an SDL\n");
+    printf("                            window. Keys are read from stdin. Use with --quiet\n");
+    printf("                            to keep the debug output off screen.\n");
+    printf("        --mode MODE         Instruction set: chip8 (default), schip for\n");
+    printf("                            SUPER-CHIP 1.1 or xochip for XO-CHIP. The last two\n");
+    printf("                            have a 128x64 screen and run without the rom\n");
+    printf("                            database, --calibrate, --mosaic, --shm and\n");
+    printf("                            --stream.\n");
+    printf("    -H, --headless          Run without any frontend and without pacing.\n");
+    printf("        --frames N          With --headless, stop after N frames and print\n");
+    printf("                            how fast they ran.\n");
+    printf("        --max-instrs N      With --headless, stop after N instructions.\n");
+    printf("        --until-pc ADDR     With --headless, stop when pc reaches the hex\n");
+    printf("                            address ADDR, before running it.\n");
+    printf("        --until-hash HASH   With --headless, stop after a frame whose screen\n");
+    printf("                            hashes to HASH, as printed on exit.\n");
+    printf("        --until-halt        With --headless, stop once the rom can only spin:\n");
+    printf("                            a jump to itself or a key wait with no keys.\n");
+    printf("        --timeout SECS      With --headless, stop after SECS of wall time.\n");
+    printf("                            On exit the stop reason, pc, I and screen hash\n");
+    printf("                            are printed after the rate.\n");
+    printf("        --strict            Stop with a fault when the rom reads or writes\n");
+    printf("                            past the end of memory through I, instead of\n");
+    printf("                            wrapping around to 0x000.\n");
+    printf("    -q, --quiet             Don't print every instruction to stderr.\n");
+    printf("        --hud               Start with the performance overlay shown. F1 (or h\n");
+    printf("                            in the terminal) toggles it while running.\n");
+    printf("        --stats             Print a line of performance stats to stderr\n");
+    printf("                            every second.\n");
+    printf("        --stats-fd FD       Write the stats as one JSON object per line to\n");
+    printf("                            file descriptor FD every second.\n");
+    printf("        --run-ahead N       Each frame, emulate N frames ahead with the keys\n");
+    printf("                            held now, show that frame and roll back. Cuts\n");
+    printf("                            input lag by N frames for games that poll keys,\n");
+    printf("                            at N+1 times the cpu cost. Max value is %d\n", MAX_RUN_AHEAD);
+    printf("        --fast-forward N    Start fast forwarding at N times speed, or as fast\n");
+    printf("                            as the host can with 0. Timers keep emulated\n");
+    printf("                            time and the screen is only drawn 60 times a\n");
+    printf("                            second. Tab toggles it while running.\n");
+    printf("        --rom-db FILE       Rom database to read quirks and clock rates from,\n");
+    printf("                            written by tools/chip8-probe. The default is\n");
+    printf("                            %s\n", RomDb::default_path().c_str());
+    printf("        --quirks LIST       Comma separated quirks to run with, over the rom\n");
+    printf("                            database: shift_vy, keep_i, jump_vx, vf_reset,\n");
+    printf("                            clip, keep_vf, or none.\n");
+    printf("        --keymap KEYS       Host key for each keypad key 0-F, 16 characters\n");
+    printf("                            from 0-9 and a-z. The default is %s\n", DEFAULT_KEYMAP);
+    printf("        --palette FG,BG     Pixel colours as RRGGBB,RRGGBB.\n");
+    printf("        --save-rom-db       Store the rate, quirks, keymap and palette in use\n");
+    printf("                            for this rom in the rom database, then run it.\n");
+    printf("        --calibrate         Find the lowest clock rate at which the rom shows\n");
+    printf("                            the same frames as at full speed, store it in the\n");
+    printf("                            rom database and exit.\n");
+    printf("        --trace FILE        Record every executed instruction to FILE (gzip\n");
+    printf("                            compressed). Decode it with tools/chip8-trace.\n");
+    printf("        --shm NAME          Publish every frame's screen, registers and timer\n");
+    printf("                            to the shared memory segment NAME for other\n");
+    printf("                            processes, which can also set the held keys\n");
+    printf("                            there. See tools/chip8-watch.\n");
+    printf("        --stream ADDR       Send changed frames, delta encoded, to clients on a\n");
+    printf("                            local socket and take held keys from them. ADDR\n");
+    printf("                            is a port on 127.0.0.1 or a Unix socket path.\n");
+    printf("                            See tools/chip8-remote.\n");
+    printf("        --perf              Count host cycles, instructions, branch and cache\n");
+    printf("                            misses while emulating and print them per\n");
+    printf("                            emulated instruction on exit, for each engine and\n");
+    printf("                            opcode class. Use with --quiet.\n");
     printf("    -s, --step              When set the emulator will run in step mode.\n");
     printf("                            In step mode, the instruction will only be\n");
     printf("                            executed after ENTER key is pressed.\n");
@@ -12,7 +12,7 @@ Memory is Big-Endian
 
 Memory Layout
 ------------------------------------
-0xFFF
+0xFFF (0xFFFF for XO-CHIP)
 .
 .        Program/Data mem
 .
@@ -33,43 +33,403 @@ Memory Layout
 
 */
 
+#include <algorithm>
+#include <bit>
 #include <fstream>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
 #include <mem.h>
+#include <fault.h>
 
-// Helpers
-static inline bool addr_in_range(uint16_t addr)
+/*
+ * Freed page copies and decoded pages are kept on a per thread list and
+ * handed out again, so machines forked and dropped by the thousand (tree
+ * search, see forkpool.h) stop touching the heap once the lists have filled.
+ */
+template<size_t BYTES>
+class FreeList {
+private:
+    void *m_head = nullptr;
+    size_t m_count = 0;
+
+public:
+    ~FreeList()
+    {
+        while (m_head != nullptr) {
+            void *next = *static_cast<void **>(m_head);
+            ::operator delete(m_head);
+            m_head = next;
+        }
+    }
+
+    static FreeList &local()
+    {
+        thread_local FreeList list;
+        return list;
+    }
+
+    void *take()
+    {
+        if (m_head == nullptr)
+            return ::operator new(BYTES);
+        void *block = m_head;
+        m_head = *static_cast<void **>(block);
+        m_count--;
+        return block;
+    }
+
+    void give(void *block)
+    {
+        if (m_count >= MEM_FREE_PAGES) {
+            ::operator delete(block);
+            return;
+        }
+        *static_cast<void **>(block) = m_head;
+        m_head = block;
+        m_count++;
+    }
+};
+
+typedef FreeList<sizeof(MemPage)> PageList;
+typedef FreeList<PAGE_SIZE * sizeof(Decoded)> CodeList;
+
+MemPage::~MemPage()
+{
+    Decoded *c = code.load(std::memory_order_relaxed);
+    if (c != nullptr)
+        CodeList::local().give(c);
+}
+
+static MemPage *new_page()
+{
+    return new (PageList::local().take()) MemPage();
+}
+
+static void unref(MemPage *page)
+{
+    if (page->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    page->~MemPage();
+    PageList::local().give(page);
+}
+
+static void unref(MemImage *image)
+{
+    if (image->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    delete[] image->pages;
+    delete image;
+}
+
+static void write_font(uint8_t *mem);
+
+// the page every Mem starts on at 0x000, and the one everywhere else
+static MemPage *font_page()
+{
+    static MemPage *page = [] {
+        MemPage *p = new MemPage();
+        std::memset(p->data, 0, PAGE_SIZE);
+        write_font(p->data);
+        return p;
+    }();
+    return page;
+}
+
+static MemPage *zero_page()
+{
+    static MemPage *page = [] {
+        MemPage *p = new MemPage();
+        std::memset(p->data, 0, PAGE_SIZE);
+        return p;
+    }();
+    return page;
+}
+
+/*
+ * Copy the part of the rom that lands on page n (rom at 0x200) into out,
+ * zero filling around it.
+ */
+static void fill_rom_page(uint8_t *out, uint32_t n, const uint8_t *rom, size_t len)
 {
-    return addr <= 0xFFF;
+    std::memset(out, 0, PAGE_SIZE);
+    uint32_t begin = n * PAGE_SIZE;
+    uint32_t from = std::max<uint32_t>(begin, 0x200);
+    uint32_t to = std::min<uint32_t>(begin + PAGE_SIZE, 0x200 + len);
+    if (from < to)
+        std::memcpy(out + (from - begin), rom + (from - 0x200), to - from);
+}
+
+/*
+ * One image per distinct rom, handed out to every Mem loading it. The cache
+ * holds a reference to each; once it has more than 64, the ones only it
+ * still holds are let go (the fuzzer goes through millions of roms, but it
+ * loads them with load_private()).
+ */
+static MemImage *shared_image(const uint8_t *rom, size_t len)
+{
+    static std::mutex lock;
+    static std::map<std::string, MemImage *> images;
+
+    std::string key((const char *)rom, len);
+    std::lock_guard<std::mutex> guard(lock);
+    MemImage *&image = images[key];
+    if (image != nullptr) {
+        image->refs.fetch_add(1, std::memory_order_relaxed);
+        return image;
+    }
+
+    MemImage *fresh = new MemImage();
+    fresh->first = 0x200 / PAGE_SIZE;
+    fresh->count = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    fresh->pages = new MemPage[fresh->count];
+    for (uint32_t i = 0; i < fresh->count; i++) {
+        fill_rom_page(fresh->pages[i].data, fresh->first + i, rom, len);
+    }
+    image = fresh;
+    fresh->refs.fetch_add(1, std::memory_order_relaxed);
+
+    if (images.size() > 64) {
+        for (auto it = images.begin(); it != images.end();) {
+            if (it->second->refs.load(std::memory_order_acquire) == 1) {
+                unref(it->second);
+                it = images.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    return fresh;
 }
 
 // class methods
-Mem::Mem()
+template<uint32_t SIZE>
+BasicMem<SIZE>::BasicMem(PageDecoder decoder)
+    : m_decoder(decoder)
+{
+    blank();
+}
+
+template<uint32_t SIZE>
+BasicMem<SIZE>::BasicMem(const BasicMem &other)
+    : m_decoder(other.m_decoder)
 {
-    Mem::write_font();
+    blank();
+    *this = other;
 }
 
-void Mem::write(uint8_t data, uint16_t addr)
+template<uint32_t SIZE>
+BasicMem<SIZE>::~BasicMem()
 {
-    if (addr_in_range(addr)) {
-        mem[addr] = data;
-    } else {
-        std::cerr << "Error: Attempt to write outside of addr range!\n";
-        std::exit(1);
+    release();
+}
+
+/*
+ * Share everything other has: its image and page table, taking a reference
+ * on every page copy.
+ */
+template<uint32_t SIZE>
+BasicMem<SIZE> &BasicMem<SIZE>::operator=(const BasicMem &other)
+{
+    if (this == &other)
+        return *this;
+    if (other.m_image != nullptr)
+        other.m_image->refs.fetch_add(1, std::memory_order_relaxed);
+    for (uint32_t w = 0; w < WORDS; w++) {
+        for (uint64_t bits = other.m_copied[w]; bits != 0; bits &= bits - 1) {
+            other.m_pages[w*64 + std::countr_zero(bits)]->refs.fetch_add(1, std::memory_order_relaxed);
+        }
     }
+    release();
+    m_image = other.m_image;
+    m_decoder = other.m_decoder;
+    std::copy(other.m_pages, other.m_pages + PAGES, m_pages);
+    std::copy(other.m_copied, other.m_copied + WORDS, m_copied);
+    std::fill(m_writable, m_writable + WORDS, 0);
+    std::fill(other.m_writable, other.m_writable + WORDS, 0);
+    return *this;
 }
 
-uint8_t Mem::read(uint16_t addr)
+/*
+ * Drop the references this Mem holds. Leaves the page table as it was,
+ * callers fill it in again.
+ */
+template<uint32_t SIZE>
+void BasicMem<SIZE>::release()
 {
-    if (addr <= 0xFFF)
-        return mem[addr];
-    std::cerr << "Error: Attempt to access outside of addr range!\n";
-    std::exit(1);
-    return 0x00;
+    if (m_image != nullptr)
+        unref(m_image);
+    m_image = nullptr;
+    for (uint32_t w = 0; w < WORDS; w++) {
+        for (uint64_t bits = m_copied[w]; bits != 0; bits &= bits - 1) {
+            unref(m_pages[w*64 + std::countr_zero(bits)]);
+        }
+        m_copied[w] = 0;
+        m_writable[w] = 0;
+    }
+}
+
+// font and zeros, after release()
+template<uint32_t SIZE>
+void BasicMem<SIZE>::blank()
+{
+    m_pages[0] = font_page();
+    std::fill(m_pages + 1, m_pages + PAGES, zero_page());
+}
+
+template<uint32_t SIZE>
+void BasicMem<SIZE>::read_fault(uint16_t addr)
+{
+    throw Fault(FAULT_MEM_READ, addr, "Attempt to access outside of addr range!");
+}
+
+template<uint32_t SIZE>
+void BasicMem<SIZE>::write_fault(uint16_t addr)
+{
+    throw Fault(FAULT_MEM_WRITE, addr, "Attempt to write outside of addr range!");
+}
+
+/*
+ * Switch to the image for this rom (font + rom at 0x200, rest zero), dropping
+ * any pages written so far. Caller checks the size.
+ */
+template<uint32_t SIZE>
+void BasicMem<SIZE>::load_program(const uint8_t *rom, size_t len)
+{
+    MemImage *image = shared_image(rom, len);
+    release();
+    blank();
+    m_image = image;
+    for (uint32_t i = 0; i < image->count; i++) {
+        m_pages[image->first + i] = &image->pages[i];
+    }
+}
+
+/*
+ * load_program() for a rom that won't be loaded again (fuzz inputs): the rom
+ * goes straight into pages of our own, no cache, no lock.
+ */
+template<uint32_t SIZE>
+void BasicMem<SIZE>::load_private(const uint8_t *rom, size_t len)
+{
+    release();
+    blank();
+    for (uint32_t n = 0x200 / PAGE_SIZE; n * PAGE_SIZE < 0x200 + len; n++) {
+        MemPage *page = new_page();
+        fill_rom_page(page->data, n, rom, len);
+        m_pages[n] = page;
+        m_copied[n >> 6] |= (uint64_t)1 << (n & 63);
+        m_writable[n >> 6] |= (uint64_t)1 << (n & 63);
+    }
 }
 
-void Mem::dump()
+/*
+ * Make a page writable, copying it unless nobody else holds it anymore. A
+ * page code has run from takes its decoded entries along.
+ */
+template<uint32_t SIZE>
+void BasicMem<SIZE>::own_page(uint16_t page)
+{
+    m_writable[page >> 6] |= (uint64_t)1 << (page & 63);
+    MemPage *old = m_pages[page];
+    bool copied = bit(m_copied, page);
+    if (copied && old->refs.load(std::memory_order_acquire) == 1)
+        return;
+    MemPage *copy = new_page();
+    std::memcpy(copy->data, old->data, PAGE_SIZE);
+    Decoded *code = old->code.load(std::memory_order_acquire);
+    if (code != nullptr) {
+        Decoded *mine = static_cast<Decoded *>(CodeList::local().take());
+        std::memcpy(mine, code, PAGE_SIZE * sizeof(Decoded));
+        copy->code.store(mine, std::memory_order_relaxed);
+    }
+    if (copied)
+        unref(old);
+    m_pages[page] = copy;
+    m_copied[page >> 6] |= (uint64_t)1 << (page & 63);
+}
+
+/*
+ * First time code runs from a page: decode all of it. Other Mems sharing
+ * the page (on other threads too) use the same entries; if one of them got
+ * there first, theirs are kept.
+ */
+template<uint32_t SIZE>
+Decoded *BasicMem<SIZE>::decode(MemPage *page)
+{
+    Decoded *code = static_cast<Decoded *>(CodeList::local().take());
+    if (m_decoder != nullptr)
+        m_decoder(page->data, code, 0, PAGE_SIZE);
+    else
+        std::memset(code, 0, PAGE_SIZE * sizeof(Decoded));
+    Decoded *none = nullptr;
+    if (!page->code.compare_exchange_strong(none, code, std::memory_order_acq_rel)) {
+        CodeList::local().give(code);
+        return none;
+    }
+    return code;
+}
+
+/*
+ * Decode again after writing [addr, addr+len): the entries that start up to
+ * DECODED_SPAN-1 bytes before each written byte on its page. Entries never
+ * read across a page, so the page before is untouched. Pages nothing has
+ * run from have no entries yet, and get them from the new bytes when
+ * something does.
+ */
+template<uint32_t SIZE>
+void BasicMem<SIZE>::redecode(uint16_t addr, uint len)
+{
+    if (m_decoder == nullptr)
+        return;
+    uint32_t at = addr & (SIZE - 1);
+    while (len > 0) {
+        uint16_t page = at >> PAGE_BITS;
+        uint off = at & (PAGE_SIZE - 1);
+        uint n = std::min<uint>(len, PAGE_SIZE - off);
+        if (m_pages[page]->code.load(std::memory_order_relaxed) != nullptr) {
+            // the entries are only ours to change on a page that is
+            if (!bit(m_writable, page))
+                own_page(page);
+            m_decoder(m_pages[page]->data, m_pages[page]->code.load(std::memory_order_relaxed),
+                      off >= DECODED_SPAN - 1 ? off - (DECODED_SPAN - 1) : 0, off + n);
+        }
+        len -= n;
+        at = (at + n) & (SIZE - 1);
+    }
+}
+
+/*
+ * Number of pages this Mem holds a copy of (shared or not).
+ */
+template<uint32_t SIZE>
+uint32_t BasicMem<SIZE>::dirty_pages()
+{
+    uint32_t n = 0;
+    for (uint64_t w : m_copied) {
+        n += std::popcount(w);
+    }
+    return n;
+}
+
+/*
+ * Number of pages this Mem reads that have been decoded.
+ */
+template<uint32_t SIZE>
+uint32_t BasicMem<SIZE>::code_pages()
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < PAGES; i++) {
+        n += m_pages[i]->code.load(std::memory_order_relaxed) != nullptr ? 1 : 0;
+    }
+    return n;
+}
+
+template<uint32_t SIZE>
+void BasicMem<SIZE>::dump()
 {
     std::fstream ofile;
     ofile.open("chip8-coredump", std::ios::out | std::ios::binary);
@@ -78,19 +438,20 @@ void Mem::dump()
         return;
     }
     // dump core
-    for (int i = 0; i < 0xFFF; i++) {
-        ofile << mem[i];
+    for (uint32_t i = 0; i < SIZE - 1; i++) {
+        ofile << read(i);
     }
 
     ofile.close();
 }
 
-uint32_t Mem::size()
+template<uint32_t SIZE>
+uint32_t BasicMem<SIZE>::size()
 {
-    return (1024*4);
+    return SIZE;
 }
 
-void Mem::write_font()
+static void write_font(uint8_t *mem)
 {
     // 0x0                          // 0x1
     mem[0x00] = 0xf0;               mem[0x05] = 0x20;
@@ -148,3 +509,6 @@ void Mem::write_font()
     mem[0x49] = 0x80;               mem[0x4e] = 0x80;
     mem[0x4a] = 0xf0;               mem[0x4f] = 0x80;
 }
+
+template class BasicMem<MEM_SIZE>;
+template class BasicMem<XO_MEM_SIZE>;
@@ -0,0 +1,77 @@
+/*
+ * mosaic.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Lock free screen board for watching many machines at once.
+ */
+
+#include <mosaic.h>
+
+Mosaic::Mosaic(size_t count)
+    : m_count(count), m_slots(new Slot[count])
+{
+    for (size_t i = 0; i < count; i++) {
+        Slot &s = m_slots[i];
+        s.seq.store(0, std::memory_order_relaxed);
+        for (int y = 0; y < FRAME_HEIGHT; y++) {
+            s.rows[y].store(0, std::memory_order_relaxed);
+        }
+        s.keys.store(0, std::memory_order_relaxed);
+        s.faulted.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Mosaic::publish(size_t slot, const uint8_t *framebuf)
+{
+    Slot &s = m_slots[slot];
+    uint32_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        const uint8_t *row = framebuf + y*FRAME_WIDTH;
+        uint64_t bits = 0;
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            bits = (bits << 1) | (row[x] & 0x1);
+        }
+        s.rows[y].store(bits, std::memory_order_relaxed);
+    }
+    s.seq.store(seq + 2, std::memory_order_release);
+}
+
+void Mosaic::set_faulted(size_t slot)
+{
+    m_slots[slot].faulted.store(true, std::memory_order_relaxed);
+}
+
+/*
+ * Copy out a whole screen, never half of one frame and half of the next.
+ * Returns the slot's sequence number, which only changes when something new
+ * was published.
+ */
+uint32_t Mosaic::snapshot(size_t slot, uint64_t rows[FRAME_HEIGHT]) const
+{
+    const Slot &s = m_slots[slot];
+    while (true) {
+        uint32_t before = s.seq.load(std::memory_order_acquire);
+        if (before & 0x1)
+            continue;
+        for (int y = 0; y < FRAME_HEIGHT; y++) {
+            rows[y] = s.rows[y].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) == before)
+            return before;
+    }
+}
+
+bool Mosaic::faulted(size_t slot) const
+{
+    return m_slots[slot].faulted.load(std::memory_order_relaxed);
+}
+
+void Mosaic::set_keys(size_t slot, uint16_t keys)
+{
+    m_slots[slot].keys.store(keys, std::memory_order_relaxed);
+}
@@ -0,0 +1,195 @@
+/*
+ * perf.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Host hardware counters around emulation, to see where the host cpu goes:
+ * dispatch branch misses, cache misses, cycles per emulated instruction.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <perf.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *event_names[NUM_PERF_EVENTS] = {
+    "cycles", "instrs", "br-miss", "l1d-miss", "llc-miss", "ns",
+};
+
+static const char *class_names[PERF_CLASSES] = {
+    "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XYN", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX__", "FX__",
+};
+
+PerfCounters::PerfCounters()
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        m_fd[e] = -1;
+        m_slot[e] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (m_fd[e] >= 0)
+            close(m_fd[e]);
+    }
+#endif
+}
+
+#ifdef __linux__
+
+static int open_event(uint32_t type, uint64_t config, int group)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread, any cpu
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool PerfCounters::open()
+{
+    const struct { uint32_t type; uint64_t config; } events[NUM_PERF_EVENTS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    };
+    // the first event that opens leads the group
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        m_fd[e] = open_event(events[e].type, events[e].config, m_leader);
+        if (m_fd[e] < 0)
+            continue;
+        if (m_leader < 0)
+            m_leader = m_fd[e];
+        m_slot[e] = m_open++;
+    }
+    return m_open > 0;
+}
+
+void PerfCounters::values(uint64_t out[NUM_PERF_EVENTS])
+{
+    uint64_t buf[3 + NUM_PERF_EVENTS]; // nr, time enabled, time running, values
+    std::memset(out, 0, NUM_PERF_EVENTS * sizeof(uint64_t));
+    if (m_leader < 0 || read(m_leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return;
+    double scale = 1.0;
+    if (buf[2] && buf[2] < buf[1])
+        scale = (double)buf[1] / buf[2];
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (m_slot[e] >= 0 && (uint64_t)m_slot[e] < buf[0])
+            out[e] = scale == 1.0 ? buf[3 + m_slot[e]] : (uint64_t)(buf[3 + m_slot[e]] * scale);
+    }
+}
+
+#else
+
+bool PerfCounters::open()
+{
+    return false;
+}
+
+void PerfCounters::values(uint64_t out[NUM_PERF_EVENTS])
+{
+    std::memset(out, 0, NUM_PERF_EVENTS * sizeof(uint64_t));
+}
+
+#endif
+
+PerfProfile::PerfProfile()
+{
+    std::memset(m_mark, 0, sizeof(m_mark));
+    std::memset(m_overhead, 0, sizeof(m_overhead));
+    std::memset(m_engines, 0, sizeof(m_engines));
+    std::memset(m_classes, 0, sizeof(m_classes));
+}
+
+/*
+ * Open the counters and measure an empty begin()/end pair, the smallest of a
+ * few tries, which gets taken off every measurement.
+ */
+bool PerfProfile::open()
+{
+    if (!m_counters.open()) {
+        std::cerr << "Failed to open any host performance counters!\n";
+        return false;
+    }
+    uint64_t a[NUM_PERF_EVENTS], b[NUM_PERF_EVENTS];
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        m_overhead[e] = UINT64_MAX;
+    }
+    for (int i = 0; i < 64; i++) {
+        m_counters.values(a);
+        m_counters.values(b);
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+            if (b[e] - a[e] < m_overhead[e])
+                m_overhead[e] = b[e] - a[e];
+        }
+    }
+    return true;
+}
+
+void PerfProfile::add(Bucket &b, uint64_t instrs)
+{
+    uint64_t now[NUM_PERF_EVENTS];
+    m_counters.values(now);
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        b.events[e] += now[e] - m_mark[e];
+    }
+    b.instrs += instrs;
+    b.reads++;
+}
+
+void PerfProfile::print_row(FILE *out, const char *name, const Bucket &b)
+{
+    std::fprintf(out, "%-14s %12llu", name, (unsigned long long)b.instrs);
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (!m_counters.available(e) || b.instrs == 0) {
+            std::fprintf(out, " %9s", "-");
+            continue;
+        }
+        double total = (double)b.events[e] - (double)m_overhead[e] * b.reads;
+        std::fprintf(out, " %9.2f", total > 0 ? total / b.instrs : 0.0);
+    }
+    std::fprintf(out, "\n");
+}
+
+/*
+ * One table, every counter divided by the emulated instructions it covers.
+ */
+void PerfProfile::report(FILE *out)
+{
+    std::fprintf(out, "Host counters per emulated instruction\n");
+    std::fprintf(out, "%-14s %12s", "", "emulated");
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        std::fprintf(out, " %9s", event_names[e]);
+    }
+    std::fprintf(out, "\n");
+    print_row(out, "engine fused", m_engines[ENGINE_FUSED]);
+    print_row(out, "engine plain", m_engines[ENGINE_PLAIN]);
+    for (int c = 0; c < PERF_CLASSES; c++) {
+        if (m_classes[c].instrs == 0)
+            continue;
+        char name[16];
+        std::snprintf(name, sizeof(name), "op %s", class_names[c]);
+        print_row(out, name, m_classes[c]);
+    }
+}
@@ -4,105 +4,64 @@
  * Travis Banken
  * 2020
  *
- * Peripherals. Handles drawing to the window and
- * key events.
+ * Peripherals. Holds the framebuffer, timer and key state, and hands
+ * frames to the frontend for drawing.
  */
 
 #include <cstdlib>
 #include <iostream>
+#include <cstring>
 #include <periphs.h>
 
-#define FRAME_HEIGHT 32
-#define FRAME_WIDTH 64
-
-Periphs::Periphs(const char *title, uint pxscale, uint clock_speed, bool max_clock)
-    : m_pxscale(pxscale), m_framebuf(FRAME_HEIGHT*FRAME_WIDTH), m_timer(0), 
-    m_clock_speed(clock_speed), m_max_clock(max_clock)
+Periphs::Periphs(Frontend *frontend)
+    : m_frontend(frontend), m_framebuf(FRAME_HEIGHT*FRAME_WIDTH), m_timer(0)
 {
-    int rc;
-
-    // init clock and last key press
-    m_last_tick = std::chrono::high_resolution_clock::now();
+    // init last key press
     m_last_keytime = std::chrono::high_resolution_clock::now();
     m_last_keycode = NO_KEY;
 
-    // init keymap, map keyboard from 0x0 to 0xF
-    m_keymap[SDLK_0] = 0;
-    m_keymap[SDLK_1] = 1;
-    m_keymap[SDLK_2] = 2;
-    m_keymap[SDLK_3] = 3;
-    m_keymap[SDLK_4] = 4;
-    m_keymap[SDLK_5] = 5;
-    m_keymap[SDLK_6] = 6;
-    m_keymap[SDLK_7] = 7;
-    m_keymap[SDLK_8] = 8;
-    m_keymap[SDLK_9] = 9;
-    // QWERTY style mapping
-    m_keymap[SDLK_q] = 10;
-    m_keymap[SDLK_w] = 11;
-    m_keymap[SDLK_e] = 12;
-    m_keymap[SDLK_r] = 13;
-    m_keymap[SDLK_t] = 14;
-    m_keymap[SDLK_y] = 15;
-    // ABCDEF style mapping
-    // m_keymap[SDLK_a] = 10;
-    // m_keymap[SDLK_b] = 11;
-    // m_keymap[SDLK_c] = 12;
-    // m_keymap[SDLK_d] = 13;
-    // m_keymap[SDLK_e] = 14;
-    // m_keymap[SDLK_f] = 15;
-
     std::fill(m_framebuf.begin(), m_framebuf.end(), 0);
+}
 
+void Periphs::reset()
+{
+    std::fill(m_framebuf.begin(), m_framebuf.end(), 0);
+    m_timer = 0;
+    m_keys = 0;
+    m_last_keycode = NO_KEY;
+}
 
-    // init sdl
-    rc = SDL_Init(SDL_INIT_VIDEO);
-    if (rc < 0) {
-        std::cerr << "Error: SDL_Init: " << SDL_GetError() << std::endl;
-        std::exit(1);
-    }
-
-    uint wh = scale(FRAME_HEIGHT);
-    uint ww = scale(FRAME_WIDTH);
-    // create window
-    m_window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                                ww, wh, SDL_WINDOW_SHOWN);
-    if (m_window == NULL) {
-        std::cerr << "Error: SDL_CreateWindow: " << SDL_GetError() << std::endl;
-        std::exit(1);
-    }
+void Periphs::save_state(State &s)
+{
+    std::memcpy(s.framebuf, m_framebuf.data(), sizeof(s.framebuf));
+    s.timer = m_timer;
+    s.keys = m_keys;
+    s.last_keycode = m_last_keycode;
+}
 
-    // create renderer
-    m_renderer = SDL_CreateRenderer(m_window, -1, 0);
-    if (m_renderer == NULL) {
-        std::cerr << "Error: SDL_CreateRenderer: " << SDL_GetError() << std::endl;
-        std::exit(1);
-    }
+void Periphs::load_state(const State &s)
+{
+    std::memcpy(m_framebuf.data(), s.framebuf, sizeof(s.framebuf));
+    m_timer = s.timer;
+    m_keys = s.keys;
+    m_last_keycode = s.last_keycode;
 }
 
-Periphs::~Periphs()
+/*
+ * The same as save_state() into child's state, without the copy between.
+ */
+void Periphs::fork(Periphs &child) const
 {
-    SDL_DestroyWindow(m_window);
-    SDL_DestroyRenderer(m_renderer);
-    SDL_Quit();
+    std::memcpy(child.m_framebuf.data(), m_framebuf.data(), m_framebuf.size());
+    child.m_timer = m_timer;
+    child.m_keys = m_keys;
+    child.m_last_keycode = m_last_keycode;
 }
 
 void Periphs::clear_screen()
 {
-    // call clear screen
-    SDL_RenderClear(m_renderer);
-
-    // fill screen black
-    SDL_SetRenderDrawColor(m_renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
-    SDL_Rect rectangle;
-    rectangle.x = 0;
-    rectangle.y = 0;
-    rectangle.w = scale(FRAME_WIDTH);
-    rectangle.h = scale(FRAME_HEIGHT);
-    SDL_RenderFillRect(m_renderer, &rectangle);
     // clear buf
     std::fill(m_framebuf.begin(), m_framebuf.end(), 0);
-    refresh();
 }
 
 bool Periphs::place_pixel(uint8_t x, uint8_t y, uint8_t pixval)
@@ -126,91 +85,72 @@ bool Periphs::place_pixel(uint8_t x, uint8_t y, uint8_t pixval)
     return collision;
 }
 
-void Periphs::render_all()
-{
-    for (size_t i = 0; i < m_framebuf.size(); i++) {
-        uint8_t x = i % FRAME_WIDTH;
-        uint8_t y = i / FRAME_WIDTH;
-        uint8_t px = m_framebuf[i];
-
-        uint8_t col = px ? 0xFF : 0x00;
-        SDL_SetRenderDrawColor(m_renderer, col, col, col, SDL_ALPHA_OPAQUE);
-        SDL_Rect rectangle;
-
-        rectangle.x = scale(x);
-        rectangle.y = scale(y);
-        rectangle.w = scale(1);
-        rectangle.h = scale(1);
-        SDL_RenderFillRect(m_renderer, &rectangle);
-    }
-}
-
+/*
+ * Once per frame: take input, then draw and show the frame.
+ */
 void Periphs::refresh()
 {
-    poll_quit();
-    SDL_RenderClear(m_renderer);
-    render_all();
-    SDL_RenderPresent(m_renderer);
-    int rc = SDL_SetRenderDrawColor(m_renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
-    if (rc != 0) {
-        std::cerr << "Error: Failed to set Renderer Draw Color\n";
-        exit(1);
-    }
-    update_timer();
-    // some primative timing trick
-    if (!m_max_clock) {
-        m_clock++;
-        if (m_clock > (15 + (3*(m_clock_speed - 5)))) {
-            SDL_Delay(16);
-            m_clock = 0;
-        }
-    }
-    get_keystate();
+    poll_input();
+    draw();
 }
 
-void Periphs::poll_quit()
+/*
+ * Draw and show the framebuffer as it is now.
+ */
+void Periphs::draw()
 {
-    SDL_Event e;
-    if (SDL_PollEvent(&e)) {
-        if (e.type == SDL_QUIT) {
-            std::exit(0);
-        }
-    }
+    if (headless())
+        return;
+    m_frontend->render(m_framebuf);
+    m_stats.render_done();
+    m_frontend->render_hud(m_show_hud ? m_stats.hud_text() : nullptr);
+    m_frontend->present();
+    m_stats.present_done();
 }
 
-uint8_t Periphs::await_keypress()
+/*
+ * Draw and show a framebuffer of another size, for the extended machines.
+ * A frontend that only takes FRAME_WIDTH x FRAME_HEIGHT gets it shrunk, a
+ * pixel lit where any pixel of its block is.
+ */
+void Periphs::draw_screen(const uint8_t *pixels, uint w, uint h)
 {
-    uint8_t res;
-    m_last_keycode = NO_KEY;
-    while (true) {
-        res = get_keystate();
-        if (res != NO_KEY)
-            return res;
+    if (headless())
+        return;
+    if (!m_frontend->render_screen(pixels, w, h)) {
+        m_shrunk.resize(FRAME_WIDTH*FRAME_HEIGHT);
+        std::fill(m_shrunk.begin(), m_shrunk.end(), 0);
+        for (uint y = 0; y < h; y++) {
+            for (uint x = 0; x < w; x++) {
+                if (pixels[y*w + x])
+                    m_shrunk[(y*FRAME_HEIGHT/h)*FRAME_WIDTH + x*FRAME_WIDTH/w] = 1;
+            }
+        }
+        m_frontend->render(m_shrunk);
     }
-    return NO_KEY;
+    m_stats.render_done();
+    m_frontend->render_hud(m_show_hud ? m_stats.hud_text() : nullptr);
+    m_frontend->present();
+    m_stats.present_done();
 }
 
 /*
- * Get current keystate of the keys. Sticky keys are enabled to help with input 
- * lag.
+ * Drain key presses from the frontend. Sticky keys are enabled to help with
+ * input lag: a press is held for up to 300ms.
  */
-uint8_t Periphs::get_keystate()
+void Periphs::poll_input()
 {
-    SDL_Event e;
-    SDL_Keycode keycode;
-    if (SDL_PollEvent(&e)) {
-        switch(e.type) {
-        case SDL_QUIT:
-            std::exit(0);
-            break;
-        case SDL_KEYDOWN:
-            keycode = e.key.keysym.sym;
-            auto it = m_keymap.find(keycode);
-            if (it != m_keymap.end()) {
-                m_last_keycode = m_keymap[keycode];
-                return m_last_keycode;
-            }
-            break;
+    if (headless())
+        return;
+    uint8_t key;
+    while ((key = m_frontend->poll_key()) != NO_KEY) {
+        if (key == KEY_HUD) {
+            m_show_hud = !m_show_hud;
+        } else if (key == KEY_FAST_FORWARD) {
+            m_fast_forward = !m_fast_forward;
+        } else if (key < 16) {
+            m_last_keycode = key;
+            m_keys = 1 << key;
         }
     }
     // if enough time passed, reset last keycode
@@ -220,19 +160,50 @@ uint8_t Periphs::get_keystate()
     if (milliseconds > 300) {
         m_last_keytime = now;
         m_last_keycode = NO_KEY;
+        m_keys = 0;
     }
-    return m_last_keycode;
 }
 
-void Periphs::update_timer()
+/*
+ * Called when FX0A starts waiting. With a frontend the sticky key from an
+ * earlier press is dropped so the wait needs a fresh press.
+ */
+void Periphs::begin_key_wait()
 {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto elapsed = now - m_last_tick;
-    long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
-    if (microseconds >= (long long)(1000000 / 60)) {
-        m_timer -= m_timer == 0 ? 0 : 1;
-        m_last_tick = std::chrono::high_resolution_clock::now();
+    if (headless())
+        return;
+    m_last_keycode = NO_KEY;
+    m_keys = 0;
+}
+
+/*
+ * Never blocks, returns NO_KEY when nothing is held and the caller retries.
+ */
+uint8_t Periphs::await_keypress()
+{
+    return get_keystate();
+}
+
+/*
+ * Get current keystate of the keys, the lowest held key.
+ */
+uint8_t Periphs::get_keystate()
+{
+    for (uint8_t k = 0; k < 16; k++) {
+        if ((m_keys >> k) & 0x1)
+            return k;
     }
+    return NO_KEY;
+}
+
+bool Periphs::key_pressed(uint8_t key)
+{
+    return key < 16 && ((m_keys >> key) & 0x1);
+}
+
+void Periphs::set_keys(uint16_t keys)
+{
+    m_keys = keys;
 }
 
 void Periphs::set_timer(uint8_t ticks)
@@ -245,7 +216,7 @@ uint8_t Periphs::get_timer()
     return m_timer;
 }
 
-uint Periphs::scale(uint x)
+void Periphs::tick_timer()
 {
-    return x * m_pxscale;
+    m_timer -= m_timer == 0 ? 0 : 1;
 }
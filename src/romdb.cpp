@@ -0,0 +1,241 @@
+/*
+ * romdb.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Per-rom settings database, written by chip8-probe and read at startup.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <romdb.h>
+#include <quirks.h>
+
+// in bit order
+static const char *quirk_names[NUM_QUIRKS] = {
+    "shift_vy", "keep_i", "jump_vx", "vf_reset", "clip", "keep_vf",
+};
+
+/*
+ * 64 bit FNV-1a, enough to tell a few thousand roms apart.
+ */
+uint64_t rom_hash(const uint8_t *rom, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= rom[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string format_quirks(uint8_t quirks)
+{
+    if (quirks == 0)
+        return "none";
+    std::string text;
+    for (int i = 0; i < NUM_QUIRKS; i++) {
+        if (!((quirks >> i) & 0x1))
+            continue;
+        if (!text.empty())
+            text += ",";
+        text += quirk_names[i];
+    }
+    return text;
+}
+
+bool parse_quirks(const std::string &text, uint8_t &quirks)
+{
+    quirks = 0;
+    if (text == "none")
+        return true;
+    std::stringstream ss(text);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        int i = 0;
+        while (i < NUM_QUIRKS && name != quirk_names[i])
+            i++;
+        if (i == NUM_QUIRKS)
+            return false;
+        quirks |= 1 << i;
+    }
+    return true;
+}
+
+/*
+ * 16 different keys, one per keypad key 0-F in order, from [0-9a-z] so both
+ * frontends can read them as typed characters.
+ */
+bool valid_keymap(const std::string &keys)
+{
+    if (keys.size() != 16)
+        return false;
+    for (size_t i = 0; i < keys.size(); i++) {
+        char c = keys[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')))
+            return false;
+        if (keys.find(c, i + 1) != std::string::npos)
+            return false;
+    }
+    return true;
+}
+
+std::string format_palette(uint32_t fg, uint32_t bg)
+{
+    char text[16];
+    std::snprintf(text, sizeof(text), "%06x,%06x", fg & 0xFFFFFF, bg & 0xFFFFFF);
+    return text;
+}
+
+/*
+ * "RRGGBB,RRGGBB", lit pixels then background.
+ */
+bool parse_palette(const std::string &text, uint32_t &fg, uint32_t &bg)
+{
+    if (text.size() != 13 || text[6] != ',')
+        return false;
+    char *end;
+    std::string a = text.substr(0, 6);
+    std::string b = text.substr(7);
+    if (a.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos
+        || b.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+        return false;
+    fg = std::strtoul(a.c_str(), &end, 16);
+    bg = std::strtoul(b.c_str(), &end, 16);
+    return true;
+}
+
+/*
+ * $XDG_CONFIG_HOME/chip8/romdb, or ~/.config/chip8/romdb
+ */
+std::string RomDb::default_path()
+{
+    const char *config = std::getenv("XDG_CONFIG_HOME");
+    if (config != NULL && *config)
+        return std::string(config) + "/chip8/romdb";
+    const char *home = std::getenv("HOME");
+    if (home == NULL)
+        return "romdb";
+    return std::string(home) + "/.config/chip8/romdb";
+}
+
+/*
+ * Returns false if the file can't be read. Lines that don't parse are
+ * skipped with a warning.
+ */
+bool RomDb::load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        RomDbEntry entry;
+        size_t hashmark = line.find('#');
+        if (hashmark != std::string::npos) {
+            size_t start = line.find_first_not_of(" \t", hashmark + 1);
+            if (start != std::string::npos)
+                entry.comment = line.substr(start);
+            line.erase(hashmark);
+        }
+
+        std::stringstream ss(line);
+        std::string word;
+        if (!(ss >> word))
+            continue;
+        char *end;
+        uint64_t hash = std::strtoull(word.c_str(), &end, 16);
+        bool ok = *end == '\0' && word.size() == 16;
+        while (ok && ss >> word) {
+            size_t eq = word.find('=');
+            if (eq == std::string::npos) {
+                ok = false;
+                break;
+            }
+            std::string key = word.substr(0, eq);
+            std::string val = word.substr(eq + 1);
+            if (key == "ipf") {
+                entry.ipf = std::strtoul(val.c_str(), &end, 10);
+                ok = *end == '\0' && !val.empty();
+            } else if (key == "quirks") {
+                ok = parse_quirks(val, entry.quirks);
+            } else if (key == "keys") {
+                entry.keymap = val;
+                ok = valid_keymap(val);
+            } else if (key == "palette") {
+                ok = entry.palette = parse_palette(val, entry.fg, entry.bg);
+            } else {
+                entry.extra += entry.extra.empty() ? word : " " + word;
+            }
+        }
+        if (!ok) {
+            std::cerr << "Warning: " << path << ":" << lineno << ": bad rom entry, skipped\n";
+            continue;
+        }
+        m_entries[hash] = entry;
+    }
+    return true;
+}
+
+/*
+ * Writes to a temporary file and renames it over the old one, so a reader
+ * never sees half a database. Creates the directory if it is missing.
+ */
+bool RomDb::save(const std::string &path) const
+{
+    size_t slash = path.rfind('/');
+    if (slash != std::string::npos && slash > 0)
+        mkdir(path.substr(0, slash).c_str(), 0755);
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open " << tmp << " for writing!\n";
+        return false;
+    }
+    out << "# chip8 rom database: <rom hash> key=value ... # name\n";
+    for (const auto &it : m_entries) {
+        const RomDbEntry &e = it.second;
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016" PRIx64, it.first);
+        out << hash;
+        if (e.ipf)
+            out << " ipf=" << e.ipf;
+        out << " quirks=" << format_quirks(e.quirks);
+        if (!e.keymap.empty())
+            out << " keys=" << e.keymap;
+        if (e.palette)
+            out << " palette=" << format_palette(e.fg, e.bg);
+        if (!e.extra.empty())
+            out << " " << e.extra;
+        if (!e.comment.empty())
+            out << " # " << e.comment;
+        out << "\n";
+    }
+    out.close();
+    if (out.fail() || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write " << path << "!\n";
+        return false;
+    }
+    return true;
+}
+
+const RomDbEntry *RomDb::find(uint64_t hash) const
+{
+    auto it = m_entries.find(hash);
+    return it == m_entries.end() ? nullptr : &it->second;
+}
+
+void RomDb::set(uint64_t hash, const RomDbEntry &entry)
+{
+    m_entries[hash] = entry;
+}
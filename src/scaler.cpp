@@ -0,0 +1,309 @@
+/*
+ * scaler.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * CPU upscaling of the framebuffer: nearest, Scale2x (EPX) and scanlines,
+ * with AVX2 and scalar versions of each step.
+ */
+
+#include <cstring>
+#include <scaler.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// scale2x_avx2's bordered copy of a w x h input
+#define SCALE2X_PAD_SIZE(w, h) (((w) + 64) * ((h) + 2))
+
+// *** scalar ***
+
+/*
+ * One output row: dst[x] comes from src[x * src_w / dst_w].
+ */
+static void expand_row_scalar(const uint8_t *src, uint src_w, uint32_t *dst, uint dst_w,
+                              uint32_t on, uint32_t off)
+{
+    for (uint x = 0; x < dst_w; x++) {
+        dst[x] = src[x * src_w / dst_w] ? on : off;
+    }
+}
+
+/*
+ * EPX on the 0/1 framebuffer, to twice the width and height. Past the edges
+ * counts as the pixel itself.
+ */
+static void scale2x_scalar(const uint8_t *src, uint8_t *dst, uint w, uint h)
+{
+    for (uint y = 0; y < h; y++) {
+        const uint8_t *row = src + y*w;
+        const uint8_t *up = y > 0 ? row - w : row;
+        const uint8_t *down = y + 1 < h ? row + w : row;
+        uint8_t *out0 = dst + (2*y) * (2*w);
+        uint8_t *out1 = out0 + 2*w;
+        for (uint x = 0; x < w; x++) {
+            uint8_t p = row[x];
+            uint8_t a = up[x];
+            uint8_t d = down[x];
+            uint8_t c = x > 0 ? row[x-1] : p;
+            uint8_t b = x + 1 < w ? row[x+1] : p;
+            out0[2*x]   = (c == a && c != d && a != b) ? a : p;
+            out0[2*x+1] = (a == b && a != c && b != d) ? b : p;
+            out1[2*x]   = (d == c && d != b && c != a) ? c : p;
+            out1[2*x+1] = (b == d && b != a && d != c) ? d : p;
+        }
+    }
+}
+
+// *** AVX2 ***
+
+#ifdef HAVE_X86
+
+/*
+ * Colours for the source row first, then each 8 output pixels are one
+ * permute of the 8 source colours starting at base.
+ */
+__attribute__((target("avx2")))
+static void expand_row_avx2(const uint8_t *src, uint src_w, uint32_t *dst, uint dst_w,
+                            uint32_t on, uint32_t off, const uint16_t *base,
+                            const int32_t *perm)
+{
+    alignas(32) uint32_t colors[2*SCALER_MAX_WIDTH + 8];
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i von = _mm256_set1_epi32(on);
+    const __m256i voff = _mm256_set1_epi32(off);
+    for (uint x = 0; x < src_w; x += 8) {
+        __m128i px = _mm_loadl_epi64((const __m128i *)(src + x));
+        __m256i lit = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(px), zero);
+        _mm256_store_si256((__m256i *)(colors + x), _mm256_blendv_epi8(voff, von, lit));
+    }
+    // the last permute may load past the row, it never picks those
+    _mm256_store_si256((__m256i *)(colors + src_w), voff);
+
+    for (uint x = 0, i = 0; x < dst_w; x += 8, i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(colors + base[i]));
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(perm + 8*i));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_permutevar8x32_epi32(v, idx));
+    }
+}
+
+/*
+ * Same as scale2x_scalar, 32 pixels at a time. Works on a copy with a one
+ * pixel border so neighbours are plain unaligned loads, made in pad.
+ */
+__attribute__((target("avx2")))
+static void scale2x_avx2(const uint8_t *src, uint8_t *dst, uint w, uint h, uint8_t *pad)
+{
+    // 32 bytes either side keeps the neighbour loads in bounds
+    const uint pw = w + 64;
+    for (uint y = 0; y < h + 2; y++) {
+        uint sy = y == 0 ? 0 : (y > h ? h - 1 : y - 1);
+        uint8_t *row = &pad[y*pw];
+        std::memcpy(row + 32, src + sy*w, w);
+        row[31] = row[32];
+        row[32 + w] = row[31 + w];
+    }
+
+    for (uint y = 0; y < h; y++) {
+        const uint8_t *row = &pad[(y+1)*pw + 32];
+        uint8_t *out0 = dst + (2*y) * (2*w);
+        uint8_t *out1 = out0 + 2*w;
+        for (uint x = 0; x < w; x += 32) {
+            __m256i p = _mm256_loadu_si256((const __m256i *)(row + x));
+            __m256i a = _mm256_loadu_si256((const __m256i *)(row - pw + x));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(row + pw + x));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(row + x - 1));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(row + x + 1));
+            __m256i ca = _mm256_cmpeq_epi8(c, a);
+            __m256i ab = _mm256_cmpeq_epi8(a, b);
+            __m256i dc = _mm256_cmpeq_epi8(d, c);
+            __m256i bd = _mm256_cmpeq_epi8(b, d);
+            // x == y && x != z  ->  andnot(eq(x, z), eq(x, y))
+            __m256i m1 = _mm256_andnot_si256(_mm256_or_si256(dc, ab), ca);
+            __m256i m2 = _mm256_andnot_si256(_mm256_or_si256(ca, bd), ab);
+            __m256i m3 = _mm256_andnot_si256(_mm256_or_si256(bd, ca), dc);
+            __m256i m4 = _mm256_andnot_si256(_mm256_or_si256(ab, dc), bd);
+            __m256i e1 = _mm256_blendv_epi8(p, a, m1);
+            __m256i e2 = _mm256_blendv_epi8(p, b, m2);
+            __m256i e3 = _mm256_blendv_epi8(p, c, m3);
+            __m256i e4 = _mm256_blendv_epi8(p, d, m4);
+            // interleave, unpack works per 128 bit lane so put lanes back after
+            __m256i lo = _mm256_unpacklo_epi8(e1, e2);
+            __m256i hi = _mm256_unpackhi_epi8(e1, e2);
+            _mm256_storeu_si256((__m256i *)(out0 + 2*x), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(out0 + 2*x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+            lo = _mm256_unpacklo_epi8(e3, e4);
+            hi = _mm256_unpackhi_epi8(e3, e4);
+            _mm256_storeu_si256((__m256i *)(out1 + 2*x), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(out1 + 2*x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+    }
+}
+
+bool cpu_has_avx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool cpu_has_avx2()
+{
+    return false;
+}
+
+#endif
+
+// *** Scaler ***
+
+Scaler::Scaler(uint scale, ScaleFilter filter, bool allow_avx2, uint in_w, uint in_h)
+    : m_scale(scale), m_filter(filter), m_avx2(allow_avx2 && cpu_has_avx2()), m_in_w(in_w),
+      m_in_h(in_h)
+{
+    // scale2x needs room to show its extra detail
+    if (m_filter == FILTER_SCALE2X && m_scale < 2)
+        m_filter = FILTER_NEAREST;
+    m_src_w = m_in_w;
+    m_src_h = m_in_h;
+    if (m_filter == FILTER_SCALE2X) {
+        m_src_w *= 2;
+        m_src_h *= 2;
+        m_epx.resize(m_src_w * m_src_h);
+        if (m_avx2)
+            m_pad.resize(SCALE2X_PAD_SIZE(m_in_w, m_in_h));
+    }
+
+    uint w = width();
+    for (uint x = 0; x < w; x += 8) {
+        uint base = x * m_src_w / w;
+        m_base.push_back(base);
+        for (uint k = 0; k < 8; k++) {
+            m_perm.push_back((x + k) * m_src_w / w - base);
+        }
+    }
+
+    m_split = height();
+    if (m_scale >= SCALER_THREAD_SCALE && std::thread::hardware_concurrency() > 1) {
+        m_split = height() / 2;
+        m_worker = std::thread(&Scaler::work, this);
+    }
+}
+
+Scaler::~Scaler()
+{
+    if (m_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_quit = true;
+        }
+        m_cv.notify_all();
+        m_worker.join();
+    }
+}
+
+void Scaler::set_palette(uint32_t on, uint32_t off)
+{
+    m_on = on;
+    m_off = off;
+    m_dim = 0xFF000000 | ((on >> 1) & 0x7F7F7F);
+}
+
+/*
+ * Scanlines: the bottom quarter of each scaled row (at least one line).
+ */
+bool Scaler::dim_row(uint y)
+{
+    if (m_filter != FILTER_SCANLINES || m_scale < 2)
+        return false;
+    uint lines = m_scale / 4 ? m_scale / 4 : 1;
+    return y % m_scale >= m_scale - lines;
+}
+
+void Scaler::scale_rows(const uint8_t *src, uint32_t *dst, size_t pitch, uint begin, uint end)
+{
+    uint w = width();
+    uint h = height();
+    uint y = begin;
+    while (y < end) {
+        uint sy = y * m_src_h / h;
+        bool dim = dim_row(y);
+        uint32_t *out = dst + y*pitch;
+        uint32_t on = dim ? m_dim : m_on;
+#ifdef HAVE_X86
+        if (m_avx2)
+            expand_row_avx2(src + sy*m_src_w, m_src_w, out, w, on, m_off, m_base.data(),
+                            m_perm.data());
+        else
+#endif
+            expand_row_scalar(src + sy*m_src_w, m_src_w, out, w, on, m_off);
+        // rows from the same source row look the same, copy them
+        for (y++; y < end && y * m_src_h / h == sy && dim_row(y) == dim; y++) {
+            std::memcpy(dst + y*pitch, out, w * sizeof(uint32_t));
+        }
+    }
+}
+
+void Scaler::scale(const uint8_t *framebuf, uint32_t *dst, size_t pitch)
+{
+    const uint8_t *src = framebuf;
+    if (m_filter == FILTER_SCALE2X) {
+#ifdef HAVE_X86
+        if (m_avx2)
+            scale2x_avx2(framebuf, m_epx.data(), m_in_w, m_in_h, m_pad.data());
+        else
+#endif
+            scale2x_scalar(framebuf, m_epx.data(), m_in_w, m_in_h);
+        src = m_epx.data();
+    }
+
+    if (!m_worker.joinable()) {
+        scale_rows(src, dst, pitch, 0, height());
+        return;
+    }
+
+    uint64_t job;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_src = src;
+        m_dst = dst;
+        m_pitch = pitch;
+        job = ++m_job;
+    }
+    m_cv.notify_all();
+    scale_rows(src, dst, pitch, 0, m_split);
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_cv.wait(guard, [&]() { return m_job_done == job; });
+}
+
+void Scaler::work()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(m_lock);
+    while (true) {
+        m_cv.wait(guard, [&]() { return m_quit || m_job != seen; });
+        if (m_quit)
+            return;
+        seen = m_job;
+        guard.unlock();
+        scale_rows(m_src, m_dst, m_pitch, m_split, height());
+        guard.lock();
+        m_job_done = seen;
+        m_cv.notify_all();
+    }
+}
+
+bool parse_filter(const char *name, ScaleFilter &filter)
+{
+    if (std::strcmp(name, "nearest") == 0)
+        filter = FILTER_NEAREST;
+    else if (std::strcmp(name, "scale2x") == 0 || std::strcmp(name, "epx") == 0)
+        filter = FILTER_SCALE2X;
+    else if (std::strcmp(name, "scanlines") == 0)
+        filter = FILTER_SCANLINES;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,256 @@
+/*
+ * sdl_frontend.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * SDL2 frontend. Draws the framebuffer to a window and reads key events.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sdl_frontend.h>
+
+// 3x5 font for the HUD, one row per byte, low 3 bits used (msb is left)
+static const char hud_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.-:";
+static const uint8_t hud_font[][5] = {
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7}, // 0-3
+    {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1}, // 4-7
+    {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7},                                   // 8-9
+    {2, 5, 7, 5, 5}, {6, 5, 6, 5, 6}, {3, 4, 4, 4, 3}, {6, 5, 5, 5, 6}, // A-D
+    {7, 4, 6, 4, 7}, {7, 4, 6, 4, 4}, {3, 4, 5, 5, 3}, {5, 5, 7, 5, 5}, // E-H
+    {7, 2, 2, 2, 7}, {1, 1, 1, 5, 2}, {5, 5, 6, 5, 5}, {4, 4, 4, 4, 7}, // I-L
+    {5, 7, 7, 5, 5}, {6, 5, 5, 5, 5}, {2, 5, 5, 5, 2}, {6, 5, 6, 4, 4}, // M-P
+    {2, 5, 5, 6, 3}, {6, 5, 6, 5, 5}, {3, 4, 2, 1, 6}, {7, 2, 2, 2, 2}, // Q-T
+    {5, 5, 5, 5, 7}, {5, 5, 5, 5, 2}, {5, 5, 7, 7, 5}, {5, 5, 2, 5, 5}, // U-X
+    {5, 5, 2, 2, 2}, {7, 1, 2, 4, 7},                                   // Y-Z
+    {0, 0, 0, 0, 2}, {0, 0, 7, 0, 0}, {0, 2, 0, 2, 0},                  // . - :
+};
+
+/*
+ * Keyboard to keypad, shared with the mosaic monitor. keys has the host key
+ * for each keypad key 0-F; SDL keycodes for digits and letters are the
+ * characters themselves.
+ */
+std::map<SDL_Keycode, uint8_t> sdl_keymap(const std::string &keys)
+{
+    std::map<SDL_Keycode, uint8_t> keymap;
+    for (size_t i = 0; i < keys.size() && i < 16; i++) {
+        keymap[(SDL_Keycode)keys[i]] = i;
+    }
+    keymap[SDLK_F1] = KEY_HUD;
+    keymap[SDLK_TAB] = KEY_FAST_FORWARD;
+    return keymap;
+}
+
+SdlFrontend::SdlFrontend(const char *title, uint pxscale, ScaleFilter filter)
+    : m_pxscale(pxscale), m_filter(filter), m_scaler(pxscale, filter)
+{
+    int rc;
+
+    m_keymap = sdl_keymap();
+
+    // init sdl
+    rc = SDL_Init(SDL_INIT_VIDEO);
+    if (rc < 0) {
+        std::cerr << "Error: SDL_Init: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+
+    uint wh = scale(FRAME_HEIGHT);
+    uint ww = scale(FRAME_WIDTH);
+    // create window
+    m_window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                ww, wh, SDL_WINDOW_SHOWN);
+    if (m_window == NULL) {
+        std::cerr << "Error: SDL_CreateWindow: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+
+    // create renderer
+    m_renderer = SDL_CreateRenderer(m_window, -1, 0);
+    if (m_renderer == NULL) {
+        std::cerr << "Error: SDL_CreateRenderer: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+
+    // the scaler fills this every frame
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                  SDL_TEXTUREACCESS_STREAMING, ww, wh);
+    if (m_texture == NULL) {
+        std::cerr << "Error: SDL_CreateTexture: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+}
+
+SdlFrontend::~SdlFrontend()
+{
+    if (m_ext_texture != NULL)
+        SDL_DestroyTexture(m_ext_texture);
+    SDL_DestroyTexture(m_texture);
+    SDL_DestroyRenderer(m_renderer);
+    SDL_DestroyWindow(m_window);
+    SDL_Quit();
+}
+
+void SdlFrontend::render(const std::vector<uint8_t> &framebuf)
+{
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(m_texture, NULL, &pixels, &pitch) != 0) {
+        std::cerr << "Error: SDL_LockTexture: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+    m_scaler.scale(framebuf.data(), (uint32_t *)pixels, pitch / sizeof(uint32_t));
+    SDL_UnlockTexture(m_texture);
+    SDL_RenderCopy(m_renderer, m_texture, NULL, NULL);
+}
+
+/*
+ * Screens of the extended machines get their own scaler and texture, at the
+ * scale that fills the same window (stretched if it doesn't divide).
+ */
+bool SdlFrontend::render_screen(const uint8_t *pixels, uint w, uint h)
+{
+    if (w > SCALER_MAX_WIDTH)
+        return false;
+    if (w != m_ext_w || h != m_ext_h) {
+        uint s = m_pxscale * FRAME_WIDTH / w;
+        m_ext_scaler.reset(new Scaler(s ? s : 1, m_filter, true, w, h));
+        m_ext_scaler->set_palette(m_on, m_off);
+        if (m_ext_texture != NULL)
+            SDL_DestroyTexture(m_ext_texture);
+        m_ext_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STREAMING, m_ext_scaler->width(),
+                                          m_ext_scaler->height());
+        if (m_ext_texture == NULL) {
+            std::cerr << "Error: SDL_CreateTexture: " << SDL_GetError() << std::endl;
+            std::exit(1);
+        }
+        m_ext_w = w;
+        m_ext_h = h;
+    }
+
+    void *dst;
+    int pitch;
+    if (SDL_LockTexture(m_ext_texture, NULL, &dst, &pitch) != 0) {
+        std::cerr << "Error: SDL_LockTexture: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+    m_ext_scaler->scale(pixels, (uint32_t *)dst, pitch / sizeof(uint32_t));
+    SDL_UnlockTexture(m_ext_texture);
+    SDL_RenderCopy(m_renderer, m_ext_texture, NULL, NULL);
+    return true;
+}
+
+void SdlFrontend::render_hud(const char *text)
+{
+    if (text == nullptr)
+        return;
+
+    int px = m_pxscale / 4 ? m_pxscale / 4 : 1;
+    int lines = 1;
+    int longest = 0;
+    int len = 0;
+    for (const char *c = text; *c; c++) {
+        if (*c == '\n') {
+            lines++;
+            len = 0;
+        } else if (++len > longest) {
+            longest = len;
+        }
+    }
+
+    // dim box behind the text
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(m_renderer, 0x00, 0x00, 0x00, 0xC0);
+    SDL_Rect box;
+    box.x = 0;
+    box.y = 0;
+    box.w = (longest*4 + 2) * px;
+    box.h = (lines*6 + 2) * px;
+    SDL_RenderFillRect(m_renderer, &box);
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
+
+    SDL_SetRenderDrawColor(m_renderer, 0x40, 0xFF, 0x40, SDL_ALPHA_OPAQUE);
+    draw_text(text, px, px, px);
+}
+
+void SdlFrontend::draw_text(const char *text, int x, int y, int px)
+{
+    int cx = x;
+    for (const char *c = text; *c; c++) {
+        if (*c == '\n') {
+            cx = x;
+            y += 6*px;
+            continue;
+        }
+        const char *glyph = std::strchr(hud_chars, *c);
+        if (*c != ' ' && glyph != NULL) {
+            const uint8_t *rows = hud_font[glyph - hud_chars];
+            for (int row = 0; row < 5; row++) {
+                for (int col = 0; col < 3; col++) {
+                    if (!((rows[row] >> (2 - col)) & 0x1))
+                        continue;
+                    SDL_Rect r;
+                    r.x = cx + col*px;
+                    r.y = y + row*px;
+                    r.w = px;
+                    r.h = px;
+                    SDL_RenderFillRect(m_renderer, &r);
+                }
+            }
+        }
+        cx += 4*px;
+    }
+}
+
+void SdlFrontend::present()
+{
+    SDL_RenderPresent(m_renderer);
+    int rc = SDL_SetRenderDrawColor(m_renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
+    if (rc != 0) {
+        std::cerr << "Error: Failed to set Renderer Draw Color\n";
+        exit(1);
+    }
+}
+
+void SdlFrontend::set_keymap(const std::string &keys)
+{
+    m_keymap = sdl_keymap(keys);
+}
+
+void SdlFrontend::set_palette(uint32_t fg, uint32_t bg)
+{
+    m_on = 0xFF000000 | fg;
+    m_off = 0xFF000000 | bg;
+    m_scaler.set_palette(m_on, m_off);
+    if (m_ext_scaler)
+        m_ext_scaler->set_palette(m_on, m_off);
+}
+
+uint8_t SdlFrontend::poll_key()
+{
+    SDL_Event e;
+    SDL_Keycode keycode;
+    while (SDL_PollEvent(&e)) {
+        switch(e.type) {
+        case SDL_QUIT:
+            std::exit(0);
+            break;
+        case SDL_KEYDOWN:
+            keycode = e.key.keysym.sym;
+            auto it = m_keymap.find(keycode);
+            if (it != m_keymap.end())
+                return it->second;
+            break;
+        }
+    }
+    return NO_KEY;
+}
+
+uint SdlFrontend::scale(uint x)
+{
+    return x * m_pxscale;
+}
@@ -0,0 +1,181 @@
+/*
+ * sdl_mosaic.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * SDL2 monitor that tiles the screens of many machines into one window.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <sdl_frontend.h>
+#include <sdl_mosaic.h>
+
+// the grid is scaled to fit in about this much screen
+#define MOSAIC_MAX_W 1600
+#define MOSAIC_MAX_H 900
+#define MOSAIC_MAX_TILE_SCALE 8
+
+#define BORDER_COLOR 0xFF303030
+#define FOCUS_COLOR  0xFF40FF40
+#define FAULT_COLOR  0xFFFF4040
+#define UNDRAWN 1 // odd, no published sequence is
+
+SdlMosaic::SdlMosaic(Mosaic &board, const char *title, uint max_fps)
+    : m_board(board), m_max_fps(max_fps ? max_fps : 1), m_seen(board.size(), UNDRAWN)
+{
+    m_keymap = sdl_keymap();
+
+    m_cols = std::ceil(std::sqrt((double)board.size()));
+    if (m_cols == 0)
+        m_cols = 1;
+    m_rows = (board.size() + m_cols - 1) / m_cols;
+    if (m_rows == 0)
+        m_rows = 1;
+    uint fit_w = MOSAIC_MAX_W / (m_cols * (FRAME_WIDTH + 2*MOSAIC_BORDER));
+    uint fit_h = MOSAIC_MAX_H / (m_rows * (FRAME_HEIGHT + 2*MOSAIC_BORDER));
+    m_tile_scale = std::min(std::min(fit_w, fit_h), (uint)MOSAIC_MAX_TILE_SCALE);
+    if (m_tile_scale == 0)
+        m_tile_scale = 1;
+    m_tile_w = FRAME_WIDTH*m_tile_scale + 2*MOSAIC_BORDER;
+    m_tile_h = FRAME_HEIGHT*m_tile_scale + 2*MOSAIC_BORDER;
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        std::cerr << "Error: SDL_Init: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+    uint ww = m_cols * m_tile_w;
+    uint wh = m_rows * m_tile_h;
+    m_window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                ww, wh, SDL_WINDOW_SHOWN);
+    if (m_window == NULL) {
+        std::cerr << "Error: SDL_CreateWindow: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+    m_renderer = SDL_CreateRenderer(m_window, -1, 0);
+    if (m_renderer == NULL) {
+        std::cerr << "Error: SDL_CreateRenderer: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                  SDL_TEXTUREACCESS_STREAMING, ww, wh);
+    if (m_texture == NULL) {
+        std::cerr << "Error: SDL_CreateTexture: " << SDL_GetError() << std::endl;
+        std::exit(1);
+    }
+}
+
+SdlMosaic::~SdlMosaic()
+{
+    SDL_DestroyTexture(m_texture);
+    SDL_DestroyRenderer(m_renderer);
+    SDL_DestroyWindow(m_window);
+    SDL_Quit();
+}
+
+void SdlMosaic::run()
+{
+    typedef std::chrono::steady_clock clock;
+    const clock::duration period = std::chrono::microseconds(1000000 / m_max_fps);
+    clock::time_point next = clock::now();
+    while (handle_events()) {
+        draw();
+        next += period;
+        clock::time_point now = clock::now();
+        if (next < now)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+/*
+ * Only tiles that published something since the last draw get uploaded.
+ */
+void SdlMosaic::draw()
+{
+    std::vector<uint32_t> tile(m_tile_w * m_tile_h);
+    for (size_t slot = 0; slot < m_board.size(); slot++) {
+        uint64_t rows[FRAME_HEIGHT];
+        uint32_t seq = m_board.snapshot(slot, rows);
+        if (seq == m_seen[slot])
+            continue;
+        m_seen[slot] = seq;
+
+        uint32_t border = slot == m_focus ? FOCUS_COLOR
+                        : m_board.faulted(slot) ? FAULT_COLOR : BORDER_COLOR;
+        std::fill(tile.begin(), tile.end(), border);
+        for (uint y = 0; y < FRAME_HEIGHT*m_tile_scale; y++) {
+            uint64_t bits = rows[y / m_tile_scale];
+            uint32_t *out = &tile[(y + MOSAIC_BORDER)*m_tile_w + MOSAIC_BORDER];
+            for (uint x = 0; x < FRAME_WIDTH*m_tile_scale; x++) {
+                bool lit = (bits >> (FRAME_WIDTH - 1 - x / m_tile_scale)) & 0x1;
+                out[x] = lit ? 0xFFFFFFFF : 0xFF000000;
+            }
+        }
+
+        SDL_Rect rect;
+        rect.x = (slot % m_cols) * m_tile_w;
+        rect.y = (slot / m_cols) * m_tile_h;
+        rect.w = m_tile_w;
+        rect.h = m_tile_h;
+        SDL_UpdateTexture(m_texture, &rect, tile.data(), m_tile_w * sizeof(uint32_t));
+    }
+    SDL_RenderCopy(m_renderer, m_texture, NULL, NULL);
+    SDL_RenderPresent(m_renderer);
+}
+
+void SdlMosaic::focus(size_t slot)
+{
+    if (slot >= m_board.size() || slot == m_focus)
+        return;
+    // keys held on the old machine are let go
+    m_board.set_keys(m_focus, 0);
+    m_keys = 0;
+    // both borders change
+    m_seen[m_focus] = UNDRAWN;
+    m_seen[slot] = UNDRAWN;
+    m_focus = slot;
+}
+
+/*
+ * Returns false once the window is closed.
+ */
+bool SdlMosaic::handle_events()
+{
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+        switch (e.type) {
+        case SDL_QUIT:
+            return false;
+        case SDL_MOUSEBUTTONDOWN: {
+            uint col = e.button.x / m_tile_w;
+            uint row = e.button.y / m_tile_h;
+            if (col < m_cols)
+                focus(row * m_cols + col);
+            break;
+        }
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_TAB) {
+                focus((m_focus + 1) % m_board.size());
+                break;
+            }
+            auto it = m_keymap.find(e.key.keysym.sym);
+            if (it == m_keymap.end() || it->second >= 16)
+                break;
+            if (e.type == SDL_KEYDOWN)
+                m_keys |= 1 << it->second;
+            else
+                m_keys &= ~(1 << it->second);
+            m_board.set_keys(m_focus, m_keys);
+            break;
+        }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+/*
+ * shm_export.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Frame ring in POSIX shared memory for outside readers.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <shm_export.h>
+
+// shm_open() names start with a slash
+static std::string shm_path(const char *name)
+{
+    return name[0] == '/' ? name : std::string("/") + name;
+}
+
+ShmExport::~ShmExport()
+{
+    if (m_map == nullptr)
+        return;
+    munmap(m_map, sizeof(ShmLayout));
+    shm_unlink(m_name.c_str());
+}
+
+/*
+ * Make a fresh segment, replacing any old one by that name. Prints why and
+ * returns false if it can't.
+ */
+bool ShmExport::create(const char *name)
+{
+    m_name = shm_path(name);
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::fprintf(stderr, "Error: shm_open %s: %s\n", m_name.c_str(), std::strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof(ShmLayout)) < 0) {
+        std::fprintf(stderr, "Error: ftruncate %s: %s\n", m_name.c_str(), std::strerror(errno));
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    void *map = mmap(nullptr, sizeof(ShmLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::fprintf(stderr, "Error: mmap %s: %s\n", m_name.c_str(), std::strerror(errno));
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    // a new segment is zero filled, so every seq and the head start at 0
+    m_map = static_cast<ShmLayout *>(map);
+    m_map->slots = SHM_SLOTS;
+    m_map->slot_size = sizeof(ShmSlot);
+    m_map->version = SHM_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    m_map->magic = SHM_MAGIC;
+    return true;
+}
+
+void ShmExport::publish(uint64_t frame, uint16_t pc, uint16_t I, const uint8_t *V, uint8_t timer,
+                        const uint8_t *framebuf)
+{
+    ShmSlot &s = m_map->slot[m_next % SHM_SLOTS];
+    s.seq.store(2*m_next + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.data.frame = frame;
+    s.data.pc = pc;
+    s.data.I = I;
+    std::memcpy(s.data.V, V, sizeof(s.data.V));
+    s.data.timer = timer;
+    std::memcpy(s.data.framebuf, framebuf, sizeof(s.data.framebuf));
+    s.seq.store(2*m_next + 2, std::memory_order_release);
+    m_next++;
+    m_map->head.store(m_next, std::memory_order_release);
+}
+
+bool ShmExport::keys(uint16_t &keys) const
+{
+    uint32_t k = m_map->keys.load(std::memory_order_relaxed);
+    keys = k & 0xFFFF;
+    return k & SHM_KEYS_SET;
+}
+
+ShmReader::~ShmReader()
+{
+    if (m_map != nullptr)
+        munmap(m_map, sizeof(ShmLayout));
+}
+
+bool ShmReader::open(const char *name)
+{
+    std::string path = shm_path(name);
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        std::fprintf(stderr, "Error: shm_open %s: %s\n", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    void *map = mmap(nullptr, sizeof(ShmLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::fprintf(stderr, "Error: mmap %s: %s\n", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    m_map = static_cast<ShmLayout *>(map);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_map->magic != SHM_MAGIC || m_map->version != SHM_VERSION
+        || m_map->slot_size != sizeof(ShmSlot)) {
+        std::fprintf(stderr, "Error: %s is not a chip8 frame export\n", path.c_str());
+        munmap(m_map, sizeof(ShmLayout));
+        m_map = nullptr;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Copy out frame n (the nth publish, not the machine's frame counter).
+ */
+ShmRead ShmReader::read(uint64_t n, ShmFrame &out) const
+{
+    const ShmSlot &s = m_map->slot[n % SHM_SLOTS];
+    while (true) {
+        uint64_t before = s.seq.load(std::memory_order_acquire);
+        if (before < 2*n + 1)
+            return SHM_NOT_YET;
+        if (before > 2*n + 2)
+            return SHM_OVERWRITTEN;
+        if (before == 2*n + 1)
+            continue;
+        std::memcpy(&out, &s.data, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = s.seq.load(std::memory_order_relaxed);
+        if (after == before)
+            return SHM_OK;
+        if (after > 2*n + 2)
+            return SHM_OVERWRITTEN;
+    }
+}
+
+void ShmReader::set_keys(uint16_t keys)
+{
+    m_map->keys.store(SHM_KEYS_SET | keys, std::memory_order_relaxed);
+}
@@ -0,0 +1,130 @@
+/*
+ * stats.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Frame timing counters for the HUD and stats export.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <stats.h>
+
+static double to_ms(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+Stats::Stats()
+    : m_cpu(0), m_render(0), m_present(0), m_instrs(0), m_frames(0),
+    m_total_frames(0), m_emulated(0), m_total_emulated(0), m_late(0), m_dropped(0), m_print_line(false), m_json_fd(-1)
+{
+    m_start = clock::now();
+    m_window_start = m_start;
+    m_mark = m_start;
+    std::memset(&m_report, 0, sizeof(m_report));
+    std::snprintf(m_hud, sizeof(m_hud), "WAITING FOR STATS");
+}
+
+/*
+ * print_line: one summary line to stderr every second
+ * json_fd: one JSON object per line every second to this fd, -1 for none
+ */
+void Stats::set_output(bool print_line, int json_fd)
+{
+    m_print_line = print_line;
+    m_json_fd = json_fd;
+}
+
+void Stats::begin_frame()
+{
+    m_mark = clock::now();
+    // emulated time starts with the first frame
+    if (m_total_frames == 0) {
+        m_start = m_mark;
+        m_window_start = m_mark;
+    }
+}
+
+void Stats::cpu_done(uint64_t instrs)
+{
+    clock::time_point now = clock::now();
+    m_cpu += now - m_mark;
+    m_mark = now;
+    m_instrs += instrs;
+}
+
+void Stats::render_done()
+{
+    clock::time_point now = clock::now();
+    m_render += now - m_mark;
+    m_mark = now;
+}
+
+void Stats::present_done()
+{
+    clock::time_point now = clock::now();
+    m_present += now - m_mark;
+    m_mark = now;
+}
+
+void Stats::end_frame(bool late, uint64_t dropped, uint64_t emulated)
+{
+    m_frames++;
+    m_total_frames++;
+    m_emulated += emulated;
+    m_total_emulated += emulated;
+    m_late += late ? 1 : 0;
+    m_dropped += dropped;
+    // after any sleep, so the frame period is included
+    clock::time_point now = clock::now();
+    if (now - m_window_start >= std::chrono::seconds(1))
+        summarize(now);
+}
+
+void Stats::summarize(clock::time_point now)
+{
+    double secs = std::chrono::duration<double>(now - m_window_start).count();
+    double frames = m_frames ? (double)m_frames : 1.0;
+    m_report.ips = m_instrs / secs;
+    m_report.fps = m_frames / secs;
+    m_report.cpu_ms = to_ms(m_cpu) / frames;
+    m_report.render_ms = to_ms(m_render) / frames;
+    m_report.present_ms = to_ms(m_present) / frames;
+    m_report.drift_ms = to_ms(now - m_start) - (m_total_emulated * 1000.0 / 60.0);
+    m_report.speed = m_emulated / frames;
+    m_report.late += m_late;
+    m_report.dropped += m_dropped;
+
+    std::snprintf(m_hud, sizeof(m_hud),
+                  "IPS %.0f FPS %.1f X%.1f\nCPU %.2f RND %.2f PRS %.2f\nDRIFT %.1f LATE %llu DROP %llu",
+                  m_report.ips, m_report.fps, m_report.speed, m_report.cpu_ms,
+                  m_report.render_ms, m_report.present_ms, m_report.drift_ms,
+                  (unsigned long long)m_report.late, (unsigned long long)m_report.dropped);
+
+    if (m_print_line) {
+        std::fprintf(stderr, "stats: ips %.0f fps %.1f speed %.1f cpu %.3fms render %.3fms "
+                     "present %.3fms drift %.1fms late %llu dropped %llu\n",
+                     m_report.ips, m_report.fps, m_report.speed, m_report.cpu_ms, m_report.render_ms,
+                     m_report.present_ms, m_report.drift_ms,
+                     (unsigned long long)m_report.late, (unsigned long long)m_report.dropped);
+    }
+    if (m_json_fd >= 0) {
+        dprintf(m_json_fd, "{\"ips\":%.0f,\"fps\":%.2f,\"speed\":%.2f,\"cpu_ms\":%.4f,"
+                "\"render_ms\":%.4f,\"present_ms\":%.4f,\"drift_ms\":%.2f,\"late\":%llu,"
+                "\"dropped\":%llu}\n",
+                m_report.ips, m_report.fps, m_report.speed, m_report.cpu_ms, m_report.render_ms,
+                m_report.present_ms, m_report.drift_ms,
+                (unsigned long long)m_report.late, (unsigned long long)m_report.dropped);
+    }
+
+    m_window_start = now;
+    m_cpu = m_render = m_present = clock::duration(0);
+    m_instrs = 0;
+    m_frames = 0;
+    m_emulated = 0;
+    m_late = 0;
+    m_dropped = 0;
+}
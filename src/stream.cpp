@@ -0,0 +1,423 @@
+/*
+ * stream.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Delta encoded frames and remote keys over a local socket.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stream.h>
+
+void stream_pack(const uint8_t *framebuf, uint8_t *bitmap)
+{
+    for (uint i = 0; i < STREAM_BITMAP_BYTES; i++) {
+        const uint8_t *px = framebuf + 8*i;
+        uint8_t b = 0;
+        for (uint k = 0; k < 8; k++) {
+            b = (b << 1) | (px[k] & 0x1);
+        }
+        bitmap[i] = b;
+    }
+}
+
+/*
+ * Run length encode prev XOR cur into out, which must hold STREAM_MAX_DELTA
+ * bytes. Returns the length.
+ */
+size_t stream_encode(const uint8_t *prev, const uint8_t *cur, uint8_t *out)
+{
+    size_t len = 0;
+    uint i = 0;
+    while (i < STREAM_BITMAP_BYTES) {
+        uint run = 0;
+        if (prev[i] == cur[i]) {
+            while (i + run < STREAM_BITMAP_BYTES && run < 128 && prev[i+run] == cur[i+run])
+                run++;
+            out[len++] = 0x7F + run;
+        } else {
+            size_t head = len++;
+            while (i + run < STREAM_BITMAP_BYTES && run < 128 && prev[i+run] != cur[i+run]) {
+                out[len++] = prev[i+run] ^ cur[i+run];
+                run++;
+            }
+            out[head] = run - 1;
+        }
+        i += run;
+    }
+    return len;
+}
+
+/*
+ * XOR the deltas in into bitmap. False if they don't cover it exactly.
+ */
+bool stream_decode(const uint8_t *in, size_t len, uint8_t *bitmap)
+{
+    size_t pos = 0;
+    uint i = 0;
+    while (pos < len) {
+        uint8_t n = in[pos++];
+        if (n >= 0x80) {
+            i += n - 0x7F;
+            if (i > STREAM_BITMAP_BYTES)
+                return false;
+            continue;
+        }
+        uint run = n + 1;
+        if (i + run > STREAM_BITMAP_BYTES || pos + run > len)
+            return false;
+        for (uint k = 0; k < run; k++) {
+            bitmap[i++] ^= in[pos++];
+        }
+    }
+    return i == STREAM_BITMAP_BYTES;
+}
+
+/*
+ * A port number is TCP on 127.0.0.1, anything else a Unix socket path.
+ */
+static bool parse_addr(const char *addr, sockaddr_storage &sa, socklen_t &len, bool &unix_path)
+{
+    std::memset(&sa, 0, sizeof(sa));
+    size_t n = std::strlen(addr);
+    unix_path = n == 0 || std::strspn(addr, "0123456789") != n;
+    if (!unix_path) {
+        unsigned long port = std::strtoul(addr, nullptr, 10);
+        if (port > 0xFFFF)
+            return false;
+        sockaddr_in *in = reinterpret_cast<sockaddr_in *>(&sa);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        len = sizeof(*in);
+        return true;
+    }
+    sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&sa);
+    if (n == 0 || n >= sizeof(un->sun_path))
+        return false;
+    un->sun_family = AF_UNIX;
+    std::memcpy(un->sun_path, addr, n);
+    len = sizeof(*un);
+    return true;
+}
+
+StreamServer::~StreamServer()
+{
+    for (Client &c : m_clients) {
+        if (c.fd >= 0)
+            close(c.fd);
+    }
+    if (m_fd < 0)
+        return;
+    close(m_fd);
+    if (!m_path.empty())
+        unlink(m_path.c_str());
+}
+
+/*
+ * Start listening. Prints why and returns false if it can't.
+ */
+bool StreamServer::listen(const char *addr)
+{
+    sockaddr_storage sa;
+    socklen_t len;
+    bool unix_path;
+    if (!parse_addr(addr, sa, len, unix_path)) {
+        std::fprintf(stderr, "Error: bad stream address %s\n", addr);
+        return false;
+    }
+    // only ever replace an old socket, a mistyped path must not cost a file
+    struct stat st;
+    if (unix_path && lstat(addr, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::fprintf(stderr, "Error: %s exists and is not a socket\n", addr);
+            return false;
+        }
+        unlink(addr);
+    }
+    int fd = socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::fprintf(stderr, "Error: socket: %s\n", std::strerror(errno));
+        return false;
+    }
+    if (!unix_path) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&sa), len) < 0
+        || ::listen(fd, STREAM_MAX_CLIENTS) < 0) {
+        std::fprintf(stderr, "Error: listen on %s: %s\n", addr, std::strerror(errno));
+        close(fd);
+        return false;
+    }
+    m_fd = fd;
+    if (unix_path)
+        m_path = addr;
+    return true;
+}
+
+void StreamServer::accept_clients()
+{
+    while (true) {
+        int fd = accept4(m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        Client *free = nullptr;
+        for (Client &c : m_clients) {
+            if (c.fd < 0) {
+                free = &c;
+                break;
+            }
+        }
+        if (free == nullptr) {
+            close(fd);
+            continue;
+        }
+        if (m_path.empty()) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        free->fd = fd;
+        m_connected++;
+        std::memset(free->sent, 0, sizeof(free->sent));
+        const uint8_t hello[STREAM_HELLO_BYTES] = {
+            STREAM_MAGIC[0], STREAM_MAGIC[1], STREAM_MAGIC[2], STREAM_MAGIC[3],
+            STREAM_VERSION, FRAME_WIDTH, FRAME_HEIGHT,
+        };
+        queue(*free, hello, sizeof(hello));
+    }
+}
+
+void StreamServer::drop(Client &c)
+{
+    close(c.fd);
+    m_connected--;
+    c.fd = -1;
+    c.pending = -1;
+    c.keys = 0;
+    c.out_len = 0;
+}
+
+/*
+ * Take the key events the client has sent. Anything else, or the client
+ * hanging up, drops it.
+ */
+void StreamServer::read_keys(Client &c)
+{
+    uint8_t buf[64];
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            drop(c);
+            return;
+        }
+        if (n < 0)
+            return;
+        for (ssize_t i = 0; i < n; i++) {
+            if (c.pending < 0) {
+                c.pending = buf[i];
+                continue;
+            }
+            uint8_t cmd = c.pending;
+            uint8_t key = buf[i];
+            c.pending = -1;
+            if ((cmd != 'D' && cmd != 'U') || key > 0xF) {
+                drop(c);
+                return;
+            }
+            if (cmd == 'D')
+                c.keys |= 1 << key;
+            else
+                c.keys &= ~(1 << key);
+            m_keys_set = true;
+        }
+    }
+}
+
+// callers make sure there is room
+void StreamServer::queue(Client &c, const void *data, size_t len)
+{
+    std::memcpy(c.out + c.out_len, data, len);
+    c.out_len += len;
+}
+
+void StreamServer::flush(Client &c)
+{
+    ssize_t n = send(c.fd, c.out, c.out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            drop(c);
+        return;
+    }
+    std::memmove(c.out, c.out + n, c.out_len - n);
+    c.out_len -= n;
+}
+
+// one poll() for new clients and the keys of those there
+void StreamServer::poll_clients()
+{
+    pollfd fds[STREAM_MAX_CLIENTS + 1];
+    Client *polled[STREAM_MAX_CLIENTS + 1];
+    nfds_t n = 0;
+    fds[n] = {m_fd, POLLIN, 0};
+    polled[n++] = nullptr;
+    for (Client &c : m_clients) {
+        if (c.fd < 0)
+            continue;
+        fds[n] = {c.fd, POLLIN, 0};
+        polled[n++] = &c;
+    }
+    if (poll(fds, n, 0) > 0) {
+        for (nfds_t i = 1; i < n; i++) {
+            if (fds[i].revents)
+                read_keys(*polled[i]);
+        }
+        if (fds[0].revents & POLLIN)
+            accept_clients();
+    }
+}
+
+/*
+ * Called once a frame: polls if it is time to, then the screen goes to
+ * every client whose copy differs, if its queue has room. A client whose
+ * queue is full gets the difference to a later frame instead.
+ *
+ * Even reading the clock shows on unpaced runs, so it is read every m_skip
+ * frames, doubling while it finds no poll due and halving when one is.
+ */
+void StreamServer::publish(uint32_t frame, const uint8_t *framebuf)
+{
+    if (m_until_look-- == 0) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= m_next_poll) {
+            poll_clients();
+            m_next_poll = now + std::chrono::microseconds(STREAM_POLL_US);
+            m_skip = std::max(m_skip / 2, 1u);
+        } else {
+            m_skip = std::min(m_skip * 2, (uint)STREAM_MAX_SKIP);
+        }
+        m_until_look = m_skip - 1;
+    }
+    if (m_connected == 0)
+        return;
+
+    stream_pack(framebuf, m_bitmap);
+    uint8_t msg[STREAM_FRAME_HEADER + STREAM_MAX_DELTA];
+    for (Client &c : m_clients) {
+        if (c.fd < 0)
+            continue;
+        if (c.out_len + sizeof(msg) <= STREAM_OUT_BYTES
+            && std::memcmp(c.sent, m_bitmap, STREAM_BITMAP_BYTES) != 0) {
+            size_t len = stream_encode(c.sent, m_bitmap, msg + STREAM_FRAME_HEADER);
+            msg[0] = 'F';
+            msg[1] = frame;
+            msg[2] = frame >> 8;
+            msg[3] = frame >> 16;
+            msg[4] = frame >> 24;
+            msg[5] = len;
+            msg[6] = len >> 8;
+            queue(c, msg, STREAM_FRAME_HEADER + len);
+            std::memcpy(c.sent, m_bitmap, STREAM_BITMAP_BYTES);
+        }
+        if (c.out_len > 0)
+            flush(c);
+    }
+}
+
+bool StreamServer::keys(uint16_t &keys) const
+{
+    keys = 0;
+    for (const Client &c : m_clients) {
+        keys |= c.keys;
+    }
+    return m_keys_set;
+}
+
+StreamClient::~StreamClient()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool StreamClient::read_all(void *buf, size_t len)
+{
+    uint8_t *p = static_cast<uint8_t *>(buf);
+    while (len > 0) {
+        ssize_t n = recv(m_fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Prints why and returns false if it can't connect.
+ */
+bool StreamClient::connect(const char *addr)
+{
+    sockaddr_storage sa;
+    socklen_t len;
+    bool unix_path;
+    if (!parse_addr(addr, sa, len, unix_path)) {
+        std::fprintf(stderr, "Error: bad stream address %s\n", addr);
+        return false;
+    }
+    m_fd = socket(sa.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 || ::connect(m_fd, reinterpret_cast<sockaddr *>(&sa), len) < 0) {
+        std::fprintf(stderr, "Error: connect to %s: %s\n", addr, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool StreamClient::read_frame(uint32_t &frame, size_t &bytes)
+{
+    if (!m_greeted) {
+        uint8_t hello[STREAM_HELLO_BYTES];
+        if (!read_all(hello, sizeof(hello)) || std::memcmp(hello, STREAM_MAGIC, 4) != 0
+            || hello[4] != STREAM_VERSION || hello[5] != FRAME_WIDTH || hello[6] != FRAME_HEIGHT) {
+            std::fprintf(stderr, "Error: not a chip8 stream\n");
+            return false;
+        }
+        m_greeted = true;
+    }
+    uint8_t head[STREAM_FRAME_HEADER];
+    uint8_t deltas[STREAM_MAX_DELTA];
+    if (!read_all(head, sizeof(head)) || head[0] != 'F')
+        return false;
+    frame = head[1] | (head[2] << 8) | (head[3] << 16) | ((uint32_t)head[4] << 24);
+    size_t len = head[5] | (head[6] << 8);
+    if (len > sizeof(deltas) || !read_all(deltas, len))
+        return false;
+    bytes = sizeof(head) + len;
+    return stream_decode(deltas, len, m_bitmap);
+}
+
+bool StreamClient::send_key(uint8_t key, bool down)
+{
+    uint8_t msg[2] = {(uint8_t)(down ? 'D' : 'U'), key};
+    return send(m_fd, msg, sizeof(msg), MSG_NOSIGNAL) == sizeof(msg);
+}
+
+bool StreamClient::pixel(uint x, uint y) const
+{
+    uint bit = y*FRAME_WIDTH + x;
+    return (m_bitmap[bit / 8] >> (7 - bit % 8)) & 0x1;
+}
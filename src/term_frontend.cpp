@@ -0,0 +1,196 @@
+/*
+ * term_frontend.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Terminal frontend. Lets the chip8 run on hosts without a display (or over
+ * ssh) by drawing the screen with unicode half blocks and ANSI escapes.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <term_frontend.h>
+
+#define CELL_UNDRAWN 0xFF
+
+// cell glyphs, indexed by (top pixel << 1) | bottom pixel
+static const char *glyphs[4] = {" ", "▄", "▀", "█"};
+
+static struct termios saved_termios;
+static bool termios_saved = false;
+
+static void restore_term()
+{
+    if (!termios_saved)
+        return;
+    // leave alt screen and show cursor again
+    const char *reset = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    ssize_t rc = write(STDOUT_FILENO, reset, std::strlen(reset));
+    (void)rc;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
+    termios_saved = false;
+}
+
+TermFrontend::TermFrontend()
+{
+    std::memset(m_cells, CELL_UNDRAWN, sizeof(m_cells));
+    m_last_present = std::chrono::steady_clock::time_point();
+    set_keymap(DEFAULT_KEYMAP);
+
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        std::cerr << "Error: Terminal frontend needs a tty on stdin and stdout!\n";
+        std::exit(1);
+    }
+
+    // raw mode: no line buffering or echo, and VMIN/VTIME 0 so reads return
+    // right away with whatever was typed. The fd itself stays blocking: on a
+    // tty stdout shares it, and the shell gets it back after we exit.
+    // ISIG is kept so ctrl-c still reaches the sighandler.
+    tcgetattr(STDIN_FILENO, &saved_termios);
+    termios_saved = true;
+    std::atexit(restore_term);
+    struct termios raw = saved_termios;
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    // alt screen, hide cursor, clear
+    m_out = "\x1b[?1049h\x1b[?25l\x1b[2J";
+    ssize_t rc = write(STDOUT_FILENO, m_out.data(), m_out.size());
+    (void)rc;
+}
+
+TermFrontend::~TermFrontend()
+{
+    restore_term();
+}
+
+void TermFrontend::render(const std::vector<uint8_t> &framebuf)
+{
+    m_out.clear();
+    // rate limit to 60Hz, changes are picked up by the next frame drawn
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_present < std::chrono::microseconds(1000000 / 60))
+        return;
+    m_last_present = now;
+
+    int cur_row = -1;
+    int cur_col = -1;
+    for (int row = 0; row < TERM_ROWS; row++) {
+        const uint8_t *top = &framebuf[(2*row) * FRAME_WIDTH];
+        const uint8_t *bot = &framebuf[(2*row + 1) * FRAME_WIDTH];
+        for (int col = 0; col < TERM_COLS; col++) {
+            uint8_t cell = ((top[col] & 1) << 1) | (bot[col] & 1);
+            uint8_t &drawn = m_cells[row*TERM_COLS + col];
+            if (cell == drawn)
+                continue;
+            drawn = cell;
+
+            // only move the cursor when we are not already there
+            if (row != cur_row || col != cur_col) {
+                char move[16];
+                std::snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, col + 1);
+                m_out += move;
+            }
+            m_out += glyphs[cell];
+            cur_row = row;
+            cur_col = col + 1;
+        }
+    }
+}
+
+/*
+ * The HUD goes on the lines below the screen, redrawn only when it changes.
+ */
+void TermFrontend::render_hud(const char *text)
+{
+    const char *want = text ? text : "";
+    if (m_hud == want)
+        return;
+
+    // clear what was there before
+    int lines = 1;
+    for (char c : m_hud) {
+        lines += c == '\n' ? 1 : 0;
+    }
+    char move[32];
+    for (int i = 0; i < lines; i++) {
+        std::snprintf(move, sizeof(move), "\x1b[%d;1H\x1b[K", TERM_ROWS + 2 + i);
+        m_out += move;
+    }
+
+    m_hud = want;
+    std::snprintf(move, sizeof(move), "\x1b[%d;1H", TERM_ROWS + 2);
+    m_out += move;
+    for (char c : m_hud) {
+        if (c == '\n')
+            m_out += "\r\n";
+        else
+            m_out += c;
+    }
+}
+
+/*
+ * Send everything render() queued. render() has already counted those cells
+ * as drawn, so a frame that can't be sent whole makes the next one redraw
+ * the whole screen.
+ */
+void TermFrontend::present()
+{
+    if (m_out.empty())
+        return;
+
+    const char *p = m_out.data();
+    size_t left = m_out.size();
+    while (left > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, left);
+        if (n > 0) {
+            p += n;
+            left -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // someone else made the tty non-blocking, wait for room
+            struct pollfd out = {STDOUT_FILENO, POLLOUT, 0};
+            if (poll(&out, 1, 100) > 0)
+                continue;
+        }
+        std::memset(m_cells, CELL_UNDRAWN, sizeof(m_cells));
+        m_hud.clear();
+        break;
+    }
+}
+
+void TermFrontend::set_keymap(const std::string &keys)
+{
+    std::memset(m_keymap, NO_KEY, sizeof(m_keymap));
+    for (size_t i = 0; i < keys.size() && i < 16; i++) {
+        m_keymap[keys[i] & 0x7F] = i;
+    }
+}
+
+uint8_t TermFrontend::poll_key()
+{
+    char c;
+    while (read(STDIN_FILENO, &c, 1) == 1) {
+        uint8_t key = m_keymap[c & 0x7F];
+        if (key != NO_KEY)
+            return key;
+        if (c == 'h')
+            return KEY_HUD;
+        if (c == '\t')
+            return KEY_FAST_FORWARD;
+    }
+    return NO_KEY;
+}
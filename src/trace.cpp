@@ -0,0 +1,99 @@
+/*
+ * trace.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Binary execution trace recorder. The emulator fills a ring buffer and a
+ * background thread compresses it out to disk.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <trace.h>
+
+#define RING_SIZE (1u << TRACE_RING_BITS)
+#define RING_MASK (RING_SIZE - 1)
+
+Tracer::Tracer()
+    : m_file(NULL), m_ring(NULL), m_head(0), m_tail(0), m_done(false)
+{
+}
+
+Tracer::~Tracer()
+{
+    close();
+}
+
+bool Tracer::open(const char *path)
+{
+    // level 1: the writer has to keep up with the emulator
+    m_file = gzopen(path, "wb1");
+    if (m_file == NULL) {
+        std::cerr << "Failed to open " << path << " for tracing!\n";
+        return false;
+    }
+
+    TraceHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(TraceRecord);
+    gzwrite(m_file, &header, sizeof(header));
+
+    m_ring = new TraceRecord[RING_SIZE];
+    m_head = 0;
+    m_tail = 0;
+    m_done = false;
+    m_writer = std::thread(&Tracer::drain, this);
+    return true;
+}
+
+/*
+ * Write out everything recorded so far and close the file.
+ */
+void Tracer::close()
+{
+    if (m_file == NULL)
+        return;
+    m_done.store(true, std::memory_order_release);
+    m_writer.join();
+    gzclose(m_file);
+    m_file = NULL;
+    delete[] m_ring;
+    m_ring = NULL;
+}
+
+void Tracer::wait_for_room()
+{
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    while (head - m_tail.load(std::memory_order_acquire) == RING_SIZE) {
+        std::this_thread::yield();
+    }
+}
+
+/*
+ * Writer thread. Drains up to the end of the ring per write, sleeps when
+ * there is nothing to do.
+ */
+void Tracer::drain()
+{
+    while (true) {
+        // read done first: if it was set, everything up to head is final
+        bool done = m_done.load(std::memory_order_acquire);
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (done)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        uint64_t start = tail & RING_MASK;
+        uint64_t count = head - tail;
+        if (start + count > RING_SIZE)
+            count = RING_SIZE - start;
+        gzwrite(m_file, &m_ring[start], count * sizeof(TraceRecord));
+        m_tail.store(tail + count, std::memory_order_release);
+    }
+}
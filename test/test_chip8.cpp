@@ -0,0 +1,524 @@
+/*
+ * test_chip8.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the cpu core
+ */
+
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <chip8.h>
+#include <calibrate.h>
+#include "test_chip8.h"
+#include "test_utils.h"
+
+#define TEST_IPF 10
+
+// counted loop, then the loop head gets overwritten by FX55
+static const uint8_t selfmod_rom[] = {
+	0x60, 0x00, // V0 = 0
+	0x70, 0x01, // V0 += 1
+	0x30, 0x05, // skip if V0 == 5
+	0x12, 0x02, // jmp 0x202
+	0x60, 0x71, // V0 = 0x71
+	0x61, 0x02, // V1 = 0x02
+	0xA2, 0x02, // I = 0x202
+	0xF1, 0x55, // 0x202 = 7102 (V1 += 2)
+	0x60, 0x00, // V0 = 0
+	0x12, 0x02, // jmp 0x202
+};
+
+// timer wait, then draw glyph 0 over and over
+static const uint8_t idiom_rom[] = {
+	0x60, 0x05, // V0 = 5
+	0xF0, 0x15, // timer = V0
+	0xF1, 0x07, // V1 = timer
+	0x31, 0x00, // skip if V1 == 0
+	0x12, 0x04, // jmp 0x204
+	0x62, 0x08, // V2 = 8
+	0x63, 0x04, // V3 = 4
+	0xA0, 0x00, // I = 0x000
+	0xD2, 0x35, // draw 5 rows at (V2, V3)
+	0x12, 0x0A, // jmp 0x20A
+};
+
+// one sprite per delay timer tick, spins in between
+static const uint8_t paced_rom[] = {
+	0x60, 0x01, // V0 = 1
+	0xF0, 0x15, // timer = V0
+	0xF1, 0x07, // V1 = timer
+	0x31, 0x00, // skip if V1 == 0
+	0x12, 0x04, // jmp 0x204
+	0x72, 0x01, // V2 += 1
+	0xA0, 0x00, // I = 0x000
+	0xD2, 0x35, // draw 5 rows at (V2, V3)
+	0x12, 0x00, // jmp 0x200
+};
+
+// counts down the timer, then jumps to itself
+static const uint8_t halt_rom[] = {
+	0x60, 0x03, // V0 = 3
+	0xF0, 0x15, // timer = V0
+	0xF1, 0x07, // V1 = timer
+	0x31, 0x00, // skip if V1 == 0
+	0x12, 0x04, // jmp 0x204
+	0x12, 0x0A, // jmp 0x20A
+};
+
+// subroutine writing BCD to memory, called forever
+static const uint8_t call_rom[] = {
+	0x22, 0x06, // call 0x206
+	0x12, 0x00, // jmp 0x200
+	0x00, 0x00,
+	0x70, 0x01, // V0 += 1
+	0xA3, 0x00, // I = 0x300
+	0xF0, 0x33, // 0x300 = BCD(V0)
+	0x00, 0xEE, // ret
+};
+
+// calls itself until the stack runs out
+static const uint8_t recurse_rom[] = {
+	0x22, 0x00, // call 0x200
+};
+
+static bool same(Chip8 &a, Chip8 &b)
+{
+	return std::memcmp(a.regs(), b.regs(), 16) == 0
+		&& *a.prog_counter() == *b.prog_counter()
+		&& *a.index_reg() == *b.index_reg()
+		&& *a.peripherals().delay_timer() == *b.peripherals().delay_timer()
+		&& std::memcmp(a.peripherals().framebuf(), b.peripherals().framebuf(),
+		               FRAME_WIDTH*FRAME_HEIGHT) == 0;
+}
+
+/*
+ * run_frame() goes through fused superinstructions; it has to end every
+ * frame in the same state as plain single steps.
+ */
+static bool run_against_steps(const uint8_t *rom, size_t len, int frames, Chip8 &fused)
+{
+	Chip8 stepped(nullptr, 0, true);
+	fused.set_verbose(false);
+	stepped.set_verbose(false);
+	fused.load_rom(rom, len);
+	stepped.load_rom(rom, len);
+	fused.set_ipf(TEST_IPF);
+	for (int f = 0; f < frames; f++) {
+		fused.run_frame(0);
+		for (int i = 0; i < TEST_IPF; i++)
+			stepped.step();
+		stepped.peripherals().tick_timer();
+		if (!same(fused, stepped))
+			return false;
+	}
+	return true;
+}
+
+static bool test_fusion()
+{
+	bool all_passed = true;
+	Chip8 c(nullptr, 0, true);
+
+	bool ok = run_against_steps(idiom_rom, sizeof(idiom_rom), 20, c);
+	printf("Testing fused timer wait and draw match steps...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	ok = run_against_steps(selfmod_rom, sizeof(selfmod_rom), 20, c);
+	printf("Testing fused loop matches steps...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	ok = c.regs()[1] > 2;
+	printf("Testing overwritten loop runs new code...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	return all_passed;
+}
+
+/*
+ * With host counters on, frames take turns between the engines; the rom
+ * must not be able to tell.
+ */
+static bool test_profiled()
+{
+	Chip8 c(nullptr, 0, true);
+	if (!c.start_perf()) {
+		printf("Skipping profiled run test, no counters\n");
+		return true;
+	}
+	bool ok = run_against_steps(idiom_rom, sizeof(idiom_rom), 30, c)
+		&& run_against_steps(selfmod_rom, sizeof(selfmod_rom), 30, c);
+	printf("Testing profiled frames match steps...");
+	TEST(ok);
+	bool all_passed = ok;
+
+	// traced too, every instruction of every frame lands in the trace
+	std::string path = "/tmp/chip8-test-" + std::to_string(getpid()) + ".trace";
+	c.set_verbose(false);
+	c.load_rom(idiom_rom, sizeof(idiom_rom));
+	c.set_ipf(TEST_IPF);
+	ok = c.start_trace(path.c_str());
+	for (int f = 0; f < 9; f++)
+		c.run_frame(0);
+	c.end_trace();
+	size_t records = 0;
+	gzFile in = gzopen(path.c_str(), "rb");
+	TraceHeader head;
+	TraceRecord r;
+	if (in != nullptr && gzread(in, &head, sizeof(head)) == sizeof(head)) {
+		while (gzread(in, &r, sizeof(r)) == sizeof(r))
+			records++;
+	}
+	if (in != nullptr)
+		gzclose(in);
+	unlink(path.c_str());
+	ok = ok && records == 9 * TEST_IPF;
+	printf("Testing profiled frames leave nothing out of the trace...");
+	TEST(ok);
+	return all_passed && ok;
+}
+
+/*
+ * The paced rom needs a handful of instructions a frame to keep up with the
+ * timer; calibration should land on the smallest rate that does, and one
+ * less should show different frames.
+ */
+static bool test_calibrate()
+{
+	uint ipf = calibrate_ipf(paced_rom, sizeof(paced_rom), 0, 120);
+	bool ok = ipf > 1 && ipf < 20
+		&& frames_digest(paced_rom, sizeof(paced_rom), 0, ipf - 1, 120)
+		   != frames_digest(paced_rom, sizeof(paced_rom), 0, ipf, 120)
+		&& calibrate_ipf(selfmod_rom, sizeof(selfmod_rom), 0, 120) == 0;
+	printf("Testing calibration finds the lowest paced rate...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * Every opcode gets a handler from the table; the ones the chip8 doesn't
+ * have get the trap, which faults without moving pc.
+ */
+static bool test_traps()
+{
+	static const uint16_t undefined[] = {0x8128, 0x8FFF, 0xE09F, 0xE5A2, 0xF000, 0xF9FF};
+	bool ok = true;
+	for (uint16_t raw : undefined) {
+		uint8_t rom[] = {(uint8_t)(raw >> 8), (uint8_t)raw};
+		Chip8 c(nullptr, 0, true);
+		c.set_verbose(false);
+		c.load_rom(rom, sizeof(rom));
+		try {
+			c.step();
+			ok = false;
+		} catch (const Fault &f) {
+			ok = ok && f.type == FAULT_BAD_INSTR && f.addr == 0x200 && *c.prog_counter() == 0x200;
+		}
+	}
+	printf("Testing undefined opcodes trap...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * Load rom into c and step through n instructions of it.
+ */
+static void run_steps(Chip8 &c, const uint8_t *rom, size_t len, uint n)
+{
+	c.set_verbose(false);
+	c.load_rom(rom, len);
+	for (uint i = 0; i < n; i++)
+		c.step();
+}
+
+static bool test_add_carry()
+{
+	const uint8_t rom[] = {
+		0x60, 0xF0, // V0 = 0xF0
+		0x61, 0x20, // V1 = 0x20
+		0x80, 0x14, // V0 += V1, carries
+		0x82, 0xF0, // V2 = VF
+		0x80, 0x14, // V0 += V1, doesn't
+	};
+	Chip8 c(nullptr, 0, true);
+	run_steps(c, rom, sizeof(rom), 5);
+	bool ok = c.regs()[0] == 0x30 && c.regs()[2] == 1 && c.regs()[0xF] == 0;
+	printf("Testing 8XY4 sets VF on carry...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_subn()
+{
+	const uint8_t rom[] = {
+		0x63, 0x05, // V3 = 5
+		0x64, 0x08, // V4 = 8
+		0x83, 0x47, // V3 = V4 - V3
+	};
+	Chip8 c(nullptr, 0, true);
+	run_steps(c, rom, sizeof(rom), 3);
+	bool ok = c.regs()[3] == 3 && c.regs()[4] == 8 && c.regs()[0xF] == 1;
+	printf("Testing 8XY7 writes VX...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * With VF as the destination the flag is what's left in it.
+ */
+static bool test_flag_last()
+{
+	const uint8_t rom[] = {
+		0x6F, 0x81, // VF = 0x81
+		0x8F, 0xF6, // VF >>= 1
+		0x80, 0xF0, // V0 = VF
+		0x6F, 0xFF, // VF = 0xFF
+		0x61, 0x01, // V1 = 1
+		0x8F, 0x14, // VF += V1
+	};
+	Chip8 c(nullptr, 0, true);
+	run_steps(c, rom, sizeof(rom), 6);
+	bool ok = c.regs()[0] == 1 && c.regs()[0xF] == 1;
+	printf("Testing 8XYN with X = F keeps the flag...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_font_nibble()
+{
+	const uint8_t rom[] = {
+		0x67, 0x1A, // V7 = 0x1A
+		0xF7, 0x29, // I = glyph A
+	};
+	Chip8 c(nullptr, 0, true);
+	run_steps(c, rom, sizeof(rom), 2);
+	bool ok = *c.index_reg() == 0xA * 5;
+	printf("Testing FX29 takes the low nibble...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * FX1E flags I passing the end of memory, except with QUIRK_KEEP_VF.
+ */
+static bool test_add_i()
+{
+	const uint8_t rom[] = {
+		0x6F, 0x07, // VF = 7
+		0xAF, 0xFF, // I = 0xFFF
+		0x60, 0x02, // V0 = 2
+		0xF0, 0x1E, // I += V0
+	};
+	Chip8 c(nullptr, 0, true);
+	run_steps(c, rom, sizeof(rom), 4);
+	bool ok = *c.index_reg() == 0x001 && c.regs()[0xF] == 1;
+	printf("Testing FX1E sets VF past 0xFFF...");
+	TEST(ok);
+	bool all_passed = ok;
+
+	c.set_quirks(QUIRK_KEEP_VF);
+	run_steps(c, rom, sizeof(rom), 4);
+	ok = *c.index_reg() == 0x001 && c.regs()[0xF] == 7;
+	printf("Testing FX1E leaves VF with keep_vf...");
+	TEST(ok);
+	return all_passed && ok;
+}
+
+/*
+ * Once a rom has written to its pages, frames must not touch the heap, on
+ * either engine.
+ */
+static bool no_allocations(const uint8_t *rom, size_t len, bool plain)
+{
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(rom, len);
+	c.set_ipf(TEST_IPF);
+	auto frame = [&]() {
+		if (!plain) {
+			c.run_frame(0);
+			return;
+		}
+		for (int i = 0; i < TEST_IPF; i++)
+			c.step();
+		c.peripherals().tick_timer();
+	};
+	for (int f = 0; f < 10; f++)
+		frame();
+	uint64_t before = test_allocations.load();
+	for (int f = 0; f < 200; f++)
+		frame();
+	return test_allocations.load() == before;
+}
+
+static bool test_allocation_free()
+{
+	bool ok = true;
+	for (int plain = 0; plain < 2; plain++) {
+		ok = ok && no_allocations(idiom_rom, sizeof(idiom_rom), plain)
+			&& no_allocations(selfmod_rom, sizeof(selfmod_rom), plain)
+			&& no_allocations(paced_rom, sizeof(paced_rom), plain)
+			&& no_allocations(call_rom, sizeof(call_rom), plain);
+	}
+	printf("Testing frames make no allocations...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * The call stack holds STACK_DEPTH returns; one more call faults, and so
+ * does a return with nothing on it.
+ */
+static bool test_stack_limits()
+{
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(recurse_rom, sizeof(recurse_rom));
+	int calls = 0;
+	bool overflow = false;
+	try {
+		for (; calls <= STACK_DEPTH; calls++)
+			c.step();
+	} catch (const Fault &f) {
+		overflow = f.type == FAULT_STACK && calls == STACK_DEPTH;
+	}
+	static const uint8_t ret_rom[] = {0x00, 0xEE};
+	c.load_rom(ret_rom, sizeof(ret_rom));
+	bool underflow = false;
+	try {
+		c.step();
+	} catch (const Fault &f) {
+		underflow = f.type == FAULT_STACK && f.addr == 0x200;
+	}
+	bool ok = overflow && underflow;
+	printf("Testing call stack overflow and underflow fault...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * An FX55 that runs off the end of memory wraps to 0x000 by default; in
+ * strict mode it faults, naming the instruction that did it.
+ */
+static bool test_strict_memory()
+{
+	static const uint8_t rom[] = {
+		0xAF, 0xFE, // I = 0xFFE
+		0xF3, 0x55, // 0xFFE-0x001 = V0-V3
+		0xA0, 0x00, // I = 0x000
+		0xF0, 0x65, // V0 = [0x000]
+		0x12, 0x08, // jmp 0x208
+	};
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(rom, sizeof(rom));
+	c.regs()[2] = 0x42;
+	bool wrapped = false;
+	try {
+		for (int i = 0; i < 4; i++)
+			c.step();
+		wrapped = c.regs()[0] == 0x42;
+	} catch (const Fault &) {
+	}
+
+	c.load_rom(rom, sizeof(rom));
+	c.set_strict(true);
+	bool faulted = false;
+	try {
+		c.step();
+		c.step();
+	} catch (const Fault &f) {
+		faulted = f.type == FAULT_MEM_WRITE && f.addr == MEM_SIZE && f.pc == 0x202
+			&& f.opcode == 0xF355;
+	}
+	bool ok = wrapped && faulted;
+	printf("Testing memory wraps, or faults in strict mode...");
+	TEST(ok);
+	return ok;
+}
+
+static Chip8::RunResult run_limited(const uint8_t *rom, size_t len,
+                                    const Chip8::RunLimits &limits)
+{
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(rom, len);
+	c.set_ipf(TEST_IPF);
+	return c.run_until(limits);
+}
+
+/*
+ * Each limit on its own stops the run where it says, and the result shows
+ * the machine as it was left.
+ */
+static bool test_run_until()
+{
+	bool all_passed = true;
+	Chip8::RunLimits limits;
+	limits.halt = true;
+	Chip8::RunResult r = run_limited(halt_rom, sizeof(halt_rom), limits);
+	bool ok = r.reason == Chip8::STOP_HALT && r.pc == 0x20A && r.frames >= 3 && r.frames <= 5;
+	printf("Testing run stops on a halted rom...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	limits = Chip8::RunLimits();
+	limits.instrs = 25;
+	r = run_limited(selfmod_rom, sizeof(selfmod_rom), limits);
+	ok = r.reason == Chip8::STOP_INSTRS && r.instrs == 25 && r.frames == 3;
+	limits = Chip8::RunLimits();
+	limits.pc = 0x208;
+	r = run_limited(selfmod_rom, sizeof(selfmod_rom), limits);
+	ok = ok && r.reason == Chip8::STOP_PC && r.pc == 0x208 && r.V[0] == 5;
+	printf("Testing run stops on instruction and pc limits...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	limits = Chip8::RunLimits();
+	limits.frames = 30;
+	Chip8::RunResult drawn = run_limited(idiom_rom, sizeof(idiom_rom), limits);
+	limits = Chip8::RunLimits();
+	limits.match_hash = true;
+	limits.frame_hash = drawn.frame_hash;
+	r = run_limited(idiom_rom, sizeof(idiom_rom), limits);
+	ok = r.reason == Chip8::STOP_FRAME_HASH && r.frames <= 30 && r.frame_hash == drawn.frame_hash;
+	printf("Testing run stops on a screen hash...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	static const uint8_t bad_rom[] = {0xF0, 0xFF}; // no such FX opcode
+	limits = Chip8::RunLimits();
+	limits.frames = 10;
+	r = run_limited(bad_rom, sizeof(bad_rom), limits);
+	ok = r.reason == Chip8::STOP_FAULT && r.fault == FAULT_BAD_INSTR && r.fault_addr == 0x200;
+	printf("Testing run stops on a fault...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	return all_passed;
+}
+
+bool test_chip8::run_all()
+{
+	bool res = true;
+	res = test_fusion() && res;
+	res = test_profiled() && res;
+	res = test_calibrate() && res;
+	res = test_traps() && res;
+	res = test_add_carry() && res;
+	res = test_subn() && res;
+	res = test_flag_last() && res;
+	res = test_font_nibble() && res;
+	res = test_add_i() && res;
+	res = test_allocation_free() && res;
+	res = test_stack_limits() && res;
+	res = test_run_until() && res;
+	res = test_strict_memory() && res;
+	return res;
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_CHIP8_H
+#define _TEST_CHIP8_H
+
+namespace test_chip8 {
+	bool run_all();
+}
+
+#endif
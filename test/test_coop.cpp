@@ -0,0 +1,132 @@
+/*
+ * test_coop.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the coroutine scheduler
+ */
+
+#include <iostream>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <coop.h>
+#include "test_coop.h"
+#include "test_utils.h"
+
+#define TEST_IPF 10
+#define TEST_FRAMES 300
+
+// one sprite per timer tick, spinning on the timer in between
+static const uint8_t paced_rom[] = {
+	0x60, 0x03, // V0 = 3
+	0xF0, 0x15, // timer = V0
+	0xF1, 0x07, // V1 = timer
+	0x31, 0x00, // skip if V1 == 0
+	0x12, 0x04, // jmp 0x204
+	0x72, 0x01, // V2 += 1
+	0xA0, 0x00, // I = 0x000
+	0xD2, 0x35, // draw 5 rows at (V2, V3)
+	0x12, 0x00, // jmp 0x200
+};
+
+// wait for a key and show it
+static const uint8_t key_rom[] = {
+	0x00, 0xE0, // clear
+	0xF0, 0x0A, // V0 = key
+	0xF0, 0x29, // I = glyph V0
+	0x61, 0x08, // V1 = 8
+	0xD1, 0x15, // draw 5 rows at (V1, V1)
+	0x12, 0x00, // jmp 0x200
+};
+
+// draw once and stop
+static const uint8_t halt_rom[] = {
+	0xA0, 0x00, // I = 0x000
+	0xD0, 0x05, // draw 5 rows at (V0, V0)
+	0x12, 0x04, // jmp 0x204
+};
+
+static uint16_t test_keys(int f)
+{
+	if (f >= 100 && f < 104)
+		return 1 << 0x5;
+	if (f >= 200 && f < 202)
+		return 1 << 0xA;
+	return 0;
+}
+
+/*
+ * Machines on the scheduler have to show the same thing every frame as
+ * machines run a whole frame at a time, while the waiting ones are parked.
+ */
+static bool test_matches_run_frame()
+{
+	const uint8_t *roms[] = {paced_rom, key_rom, halt_rom};
+	const size_t lens[] = {sizeof(paced_rom), sizeof(key_rom), sizeof(halt_rom)};
+	std::vector<std::unique_ptr<Chip8>> coop, plain;
+	Scheduler sched;
+	for (int i = 0; i < 3; i++) {
+		for (auto *list : {&coop, &plain}) {
+			list->emplace_back(new Chip8(nullptr, 0, true));
+			Chip8 &c = *list->back();
+			c.set_verbose(false);
+			c.load_rom(roms[i], lens[i]);
+			c.set_ipf(TEST_IPF);
+		}
+		sched.add(*coop.back());
+	}
+
+	bool ok = true;
+	size_t runs[3] = {0};
+	for (int f = 0; f < TEST_FRAMES && ok; f++) {
+		for (size_t id = 0; id < 3; id++)
+			sched.set_keys(id, test_keys(f));
+		for (size_t id : sched.run_frame())
+			runs[id]++;
+		for (size_t id = 0; id < 3; id++) {
+			plain[id]->run_frame(test_keys(f));
+			Chip8 &a = sched.sync(id);
+			Chip8 &b = *plain[id];
+			// pc can differ, spinning loops are left at their head
+			ok = ok && !sched.faulted(id)
+				&& *a.index_reg() == *b.index_reg()
+				&& *a.peripherals().delay_timer() == *b.peripherals().delay_timer()
+				&& std::memcmp(a.peripherals().framebuf(), b.peripherals().framebuf(),
+				               FRAME_WIDTH*FRAME_HEIGHT) == 0;
+		}
+	}
+	printf("Testing scheduled machines match run_frame...");
+	TEST(ok);
+
+	// paced: awake one frame in three; key: start, while held and one frame
+	// after each press; halt: once
+	bool parked = runs[0] <= TEST_FRAMES / 3 + 2 && runs[1] <= 10 && runs[2] == 1;
+	printf("Testing waiting machines stay parked...");
+	TEST(parked);
+	return ok && parked;
+}
+
+static bool test_fault()
+{
+	static const uint8_t bad_rom[] = {0x00, 0xEE}; // return with no call
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(bad_rom, sizeof(bad_rom));
+	Scheduler sched;
+	size_t id = sched.add(c);
+	sched.run_frame();
+	bool ok = sched.faulted(id) && sched.fault(id) != nullptr && sched.run_frame().empty();
+	printf("Testing a faulting machine is dropped...");
+	TEST(ok);
+	return ok;
+}
+
+bool test_coop::run_all()
+{
+	bool res = true;
+	res = test_matches_run_frame() && res;
+	res = test_fault() && res;
+	return res;
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_COOP_H
+#define _TEST_COOP_H
+
+namespace test_coop {
+	bool run_all();
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * test_fork.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for forking machines and the fork pool
+ */
+
+#include <iostream>
+#include <cstring>
+#include <chip8.h>
+#include <forkpool.h>
+#include "test_fork.h"
+#include "test_utils.h"
+
+// stores a random byte, draws glyph 0 a row lower each time and clears the
+// screen while key 0 is held
+static const uint8_t branch_rom[] = {
+	0xA3, 0x00, // I = 0x300
+	0xC0, 0xFF, // V0 = rand
+	0xF0, 0x55, // [0x300] = V0
+	0xA0, 0x00, // I = 0x000
+	0xD0, 0x15, // draw 5 rows at (V0, V1)
+	0x71, 0x01, // V1 += 1
+	0xE2, 0x9E, // skip if key V2 (0) is held
+	0x12, 0x00, // jmp 0x200
+	0x00, 0xE0, // clear
+	0x12, 0x00, // jmp 0x200
+};
+
+static Chip8 *branch_machine()
+{
+	Chip8 *c = new Chip8(nullptr, 0, true);
+	c->set_verbose(false);
+	c->set_seed(7);
+	c->load_rom(branch_rom, sizeof(branch_rom));
+	c->set_ipf(9);
+	return c;
+}
+
+static bool same(Chip8 &a, Chip8 &b)
+{
+	Chip8::State sa, sb;
+	a.save_state(sa);
+	b.save_state(sb);
+	bool ok = sa.I == sb.I && sa.pc == sb.pc && std::memcmp(sa.V, sb.V, 16) == 0
+		&& sa.rand == sb.rand && sa.periphs.timer == sb.periphs.timer
+		&& std::memcmp(sa.periphs.framebuf, sb.periphs.framebuf, sizeof(sa.periphs.framebuf)) == 0;
+	for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+		ok = ok && sa.mem.read(addr) == sb.mem.read(addr);
+	return ok;
+}
+
+/*
+ * A child runs on exactly as its parent would have, and what it does after
+ * the fork never shows up in the parent.
+ */
+static bool test_fork_matches()
+{
+	Chip8 *parent = branch_machine();
+	Chip8 *ref = branch_machine();
+	Chip8 *child = branch_machine();
+	for (int f = 0; f < 10; f++) {
+		parent->run_frame(0);
+		ref->run_frame(0);
+	}
+	parent->fork(*child);
+	bool ok = same(*parent, *child);
+	for (int f = 0; f < 20; f++) {
+		parent->run_frame(0);
+		child->run_frame(0);
+	}
+	ok = ok && same(*parent, *child);
+	printf("Testing a forked machine runs on like its parent...");
+	TEST(ok);
+	bool all_passed = ok;
+
+	parent->fork(*child);
+	for (int f = 0; f < 20; f++) {
+		child->run_frame(1 << 0);
+		parent->run_frame(0);
+		ref->run_frame(0);
+	}
+	for (int f = 0; f < 20; f++)
+		ref->run_frame(0);
+	ok = same(*parent, *ref) && !same(*parent, *child);
+	printf("Testing a child's writes don't reach its parent...");
+	TEST(ok);
+	delete parent;
+	delete ref;
+	delete child;
+	return all_passed && ok;
+}
+
+/*
+ * Every slot can be handed out once, a released one comes back first, and
+ * once warm a search through the pool doesn't allocate.
+ */
+static bool test_pool()
+{
+	Chip8 *root = branch_machine();
+	root->run_frame(0);
+	ForkPool pool(8);
+	int slots[8];
+	bool ok = true;
+	for (int i = 0; i < 8; i++) {
+		slots[i] = pool.fork(*root);
+		ok = ok && slots[i] == i;
+	}
+	ok = ok && pool.fork(*root) == FORK_NONE && pool.in_use() == 8;
+	pool.release(slots[5]);
+	ok = ok && pool.in_use() == 7 && pool.fork(pool.at(slots[2])) == 5 && same(pool.at(5), pool.at(2));
+	printf("Testing the pool hands out and takes back slots...");
+	TEST(ok);
+	bool all_passed = ok;
+	for (int i = 0; i < 8; i++)
+		pool.release(slots[i]);
+
+	// depth two search: four children of the root, two grandchildren each,
+	// every node run a frame with its own keys
+	auto search = [&]() {
+		int kids[4];
+		for (int k = 0; k < 4; k++) {
+			kids[k] = pool.fork(*root);
+			pool.at(kids[k]).run_frame(k & 1);
+			for (int g = 0; g < 2; g++) {
+				int grand = pool.fork(pool.at(kids[k]));
+				pool.at(grand).run_frame(g);
+				pool.release(grand);
+			}
+		}
+		for (int k = 0; k < 4; k++)
+			pool.release(kids[k]);
+	};
+	for (int i = 0; i < 20; i++)
+		search();
+	uint64_t before = test_allocations.load();
+	for (int i = 0; i < 200; i++)
+		search();
+	ok = test_allocations.load() == before && pool.in_use() == 0;
+	printf("Testing forks through a warm pool make no allocations...");
+	TEST(ok);
+	delete root;
+	return all_passed && ok;
+}
+
+bool test_fork::run_all()
+{
+	bool res = true;
+	res = test_fork_matches() && res;
+	res = test_pool() && res;
+	return res;
+}
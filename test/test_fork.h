@@ -0,0 +1,8 @@
+#ifndef _TEST_FORK_H
+#define _TEST_FORK_H
+
+namespace test_fork {
+	bool run_all();
+}
+
+#endif
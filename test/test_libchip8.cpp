@@ -0,0 +1,155 @@
+/*
+ * test_libchip8.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the embedding interface
+ */
+
+#include <iostream>
+#include <libchip8.h>
+#include "test_libchip8.h"
+#include "test_utils.h"
+
+// draw font glyph 0 at (0,0), then spin
+static const uint8_t draw_rom[] = {
+	0x00, 0xE0, // CLS
+	0xA0, 0x00, // I = 0x000
+	0x60, 0x00, // V0 = 0
+	0x61, 0x00, // V1 = 0
+	0xD0, 0x15, // draw 5 rows at (V0, V1)
+	0x12, 0x0A, // jmp 0x20A
+};
+
+// V2 = key once pressed, then spin
+static const uint8_t key_rom[] = {
+	0xF2, 0x0A, // V2 = wait for key
+	0x12, 0x02, // jmp 0x202
+};
+
+// V0-V3 = random bytes, then spin
+static const uint8_t rand_rom[] = {
+	0xC0, 0xFF, // V0 = rand
+	0xC1, 0xFF, // V1 = rand
+	0xC2, 0xFF, // V2 = rand
+	0xC3, 0xFF, // V3 = rand
+	0x12, 0x08, // jmp 0x208
+};
+
+static bool test_draw()
+{
+	bool all_passed = true;
+	chip8_t *c = chip8_create(10);
+	chip8_load_rom(c, draw_rom, sizeof(draw_rom));
+	chip8_run_frames(c, 1, NULL);
+
+	chip8_view_t view;
+	chip8_get_view(c, &view);
+	// top row of the 0 glyph is 0xF0
+	bool ok = view.framebuf[0] && view.framebuf[3] && !view.framebuf[4];
+	printf("Testing glyph drawn...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	ok = *view.pc == 0x20A;
+	printf("Testing pc parked on spin...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	chip8_reset(c);
+	ok = *view.pc == 0x200 && !view.framebuf[0];
+	printf("Testing reset...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	chip8_destroy(c);
+	return all_passed;
+}
+
+static bool test_key_wait()
+{
+	bool all_passed = true;
+	chip8_t *c = chip8_create(10);
+	chip8_load_rom(c, key_rom, sizeof(key_rom));
+	chip8_view_t view;
+	chip8_get_view(c, &view);
+
+	chip8_run_frames(c, 3, NULL);
+	bool ok = *view.pc == 0x200;
+	printf("Testing FX0A waits without keys...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	uint16_t keys = 1 << 0xB;
+	chip8_run_frames(c, 1, &keys);
+	ok = view.V[2] == 0xB && *view.pc == 0x202;
+	printf("Testing FX0A takes held key...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	chip8_destroy(c);
+	return all_passed;
+}
+
+static bool test_batch()
+{
+	chip8_t *cs[4];
+	for (int i = 0; i < 4; i++) {
+		cs[i] = chip8_create(10);
+		chip8_load_rom(cs[i], key_rom, sizeof(key_rom));
+	}
+	uint16_t keys[4 * 2] = {0};
+	for (int i = 0; i < 4; i++) {
+		keys[i*2 + 1] = 1 << i;
+	}
+	chip8_run_frames_batch(cs, 4, 2, keys);
+
+	bool all_passed = true;
+	for (int i = 0; i < 4; i++) {
+		chip8_view_t view;
+		chip8_get_view(cs[i], &view);
+		printf("Testing batch machine %d...", i);
+		TEST(view.V[2] == i);
+		all_passed = all_passed && view.V[2] == i;
+		chip8_destroy(cs[i]);
+	}
+	return all_passed;
+}
+
+static bool test_seed()
+{
+	chip8_t *a = chip8_create(10);
+	chip8_t *b = chip8_create(10);
+	chip8_set_seed(a, 1234);
+	chip8_set_seed(b, 1234);
+	chip8_load_rom(a, rand_rom, sizeof(rand_rom));
+	chip8_load_rom(b, rand_rom, sizeof(rand_rom));
+	chip8_run_frames(a, 1, NULL);
+	chip8_run_frames(b, 1, NULL);
+
+	chip8_view_t va, vb;
+	chip8_get_view(a, &va);
+	chip8_get_view(b, &vb);
+	bool ok = va.V[0] == vb.V[0] && va.V[1] == vb.V[1] && va.V[2] == vb.V[2]
+		&& va.V[3] == vb.V[3];
+	chip8_reset(a);
+	chip8_run_frames(a, 1, NULL);
+	ok = ok && va.V[0] == vb.V[0] && va.V[3] == vb.V[3];
+	printf("Testing seeded machines draw the same numbers...");
+	TEST(ok);
+
+	chip8_destroy(a);
+	chip8_destroy(b);
+	return ok;
+}
+
+bool test_libchip8::run_all()
+{
+	bool res = true;
+	res = test_draw() && res;
+	res = test_key_wait() && res;
+	res = test_batch() && res;
+	res = test_seed() && res;
+	return res;
+}
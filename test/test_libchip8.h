@@ -0,0 +1,8 @@
+#ifndef _TEST_LIBCHIP8_H
+#define _TEST_LIBCHIP8_H
+
+namespace test_libchip8 {
+	bool run_all();
+}
+
+#endif
@@ -7,9 +7,43 @@
  * Main file for running tests on the chip8
  */
 
+#include <cstdlib>
 #include <iostream>
+#include <new>
 
 #include "test_mem.h"
+#include "test_libchip8.h"
+#include "test_chip8.h"
+#include "test_scaler.h"
+#include "test_mosaic.h"
+#include "test_coop.h"
+#include "test_shm.h"
+#include "test_xochip.h"
+#include "test_stream.h"
+#include "test_fork.h"
+#include "test_utils.h"
+
+std::atomic<uint64_t> test_allocations(0);
+
+// count every allocation, so tests can check a stretch of code makes none
+void *operator new(size_t size)
+{
+    test_allocations++;
+    void *p = std::malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
 
 int main()
 {
@@ -19,5 +53,41 @@ int main()
     std::cout << "---------------------------------------------\n";
     all_passed = all_passed && test_mem::run_all();
     std::cout << "---------------------------------------------\n";
+    std::cout << "Running libchip8 tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_libchip8::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running cpu tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_chip8::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running scaler tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_scaler::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running mosaic tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_mosaic::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running scheduler tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_coop::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running frame export tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_shm::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running SUPER-CHIP and XO-CHIP tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_xochip::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running frame stream tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_stream::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
+    std::cout << "Running fork tests...\n";
+    std::cout << "---------------------------------------------\n";
+    all_passed = test_fork::run_all() && all_passed;
+    std::cout << "---------------------------------------------\n";
     return !all_passed;
 }
\ No newline at end of file
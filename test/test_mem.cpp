@@ -9,11 +9,10 @@
 
 #include <iostream>
 #include <mem.h>
+#include <fault.h>
 #include "test_mem.h"
 #include "test_utils.h"
 
-#define MEM_SIZE (4 * 1024)
-
 static bool test_read_write()
 {
 	Mem mem = Mem();
@@ -29,9 +28,76 @@ static bool test_read_write()
 	return all_passed;
 }
 
+static bool test_wrap()
+{
+	Mem mem = Mem();
+	mem.write(42, MEM_SIZE + 0x300);
+	bool ok = mem.read(0x300) == 42 && mem.read(0xF300) == 42;
+	printf("Testing addresses wrap at 0x%03X...", MEM_SIZE);
+	TEST(ok);
+	return ok;
+}
+
+static bool test_out_of_range()
+{
+	Mem mem = Mem();
+	bool faulted = false;
+	try {
+		mem.write_checked(42, MEM_SIZE);
+	} catch (const Fault &f) {
+		faulted = f.type == FAULT_MEM_WRITE && f.addr == MEM_SIZE;
+	}
+	printf("Testing checked write @ 0x%03X faults...", MEM_SIZE);
+	TEST(faulted);
+	bool all_passed = faulted;
+
+	faulted = false;
+	try {
+		mem.read_checked(0xFFFF);
+	} catch (const Fault &f) {
+		faulted = f.type == FAULT_MEM_READ && f.addr == 0xFFFF;
+	}
+	printf("Testing checked read @ 0xFFFF faults...");
+	TEST(faulted);
+	return all_passed && faulted;
+}
+
+static bool test_copy_on_write()
+{
+	const uint8_t rom[] = {0x12, 0x00};
+	Mem a = Mem();
+	Mem b = Mem();
+	a.load_program(rom, sizeof(rom));
+	b.load_program(rom, sizeof(rom));
+	bool all_passed = true;
+
+	bool ok = a.dirty_pages() == 0 && a.read(0x200) == 0x12 && a.read(0x000) == 0xF0;
+	printf("Testing fresh mem reads image...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	a.write(0x42, 0x300);
+	ok = a.read(0x300) == 0x42 && b.read(0x300) == 0x00 && a.dirty_pages() == 1;
+	printf("Testing write copies only its page...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	Mem snap = a;
+	a.write(0x43, 0x300);
+	ok = snap.read(0x300) == 0x42 && a.read(0x300) == 0x43;
+	printf("Testing copies don't see later writes...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	return all_passed;
+}
+
 bool test_mem::run_all()
 {
 	bool res = true;
 	res = res && test_read_write();
+	res = res && test_wrap();
+	res = res && test_out_of_range();
+	res = res && test_copy_on_write();
 	return res;
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+ * test_mosaic.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the mosaic screen board
+ */
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mosaic.h>
+#include "test_mosaic.h"
+#include "test_utils.h"
+
+static bool test_publish()
+{
+	Mosaic board(2);
+	std::vector<uint8_t> fb(FRAME_WIDTH*FRAME_HEIGHT, 0);
+	fb[0] = 1;                          // (0, 0)
+	fb[3*FRAME_WIDTH + 63] = 1;         // (63, 3)
+	uint64_t rows[FRAME_HEIGHT];
+	uint32_t before = board.snapshot(1, rows);
+	board.publish(1, fb.data());
+	uint32_t after = board.snapshot(1, rows);
+	board.set_keys(1, 0x8001);
+
+	bool ok = after != before && rows[0] == (1ull << 63) && rows[3] == 1 && rows[1] == 0
+		&& board.snapshot(0, rows) == 0 && board.keys(1) == 0x8001 && board.keys(0) == 0
+		&& !board.faulted(1);
+	board.set_faulted(1);
+	ok = ok && board.faulted(1) && !board.faulted(0);
+	printf("Testing publish and snapshot...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * A writer flips between an all off and an all on screen as fast as it can;
+ * the reader must never see a mix of the two.
+ */
+static bool test_no_torn_reads()
+{
+	Mosaic board(1);
+	std::atomic<bool> stop(false);
+	std::thread writer([&]() {
+		std::vector<uint8_t> off(FRAME_WIDTH*FRAME_HEIGHT, 0);
+		std::vector<uint8_t> on(FRAME_WIDTH*FRAME_HEIGHT, 1);
+		for (int i = 0; !stop.load(); i++)
+			board.publish(0, i & 1 ? on.data() : off.data());
+	});
+
+	bool ok = true;
+	uint64_t rows[FRAME_HEIGHT];
+	for (int i = 0; i < 200000 && ok; i++) {
+		board.snapshot(0, rows);
+		for (int y = 1; y < FRAME_HEIGHT; y++)
+			ok = ok && rows[y] == rows[0];
+		ok = ok && (rows[0] == 0 || rows[0] == ~0ull);
+	}
+	stop.store(true);
+	writer.join();
+	printf("Testing snapshots are never torn...");
+	TEST(ok);
+	return ok;
+}
+
+bool test_mosaic::run_all()
+{
+	bool res = true;
+	res = test_publish() && res;
+	res = test_no_torn_reads() && res;
+	return res;
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_MOSAIC_H
+#define _TEST_MOSAIC_H
+
+namespace test_mosaic {
+	bool run_all();
+}
+
+#endif
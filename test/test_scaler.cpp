@@ -0,0 +1,86 @@
+/*
+ * test_scaler.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the display scalers
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <scaler.h>
+#include "test_scaler.h"
+#include "test_utils.h"
+
+static const ScaleFilter filters[] = {FILTER_NEAREST, FILTER_SCALE2X, FILTER_SCANLINES};
+static const char *filter_names[] = {"nearest", "scale2x", "scanlines"};
+
+static void random_frame(std::vector<uint8_t> &fb, int density)
+{
+	for (size_t i = 0; i < fb.size(); i++)
+		fb[i] = std::rand() % 100 < density ? 1 : 0;
+}
+
+static bool test_nearest()
+{
+	std::vector<uint8_t> fb(FRAME_WIDTH*FRAME_HEIGHT, 0);
+	fb[1*FRAME_WIDTH + 2] = 1; // (2, 1)
+	Scaler scaler(4, FILTER_NEAREST, false);
+	std::vector<uint32_t> out(scaler.width() * scaler.height());
+	scaler.scale(fb.data(), out.data(), scaler.width());
+
+	size_t lit = 0;
+	for (uint32_t px : out)
+		lit += px == PIXEL_ON;
+	bool ok = lit == 16 && out[4*scaler.width() + 8] == PIXEL_ON
+		&& out[7*scaler.width() + 11] == PIXEL_ON && out[0] == PIXEL_OFF;
+	printf("Testing nearest makes 4x4 blocks...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * Every filter at every scale has to give the same image with AVX2 as with
+ * the scalar code, including through a pitch wider than the image.
+ */
+static bool test_avx2_matches_scalar()
+{
+	if (!cpu_has_avx2()) {
+		printf("Skipping AVX2 tests, cpu doesn't have it\n");
+		return true;
+	}
+	bool all_passed = true;
+	std::vector<uint8_t> fb(FRAME_WIDTH*FRAME_HEIGHT);
+	for (int f = 0; f < 3; f++) {
+		bool ok = true;
+		for (uint scale = 1; scale <= 32 && ok; scale++) {
+			Scaler scalar(scale, filters[f], false);
+			Scaler avx2(scale, filters[f], true);
+			size_t pitch = scalar.width() + 8;
+			std::vector<uint32_t> a(pitch * scalar.height());
+			std::vector<uint32_t> b(pitch * scalar.height());
+			for (int density = 0; density <= 100 && ok; density += 25) {
+				random_frame(fb, density);
+				scalar.scale(fb.data(), a.data(), pitch);
+				avx2.scale(fb.data(), b.data(), pitch);
+				for (uint y = 0; y < scalar.height() && ok; y++)
+					ok = std::memcmp(&a[y*pitch], &b[y*pitch], scalar.width() * 4) == 0;
+			}
+		}
+		printf("Testing AVX2 %s matches scalar...", filter_names[f]);
+		TEST(ok);
+		all_passed = all_passed && ok;
+	}
+	return all_passed;
+}
+
+bool test_scaler::run_all()
+{
+	bool res = true;
+	res = test_nearest() && res;
+	res = test_avx2_matches_scalar() && res;
+	return res;
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_SCALER_H
+#define _TEST_SCALER_H
+
+namespace test_scaler {
+	bool run_all();
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * test_shm.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the shared memory frame export
+ */
+
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <chip8.h>
+#include <shm_export.h>
+#include "test_shm.h"
+#include "test_utils.h"
+
+// draws glyph 0, then waits for key 5 and draws it
+static const uint8_t key_rom[] = {
+	0xA0, 0x00, // I = 0x000
+	0xD0, 0x05, // draw 5 rows at (V0, V0)
+	0x61, 0x05, // V1 = 5
+	0xE1, 0xA1, // skip if key V1 isn't held
+	0x13, 0x00, // jmp 0x300
+	0x12, 0x06, // jmp 0x206
+};
+
+static std::string test_name()
+{
+	return "chip8-test-" + std::to_string(getpid());
+}
+
+static bool test_publish()
+{
+	std::string name = test_name();
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(key_rom, sizeof(key_rom));
+	c.set_ipf(10);
+	ShmReader reader;
+	bool ok = c.start_export(name.c_str()) && reader.open(name.c_str());
+	printf("Testing export segment opens...");
+	TEST(ok);
+	if (!ok)
+		return false;
+
+	ShmFrame f;
+	bool empty = reader.head() == 0 && reader.read(0, f) == SHM_NOT_YET;
+	for (int i = 0; i < 5; i++)
+		c.run_frame(0);
+	ok = empty && reader.head() == 5 && reader.read(4, f) == SHM_OK
+		&& f.frame == 5 && f.pc == *c.prog_counter() && f.I == *c.index_reg()
+		&& std::memcmp(f.V, c.regs(), 16) == 0
+		&& std::memcmp(f.framebuf, c.peripherals().framebuf(), sizeof(f.framebuf)) == 0
+		&& f.framebuf[0] == 1 && reader.read(5, f) == SHM_NOT_YET;
+	printf("Testing published frame matches the machine...");
+	TEST(ok);
+	bool all_passed = ok;
+
+	for (int i = 0; i < SHM_SLOTS; i++)
+		c.run_frame(0);
+	ok = reader.read(4, f) == SHM_OVERWRITTEN && reader.read(5 + SHM_SLOTS - 1, f) == SHM_OK;
+	printf("Testing a reader left behind sees frames overwritten...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	// run_frame() sets keys itself, so go through run_until(); the keys are
+	// picked up at the end of the first frame
+	reader.set_keys(1 << 5);
+	Chip8::RunLimits limits;
+	limits.frames = 3;
+	limits.pc = 0x300;
+	Chip8::RunResult r = c.run_until(limits);
+	ok = r.reason == Chip8::STOP_PC && r.frames == 2;
+	printf("Testing keys set through the segment reach the machine...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	c.end_export();
+	ShmReader gone;
+	ok = !gone.open(name.c_str());
+	printf("Testing the segment is removed...");
+	TEST(ok);
+	return all_passed && ok;
+}
+
+bool test_shm::run_all()
+{
+	return test_publish();
+}
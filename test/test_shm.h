@@ -0,0 +1,8 @@
+#ifndef _TEST_SHM_H
+#define _TEST_SHM_H
+
+namespace test_shm {
+	bool run_all();
+}
+
+#endif
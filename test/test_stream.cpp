@@ -0,0 +1,134 @@
+/*
+ * test_stream.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the socket frame stream
+ */
+
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <chip8.h>
+#include <stream.h>
+#include "test_stream.h"
+#include "test_utils.h"
+
+// draws glyph 0, then clears the screen for as long as key 5 is held
+static const uint8_t clear_rom[] = {
+	0xA0, 0x00, // I = 0x000
+	0xD0, 0x05, // draw 5 rows at (V0, V0)
+	0x61, 0x05, // V1 = 5
+	0xE1, 0xA1, // skip if key V1 isn't held
+	0x00, 0xE0, // clear
+	0x12, 0x06, // jmp 0x206
+};
+
+static bool test_encoding()
+{
+	uint8_t blank[STREAM_BITMAP_BYTES] = {0};
+	uint8_t a[STREAM_BITMAP_BYTES];
+	uint8_t out[STREAM_MAX_DELTA];
+	uint32_t x = 1;
+	for (uint i = 0; i < STREAM_BITMAP_BYTES; i++) {
+		x = x * 1103515245 + 12345;
+		a[i] = (i % 3 == 0) ? 0 : x >> 24;
+	}
+	uint8_t b[STREAM_BITMAP_BYTES] = {0};
+	size_t len = stream_encode(blank, a, out);
+	bool ok = len <= STREAM_MAX_DELTA && stream_decode(out, len, b) && std::memcmp(a, b, sizeof(a)) == 0;
+	// the same screen again is two runs of 128 zero bytes
+	len = stream_encode(a, a, out);
+	ok = ok && len == 2 && stream_decode(out, len, b) && std::memcmp(a, b, sizeof(a)) == 0;
+	// and the worst case, every other byte changed, still fits
+	for (uint i = 0; i < STREAM_BITMAP_BYTES; i++)
+		b[i] = a[i] ^ (i % 2);
+	len = stream_encode(a, b, out);
+	ok = ok && len <= STREAM_MAX_DELTA && stream_decode(out, len, a) && std::memcmp(a, b, sizeof(a)) == 0;
+	ok = ok && !stream_decode(out, len - 1, a);
+	printf("Testing XOR run length deltas round trip...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_serve()
+{
+	std::string path = "/tmp/chip8-test-" + std::to_string(getpid()) + ".sock";
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	c.load_rom(clear_rom, sizeof(clear_rom));
+	c.set_ipf(10);
+	StreamClient client;
+	bool ok = c.start_stream(path.c_str()) && client.connect(path.c_str());
+	printf("Testing stream socket accepts a client...");
+	TEST(ok);
+	if (!ok)
+		return false;
+
+	c.run_frame(0);
+	uint32_t frame = 0;
+	size_t bytes = 0;
+	uint8_t packed[STREAM_BITMAP_BYTES];
+	stream_pack(c.peripherals().framebuf(), packed);
+	ok = client.read_frame(frame, bytes) && frame == 1 && client.pixel(0, 0)
+		&& std::memcmp(client.bitmap(), packed, sizeof(packed)) == 0;
+	printf("Testing streamed frame matches the machine...");
+	TEST(ok);
+	bool all_passed = ok;
+
+	// the screen stays the same for these, so the next frame the client
+	// gets is the one cleared once key 5 is down
+	for (int i = 0; i < 5; i++)
+		c.run_frame(0);
+	ok = client.send_key(5, true);
+	// the server only polls for keys about every STREAM_POLL_US, and looks
+	// at the clock less often the faster frames go by
+	usleep(2 * STREAM_POLL_US);
+	Chip8::RunLimits limits;
+	limits.frames = 2 * STREAM_MAX_SKIP;
+	c.run_until(limits);
+	ok = ok && client.read_frame(frame, bytes) && frame > 6 && bytes < 32;
+	bool blank = true;
+	for (uint i = 0; i < STREAM_BITMAP_BYTES; i++)
+		blank = blank && client.bitmap()[i] == 0;
+	ok = ok && blank;
+	printf("Testing unchanged frames are not sent and keys come back...");
+	TEST(ok);
+	all_passed = all_passed && ok;
+
+	c.end_stream();
+	ok = !client.read_frame(frame, bytes) && access(path.c_str(), F_OK) != 0;
+	printf("Testing the stream closes and its socket is removed...");
+	TEST(ok);
+	return all_passed && ok;
+}
+
+/*
+ * A stream path that names an ordinary file fails instead of deleting it.
+ */
+static bool test_keeps_files()
+{
+	std::string path = "/tmp/chip8-test-" + std::to_string(getpid()) + ".txt";
+	FILE *f = fopen(path.c_str(), "w");
+	bool ok = f != nullptr;
+	if (f != nullptr)
+		fclose(f);
+	Chip8 c(nullptr, 0, true);
+	c.set_verbose(false);
+	ok = ok && !c.start_stream(path.c_str()) && access(path.c_str(), F_OK) == 0;
+	unlink(path.c_str());
+	printf("Testing a stream won't replace an ordinary file...");
+	TEST(ok);
+	return ok;
+}
+
+bool test_stream::run_all()
+{
+	bool res = true;
+	res = test_encoding() && res;
+	res = test_serve() && res;
+	res = test_keeps_files() && res;
+	return res;
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_STREAM_H
+#define _TEST_STREAM_H
+
+namespace test_stream {
+	bool run_all();
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef _TEST_UTILS_H
 #define _TEST_UTILS_H
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 
 #define TEST(cond) \
@@ -10,4 +12,7 @@
 		std::cout << "TEST PASSED\n"; \
 	}
 
+// operator new calls so far, counted by test_main.cpp
+extern std::atomic<uint64_t> test_allocations;
+
 #endif
\ No newline at end of file
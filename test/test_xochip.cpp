@@ -0,0 +1,235 @@
+/*
+ * test_xochip.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Tests for the SUPER-CHIP and XO-CHIP machines
+ */
+
+#include <iostream>
+#include <cstring>
+#include <xochip.h>
+#include "test_xochip.h"
+#include "test_utils.h"
+
+// run a rom until it jumps to itself
+template<typename Machine>
+static Chip8::RunResult run_rom(Machine &c, const uint8_t *rom, size_t len)
+{
+	c.set_verbose(false);
+	c.load_rom(rom, len);
+	Chip8::RunLimits limits;
+	limits.halt = true;
+	limits.frames = 10;
+	c.peripherals().set_keys(0);
+	return c.run_until(limits);
+}
+
+template<typename Machine>
+static bool lit(Machine &c, int x, int y)
+{
+	return c.framebuf()[y*EXT_WIDTH + x] != 0;
+}
+
+static bool test_hires_sprite()
+{
+	// 16x16 of lit pixels at (120, 60), clipped at both edges
+	uint8_t rom[0x40] = {
+		0x00, 0xFF, // hires
+		0xA2, 0x20, // I = 0x220
+		0x60, 0x78, // V0 = 120
+		0x61, 0x3C, // V1 = 60
+		0xD0, 0x10, // 16x16 sprite at (V0, V1)
+		0x12, 0x0A, // jmp 0x20A
+	};
+	for (int i = 0x20; i < 0x40; i++)
+		rom[i] = 0xFF;
+	SuperChip8 c(nullptr, true);
+	Chip8::RunResult r = run_rom(c, rom, sizeof(rom));
+	bool ok = r.reason == Chip8::STOP_HALT && c.hires() && lit(c, 120, 60) && lit(c, 127, 63)
+		&& !lit(c, 0, 0) && !lit(c, 119, 60) && c.regs()[0xF] == 0;
+	printf("Testing hires 16x16 sprite clips...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_lores_scroll()
+{
+	// one lores pixel at (0, 0), scrolled down 1 and right 4
+	const uint8_t rom[] = {
+		0xA2, 0x0E, // I = 0x20E
+		0x60, 0x00, // V0 = 0
+		0xD0, 0x01, // 1 row at (V0, V0)
+		0x00, 0xC1, // scroll down 1
+		0x00, 0xFB, // scroll right 4
+		0x12, 0x0A, // jmp 0x20A
+		0x00, 0x00,
+		0x80,       // sprite
+	};
+	SuperChip8 c(nullptr, true);
+	run_rom(c, rom, sizeof(rom));
+	bool ok = !c.hires() && !lit(c, 0, 0) && lit(c, 8, 2) && lit(c, 9, 3) && !lit(c, 10, 2);
+	printf("Testing lores pixels and scrolls are doubled...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_big_font()
+{
+	const uint8_t rom[] = {
+		0x60, 0x08, // V0 = 8
+		0xF0, 0x30, // I = big 8
+		0x12, 0x04, // jmp 0x204
+	};
+	SuperChip8 c(nullptr, true);
+	run_rom(c, rom, sizeof(rom));
+	bool ok = *c.index_reg() == BIG_FONT_ADDR + 80;
+	printf("Testing FX30 points at the big font...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_long_i()
+{
+	// F000 NNNN loads I, and a skip steps over all 4 bytes of it
+	const uint8_t rom[] = {
+		0xF0, 0x00, 0xFF, 0xF0, // I = 0xFFF0
+		0x60, 0x42, // V0 = 0x42
+		0xF0, 0x55, // mem[I] = V0, I++
+		0x30, 0x42, // skip if V0 == 0x42
+		0xF0, 0x00, 0x12, 0x34, // I = 0x1234, skipped
+		0xF0, 0x00, 0xFF, 0xF0, // I = 0xFFF0
+		0x51, 0x13, // V1 = mem[I]
+		0x12, 0x14, // jmp 0x214
+	};
+	XoChip8 c(nullptr, true);
+	Chip8::RunResult r = run_rom(c, rom, sizeof(rom));
+	bool ok = r.reason == Chip8::STOP_HALT && *c.index_reg() == 0xFFF0 && c.regs()[1] == 0x42;
+	printf("Testing XO-CHIP 16 bit I over 64KB...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_planes()
+{
+	// plane 2 only, then both planes with a row per plane
+	const uint8_t rom[] = {
+		0xA2, 0x10, // I = 0x210
+		0x60, 0x00, // V0 = 0
+		0xF2, 0x01, // plane 2
+		0xD0, 0x01, // 1 row at (0, 0)
+		0xF3, 0x01, // planes 1 and 2
+		0xD0, 0x01, // 1 row per plane at (0, 0)
+		0x12, 0x0C, // jmp 0x20C
+		0x00, 0x00,
+		0x80, 0xC0, // plane 1 row, plane 2 row
+	};
+	XoChip8 c(nullptr, true);
+	run_rom(c, rom, sizeof(rom));
+	// (0,0) was plane 2, plane 1 lit and plane 2 cleared it; (2,0) only plane 2
+	const uint8_t *fb = c.framebuf();
+	bool ok = fb[0] == 1 && fb[1] == 1 && fb[2] == 2 && fb[3] == 2 && c.regs()[0xF] == 1;
+	printf("Testing XO-CHIP sprites per plane...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * Every machine runs the CHIP-8 opcodes through the same handlers.
+ */
+static bool test_shared_core()
+{
+	const uint8_t rom[] = {
+		0x60, 0xF0, // V0 = 0xF0
+		0x61, 0x20, // V1 = 0x20
+		0x80, 0x14, // V0 += V1, carry
+		0x82, 0xF0, // V2 = VF
+		0x81, 0x07, // V1 = V0 - V1
+		0xF1, 0x29, // I = glyph V1
+		0xF0, 0x1E, // I += V0
+		0x12, 0x0E, // jmp 0x20E
+	};
+	Chip8 a(nullptr, 0, true);
+	SuperChip8 b(nullptr, true);
+	XoChip8 c(nullptr, true);
+	run_rom(a, rom, sizeof(rom));
+	run_rom(b, rom, sizeof(rom));
+	run_rom(c, rom, sizeof(rom));
+	bool ok = a.regs()[2] == 1 && a.regs()[1] == 0xF0
+		&& std::memcmp(a.regs(), b.regs(), 16) == 0 && std::memcmp(a.regs(), c.regs(), 16) == 0
+		&& *a.index_reg() == *b.index_reg() && *a.index_reg() == *c.index_reg();
+	printf("Testing the CHIP-8 opcodes match on every machine...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * The strict memory checks hold at the end of XO-CHIP's 64KB too.
+ */
+static bool test_strict()
+{
+	const uint8_t rom[] = {
+		0xF0, 0x00, 0xFF, 0xFF, // I = 0xFFFF
+		0xF1, 0x55, // 0xFFFF-0x10000 = V0-V1
+		0x12, 0x06, // jmp 0x206
+	};
+	XoChip8 c(nullptr, true);
+	c.set_strict(true);
+	Chip8::RunResult r = run_rom(c, rom, sizeof(rom));
+	bool ok = r.reason == Chip8::STOP_FAULT && r.fault_pc == 0x204;
+	printf("Testing strict mode faults past XO-CHIP memory...");
+	TEST(ok);
+	return ok;
+}
+
+/*
+ * Without strict mode FX55 and FX65 at I = 0xFFFF carry on at 0x0000.
+ */
+static bool test_wrap()
+{
+	const uint8_t rom[] = {
+		0x60, 0x11, // V0 = 0x11
+		0x61, 0x22, // V1 = 0x22
+		0xF0, 0x00, 0xFF, 0xFF, // I = 0xFFFF
+		0xF1, 0x55, // 0xFFFF-0x0000 = V0-V1
+		0xA0, 0x00, // I = 0x000
+		0xF0, 0x65, // V0 = 0x0000
+		0x85, 0x00, // V5 = V0
+		0xF0, 0x00, 0xFF, 0xFF, // I = 0xFFFF
+		0xF0, 0x65, // V0 = 0xFFFF
+		0x12, 0x18, // jmp 0x218
+	};
+	XoChip8 c(nullptr, true);
+	run_rom(c, rom, sizeof(rom));
+	bool ok = c.regs()[0] == 0x11 && c.regs()[5] == 0x22;
+	printf("Testing XO-CHIP memory wraps at 0xFFFF...");
+	TEST(ok);
+	return ok;
+}
+
+static bool test_mem_sizes()
+{
+	XoMem big;
+	big.write(0x42, 0xFFFF);
+	bool ok = big.read(0xFFFF) == 0x42 && big.size() == XO_MEM_SIZE
+		&& Mem::PAGES == NUM_PAGES && sizeof(Mem) < sizeof(XoMem);
+	printf("Testing 64KB memory next to the 4KB one...");
+	TEST(ok);
+	return ok;
+}
+
+bool test_xochip::run_all()
+{
+	bool res = true;
+	res = res && test_hires_sprite();
+	res = res && test_lores_scroll();
+	res = res && test_big_font();
+	res = res && test_long_i();
+	res = res && test_planes();
+	res = res && test_shared_core();
+	res = res && test_strict();
+	res = res && test_wrap();
+	res = res && test_mem_sizes();
+	return res;
+}
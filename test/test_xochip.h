@@ -0,0 +1,8 @@
+#ifndef _TEST_XOCHIP_H
+#define _TEST_XOCHIP_H
+
+namespace test_xochip {
+	bool run_all();
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * chip8-probe.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Runs roms headless under every quirk combination and a few instruction
+ * rates, scores how well each run went and writes the best setup for each
+ * rom into the rom database.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chip8.h>
+#include <romdb.h>
+#include <calibrate.h>
+
+#define DEFAULT_FRAMES 1200 // 20 seconds of emulated time
+#define DEFAULT_IPF 10      // what --clock-speed 3 runs at
+#define PROBE_SEED 0xC8C8C8C8
+
+// instruction rates to try, --clock-speed 1, 3, 5, 7 and 10
+static const uint probe_ipfs[] = {4, 10, 16, 22, 31};
+#define NUM_IPFS (sizeof(probe_ipfs) / sizeof(probe_ipfs[0]))
+
+struct Rom {
+    std::string path;
+    std::vector<uint8_t> data;
+};
+
+struct Run {
+    size_t rom;
+    uint8_t quirks;
+    uint ipf;
+    // results
+    bool faulted = false;
+    uint32_t frames = 0;        // frames run before a fault, or all of them
+    uint32_t active = 0;        // frames the screen changed in
+    bool drew = false;          // anything lit at any point
+    uint64_t sprites = 0;
+    uint64_t offscreen = 0;
+    double score = 0;
+};
+
+static void probe(Run &run, const Rom &rom, uint32_t frames)
+{
+    Chip8 chip8(nullptr, 0, true);
+    chip8.set_verbose(false);
+    chip8.set_seed(PROBE_SEED);
+    chip8.load_rom(rom.data.data(), rom.data.size());
+    chip8.set_quirks(run.quirks);
+    chip8.set_ipf(run.ipf);
+
+    uint8_t last[FRAME_WIDTH*FRAME_HEIGHT] = {0};
+    const uint8_t *framebuf = chip8.peripherals().framebuf();
+    for (run.frames = 0; run.frames < frames; run.frames++) {
+        try {
+            chip8.run_frame(script_keys(run.frames));
+        } catch (const Fault &) {
+            run.faulted = true;
+            break;
+        }
+        if (std::memcmp(last, framebuf, sizeof(last)) != 0) {
+            run.active++;
+            std::memcpy(last, framebuf, sizeof(last));
+            run.drew = run.drew || std::find(last, last + sizeof(last), 1) != last + sizeof(last);
+        }
+    }
+    run.sprites = chip8.sprite_draws();
+    run.offscreen = chip8.offscreen_draws();
+
+    // faults first, then roms that never draw, then sprites hanging off the
+    // screen (usually a wrong shift or I quirk), then how alive the screen is
+    run.score = 100.0 * run.active / frames;
+    if (run.sprites)
+        run.score -= 50.0 * run.offscreen / run.sprites;
+    if (!run.drew)
+        run.score -= 1000;
+    if (run.faulted)
+        run.score -= 10000 - 1000.0 * run.frames / frames;
+}
+
+static int popcount(uint8_t x)
+{
+    int n = 0;
+    for (; x; x >>= 1)
+        n += x & 0x1;
+    return n;
+}
+
+/*
+ * Scores within a couple of points are a tie, then the setup closest to the
+ * emulator's defaults wins.
+ */
+static bool better(const Run &a, const Run &b)
+{
+    if (std::abs(a.score - b.score) > 2.0)
+        return a.score > b.score;
+    if (popcount(a.quirks) != popcount(b.quirks))
+        return popcount(a.quirks) < popcount(b.quirks);
+    int da = std::abs((int)a.ipf - DEFAULT_IPF);
+    int db = std::abs((int)b.ipf - DEFAULT_IPF);
+    if (da != db)
+        return da < db;
+    return a.quirks < b.quirks;
+}
+
+static bool read_rom(const char *path, Rom &rom)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::fprintf(stderr, "Error: failed to open %s\n", path);
+        return false;
+    }
+    rom.path = path;
+    rom.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (rom.data.empty() || rom.data.size() > MEM_SIZE - 0x200) {
+        std::fprintf(stderr, "Error: %s is not a chip8 rom\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void print_usage()
+{
+    printf("Usage: chip8-probe [OPTIONS] <rom>...\n");
+    printf("Runs each rom headless under every quirk combination and a few\n");
+    printf("instruction rates, and stores the best setup in the rom database\n");
+    printf("that chip8 reads at startup.\n");
+    printf("\n");
+    printf("OPTIONS:\n");
+    printf("    -j N                Threads to use, default is one per core.\n");
+    printf("    --frames N          Frames per run, default %d.\n", DEFAULT_FRAMES);
+    printf("    --db FILE           Database to update, default %s\n", RomDb::default_path().c_str());
+    printf("    -n, --dry-run       Print the results, don't write the database.\n");
+    printf("    -v, --verbose       Print every run, not just the winner.\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint threads = std::thread::hardware_concurrency();
+    uint32_t frames = DEFAULT_FRAMES;
+    std::string db_path = RomDb::default_path();
+    bool dry_run = false;
+    bool verbose = false;
+    std::vector<Rom> roms;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+        if (arg == "-j" && has_val) {
+            threads = std::strtoul(argv[++i], NULL, 0);
+        } else if (arg == "--frames" && has_val) {
+            frames = std::strtoul(argv[++i], NULL, 0);
+        } else if (arg == "--db" && has_val) {
+            db_path = argv[++i];
+        } else if (arg == "-n" || arg == "--dry-run") {
+            dry_run = true;
+        } else if (arg == "-v" || arg == "--verbose") {
+            verbose = true;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg[0] == '-') {
+            std::fprintf(stderr, "Error: bad argument %s\n", argv[i]);
+            print_usage();
+            return 1;
+        } else {
+            Rom rom;
+            if (!read_rom(argv[i], rom))
+                return 1;
+            roms.push_back(rom);
+        }
+    }
+    if (roms.empty() || frames == 0) {
+        print_usage();
+        return 1;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    std::vector<Run> runs;
+    for (size_t r = 0; r < roms.size(); r++) {
+        for (uint q = 0; q < QUIRK_COMBOS; q++) {
+            for (size_t i = 0; i < NUM_IPFS; i++) {
+                Run run;
+                run.rom = r;
+                run.quirks = q;
+                run.ipf = probe_ipfs[i];
+                runs.push_back(run);
+            }
+        }
+    }
+
+    // runs are independent, hand them out one at a time
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (uint t = 0; t < threads; t++) {
+        pool.emplace_back([&]() {
+            size_t i;
+            while ((i = next++) < runs.size())
+                probe(runs[i], roms[runs[i].rom], frames);
+        });
+    }
+    for (auto &t : pool)
+        t.join();
+
+    RomDb db;
+    db.load(db_path);
+    size_t per_rom = QUIRK_COMBOS * NUM_IPFS;
+    for (size_t r = 0; r < roms.size(); r++) {
+        const Run *best = &runs[r * per_rom];
+        for (size_t i = r * per_rom; i < (r + 1) * per_rom; i++) {
+            const Run &run = runs[i];
+            if (verbose) {
+                printf("  %-24s ipf %2u %-36s score %7.1f active %u/%u offscreen %llu/%llu%s\n",
+                       roms[r].path.c_str(), run.ipf, format_quirks(run.quirks).c_str(),
+                       run.score, run.active, frames, (unsigned long long)run.offscreen,
+                       (unsigned long long)run.sprites, run.faulted ? " FAULT" : "");
+            }
+            if (better(run, *best))
+                best = &run;
+        }
+
+        uint64_t hash = rom_hash(roms[r].data.data(), roms[r].data.size());
+        printf("%016llx %s: ipf %u quirks %s score %.1f%s\n", (unsigned long long)hash,
+               roms[r].path.c_str(), best->ipf, format_quirks(best->quirks).c_str(),
+               best->score, best->faulted ? " (faults under every setup)" : "");
+
+        RomDbEntry entry;
+        const RomDbEntry *old = db.find(hash);
+        if (old != nullptr)
+            entry = *old;
+        entry.ipf = best->ipf;
+        entry.quirks = best->quirks;
+        size_t slash = roms[r].path.rfind('/');
+        entry.comment = roms[r].path.substr(slash == std::string::npos ? 0 : slash + 1);
+        db.set(hash, entry);
+    }
+
+    if (!dry_run) {
+        if (!db.save(db_path))
+            return 1;
+        printf("wrote %zu roms to %s\n", db.size(), db_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * chip8-remote.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Follows the frames chip8 --stream sends and prints one line per frame.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <stream.h>
+
+static void print_usage()
+{
+    printf("Usage: chip8-remote [--keys MASK] [--frames N] [--show] <addr>\n");
+    printf("Connects to chip8 --stream ADDR (a port on 127.0.0.1 or a Unix socket\n");
+    printf("path) and prints a line per frame received: the frame, the bytes it\n");
+    printf("took and the lit pixels. Frames only come when the screen changes.\n");
+    printf("\n");
+    printf("    --keys MASK         Hold these keypad keys (hex, bit n is key n).\n");
+    printf("    --frames N          Stop after N frames.\n");
+    printf("    --show              Draw each frame as text.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = NULL;
+    long keys = -1;
+    unsigned long frames = 0;
+    bool show = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+        if (arg == "--keys" && has_val) {
+            keys = std::strtol(argv[++i], NULL, 16);
+        } else if (arg == "--frames" && has_val) {
+            frames = std::strtoul(argv[++i], NULL, 0);
+        } else if (arg == "--show") {
+            show = true;
+        } else if (arg[0] != '-' && addr == NULL) {
+            addr = argv[i];
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    if (addr == NULL || keys > 0xFFFF) {
+        print_usage();
+        return 2;
+    }
+
+    StreamClient client;
+    if (!client.connect(addr))
+        return 1;
+    for (uint8_t k = 0; keys > 0 && k < 16; k++) {
+        if ((keys & (1 << k)) && !client.send_key(k, true))
+            return 1;
+    }
+
+    unsigned long seen = 0;
+    uint32_t frame;
+    size_t bytes;
+    while (frames == 0 || seen < frames) {
+        if (!client.read_frame(frame, bytes))
+            return 0;
+        int lit = 0;
+        for (uint y = 0; y < FRAME_HEIGHT; y++) {
+            for (uint x = 0; x < FRAME_WIDTH; x++) {
+                lit += client.pixel(x, y);
+            }
+        }
+        printf("frame %u bytes %zu lit %d\n", frame, bytes, lit);
+        if (show) {
+            for (uint y = 0; y < FRAME_HEIGHT; y++) {
+                std::string row;
+                for (uint x = 0; x < FRAME_WIDTH; x++) {
+                    row += client.pixel(x, y) ? '#' : '.';
+                }
+                printf("%s\n", row.c_str());
+            }
+        }
+        seen++;
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * chip8-trace.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Decodes, filters and diffs the execution traces written by chip8 --trace.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <trace.h>
+
+struct Filter {
+    uint32_t pc_lo = 0, pc_hi = 0xFFFF;
+    uint32_t frame_lo = 0, frame_hi = 0xFFFFFFFF;
+    uint16_t op_mask = 0, op_val = 0; // from a pattern like "DXYN" or "F?55"
+    int reg = -1;                     // only records that changed this V
+};
+
+class TraceReader {
+private:
+    gzFile m_file;
+
+public:
+    TraceReader() : m_file(NULL) {}
+    ~TraceReader() { if (m_file) gzclose(m_file); }
+
+    bool open(const char *path)
+    {
+        m_file = gzopen(path, "rb");
+        if (m_file == NULL) {
+            std::fprintf(stderr, "Error: failed to open %s\n", path);
+            return false;
+        }
+        TraceHeader header;
+        if (gzread(m_file, &header, sizeof(header)) != (int)sizeof(header)
+                || std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+            std::fprintf(stderr, "Error: %s is not a chip8 trace\n", path);
+            return false;
+        }
+        if (header.record_size != sizeof(TraceRecord)) {
+            std::fprintf(stderr, "Error: %s has %u byte records, expected %zu\n",
+                         path, header.record_size, sizeof(TraceRecord));
+            return false;
+        }
+        return true;
+    }
+
+    bool next(TraceRecord &r)
+    {
+        return gzread(m_file, &r, sizeof(r)) == (int)sizeof(r);
+    }
+};
+
+static bool parse_range(const char *arg, uint32_t &lo, uint32_t &hi)
+{
+    char *end;
+    lo = std::strtoul(arg, &end, 0);
+    if (end == arg)
+        return false;
+    hi = lo;
+    if (*end == '-') {
+        const char *start = end + 1;
+        hi = std::strtoul(start, &end, 0);
+        if (end == start)
+            return false;
+    }
+    return *end == '\0' && lo <= hi;
+}
+
+/*
+ * Four characters, one per nibble. Hex digits must match, anything else
+ * is a wildcard.
+ */
+static bool parse_op(const char *arg, uint16_t &mask, uint16_t &val)
+{
+    if (std::strlen(arg) != 4)
+        return false;
+    mask = 0;
+    val = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = arg[i];
+        int nib = -1;
+        if (c >= '0' && c <= '9')
+            nib = c - '0';
+        else if (c >= 'A' && c <= 'F')
+            nib = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f')
+            nib = c - 'a' + 10;
+        mask <<= 4;
+        val <<= 4;
+        if (nib >= 0) {
+            mask |= 0xF;
+            val |= nib;
+        }
+    }
+    return true;
+}
+
+static bool matches(const Filter &f, const TraceRecord &r)
+{
+    return r.pc >= f.pc_lo && r.pc <= f.pc_hi
+        && r.frame >= f.frame_lo && r.frame <= f.frame_hi
+        && (r.opcode & f.op_mask) == f.op_val
+        && (f.reg < 0 || (r.vmask >> f.reg) & 0x1);
+}
+
+static void print_record(uint64_t idx, const TraceRecord &r, const char *prefix = "")
+{
+    std::printf("%s%8llu f%-6u %04X: %04X  I=%03X DT=%02X", prefix,
+                (unsigned long long)idx, r.frame, r.pc, r.opcode, r.I, r.timer);
+    for (int i = 0; i < 16; i++) {
+        if ((r.vmask >> i) & 0x1)
+            std::printf(" V%X=%02X", i, r.V[i]);
+    }
+    if (r.wlen) {
+        // the only writers are FX33 and FX55, so the bytes follow from V
+        uint8_t x = (r.opcode >> 8) & 0xF;
+        std::printf("  [%03X]<-", r.waddr);
+        if ((r.opcode & 0xFF) == 0x33) {
+            std::printf(" %02X %02X %02X", r.V[x] / 100, (r.V[x] / 10) % 10, r.V[x] % 10);
+        } else {
+            for (int i = 0; i < r.wlen; i++)
+                std::printf(" %02X", r.V[i]);
+        }
+    }
+    std::printf("\n");
+}
+
+static int dump(const char *path, const Filter &f)
+{
+    TraceReader reader;
+    if (!reader.open(path))
+        return 2;
+    TraceRecord r;
+    uint64_t idx = 0;
+    uint64_t shown = 0;
+    for (; reader.next(r); idx++) {
+        if (matches(f, r)) {
+            print_record(idx, r);
+            shown++;
+        }
+    }
+    std::fprintf(stderr, "%llu of %llu records\n",
+                 (unsigned long long)shown, (unsigned long long)idx);
+    return 0;
+}
+
+/*
+ * Walk both traces in step and report the first record that differs, with
+ * a few records of shared history before it.
+ */
+static int diff(const char *path_a, const char *path_b, const Filter &f, size_t context)
+{
+    TraceReader a, b;
+    if (!a.open(path_a) || !b.open(path_b))
+        return 2;
+    std::deque<std::pair<uint64_t, TraceRecord>> history;
+    TraceRecord ra, rb;
+    uint64_t idx = 0;
+    while (true) {
+        bool more_a = a.next(ra);
+        bool more_b = b.next(rb);
+        if (!more_a && !more_b) {
+            std::printf("traces match (%llu records)\n", (unsigned long long)idx);
+            return 0;
+        }
+        if (more_a != more_b) {
+            for (auto &h : history)
+                print_record(h.first, h.second, "  ");
+            std::printf("%s ends after %llu records\n", more_a ? path_b : path_a,
+                        (unsigned long long)idx);
+            return 1;
+        }
+        if (std::memcmp(&ra, &rb, sizeof(ra)) != 0 && matches(f, ra)) {
+            for (auto &h : history)
+                print_record(h.first, h.second, "  ");
+            print_record(idx, ra, "< ");
+            print_record(idx, rb, "> ");
+            return 1;
+        }
+        if (context) {
+            if (history.size() == context)
+                history.pop_front();
+            history.emplace_back(idx, ra);
+        }
+        idx++;
+    }
+}
+
+static void print_usage()
+{
+    printf("Usage: chip8-trace dump [FILTERS] <trace>\n");
+    printf("       chip8-trace diff [FILTERS] [--context N] <trace-a> <trace-b>\n");
+    printf("Decodes traces recorded with chip8 --trace. Each line is the record\n");
+    printf("index, frame, pc, opcode, I and delay timer after the instruction, the\n");
+    printf("registers it changed and any bytes it wrote to memory.\n");
+    printf("\n");
+    printf("FILTERS:\n");
+    printf("    --pc LO[-HI]        Only instructions at these addresses.\n");
+    printf("    --frame LO[-HI]     Only instructions run in these frames.\n");
+    printf("    --op PATTERN        Only opcodes matching PATTERN, one character per\n");
+    printf("                        nibble, non hex characters match anything (DXYN).\n");
+    printf("    --reg N             Only instructions that changed VN.\n");
+    printf("\n");
+    printf("diff stops at the first differing record that passes the filters and\n");
+    printf("exits with 1, or 0 if the traces match.\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        print_usage();
+        return 2;
+    }
+    std::string cmd = argv[1];
+    Filter f;
+    size_t context = 8;
+    const char *files[2];
+    int nfiles = 0;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--pc" && has_val) {
+            ok = parse_range(argv[++i], f.pc_lo, f.pc_hi);
+        } else if (arg == "--frame" && has_val) {
+            ok = parse_range(argv[++i], f.frame_lo, f.frame_hi);
+        } else if (arg == "--op" && has_val) {
+            ok = parse_op(argv[++i], f.op_mask, f.op_val);
+        } else if (arg == "--reg" && has_val) {
+            f.reg = std::strtol(argv[++i], NULL, 16);
+            ok = f.reg >= 0 && f.reg < 16;
+        } else if (arg == "--context" && has_val) {
+            context = std::strtoul(argv[++i], NULL, 0);
+        } else if (arg[0] != '-' && nfiles < 2) {
+            files[nfiles++] = argv[i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "Error: bad argument %s\n", argv[i]);
+            print_usage();
+            return 2;
+        }
+    }
+
+    if (cmd == "dump" && nfiles == 1)
+        return dump(files[0], f);
+    if (cmd == "diff" && nfiles == 2)
+        return diff(files[0], files[1], f, context);
+    print_usage();
+    return 2;
+}
@@ -0,0 +1,93 @@
+/*
+ * chip8-watch.cpp
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Follows the frames chip8 --shm publishes and prints one line per frame.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <shm_export.h>
+
+static void print_usage()
+{
+    printf("Usage: chip8-watch [--keys MASK] [--frames N] <name>\n");
+    printf("Follows the shared memory segment written by chip8 --shm NAME and\n");
+    printf("prints a line per frame: publish index, frame, pc, I, delay timer,\n");
+    printf("lit pixels and V0-VF. Frames the ring moved past before they were\n");
+    printf("read are reported as skipped.\n");
+    printf("\n");
+    printf("    --keys MASK         Hold these keypad keys (hex, bit n is key n).\n");
+    printf("    --frames N          Stop after N frames.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = NULL;
+    long keys = -1;
+    unsigned long frames = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+        if (arg == "--keys" && has_val) {
+            keys = std::strtol(argv[++i], NULL, 16);
+        } else if (arg == "--frames" && has_val) {
+            frames = std::strtoul(argv[++i], NULL, 0);
+        } else if (arg[0] != '-' && name == NULL) {
+            name = argv[i];
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    if (name == NULL || keys > 0xFFFF) {
+        print_usage();
+        return 2;
+    }
+
+    ShmReader reader;
+    if (!reader.open(name))
+        return 1;
+    if (keys >= 0)
+        reader.set_keys(keys);
+
+    // start from the newest frame, not from whatever the ring still holds
+    uint64_t n = reader.head();
+    if (n > 0)
+        n--;
+    unsigned long seen = 0;
+    ShmFrame f;
+    while (frames == 0 || seen < frames) {
+        switch (reader.read(n, f)) {
+        case SHM_NOT_YET:
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        case SHM_OVERWRITTEN: {
+            uint64_t head = reader.head();
+            printf("skipped %llu\n", (unsigned long long)(head - n - 1));
+            n = head - 1;
+            continue;
+        }
+        case SHM_OK:
+            break;
+        }
+        int lit = 0;
+        for (uint8_t px : f.framebuf) {
+            lit += px & 0x1;
+        }
+        printf("%llu frame %llu pc 0x%04X I 0x%04X timer %u lit %d V",
+               (unsigned long long)n, (unsigned long long)f.frame, f.pc, f.I, f.timer, lit);
+        for (int r = 0; r < 16; r++) {
+            printf(" %02X", f.V[r]);
+        }
+        printf("\n");
+        n++;
+        seen++;
+    }
+    return 0;
+}